@@ -9,9 +9,28 @@
 #include "ck2/DefinitionsTable.h"
 #include "ck2/AdjacenciesFile.h"
 #include "ck2/ProvMap.h"
+#include "ck2/ProvMapRLE.h"
+#include "ck2/ProvGeometry.h"
+#include "ck2/ProvGraph.h"
+#include "ck2/ProvPathfinder.h"
 #include "ck2/date.h"
 #include "ck2/fp_decimal.h"
 #include "ck2/parser.h"
+#include "ck2/keyword.h"
+#include "ck2/writer.h"
+#include "ck2/bulk_write.h"
+#include "ck2/bulk_load.h"
+#include "ck2/Workspace.h"
+#include "ck2/WorkspaceWatcher.h"
+#include "ck2/FolderView.h"
+#include "ck2/HistoryTimeline.h"
+#include "ck2/SymbolTable.h"
+#include "ck2/query.h"
+#include "ck2/bind.h"
+#include "ck2/snapshot.h"
+#include "ck2/save_index.h"
+#include "ck2/binary_parser.h"
+#include "ck2/zip.h"
 
 
 #endif
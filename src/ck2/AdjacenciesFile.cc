@@ -3,7 +3,7 @@
 #include "DefaultMap.h"
 #include "VFS.h"
 #include <memory>
-#include <fstream>
+#include <string>
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
@@ -103,33 +103,25 @@ AdjacenciesFile::AdjacenciesFile(const VFS& vfs, const DefaultMap& dm)
 }
 
 
-void AdjacenciesFile::write(const fs::path& out_path)
+void AdjacenciesFile::write(const fs::path& out_path) const
 {
-  // TODO: needs a unique_file_ptr-like thing (exception guard to close/release the file should we return
-  // unexpectedly)
-
-  const std::string spath = out_path.generic_string();
-  std::ofstream os(spath);
+  write_file_atomic(out_path, [this](std::FILE* f) { write(f); });
+}
 
-  // don't think errno is set for ofstream failure, and the C++ exception model for iostreams is fucking uber-
-  // complicated. perma-TODO to decide whether IOStreams are worthwhile (on the input side mainly, but it'd be
-  // nice to use one API for both).
-  if (!os)
-    throw FLError(out_path, "Failed to write to adjacencies file: {}", strerror(errno));
 
-  os << "From;To;Type;Through;-1;-1;-1;-1;Comment\n";
+void AdjacenciesFile::write(std::FILE* f) const
+{
+  fmt::print(f, "From;To;Type;Through;-1;-1;-1;-1;Comment\n");
 
   /* again, NOTE from 2018: apparently 0-values are blanks. k, IDK, whatever. */
 
+  const auto id_str = [](uint id) { return (id) ? std::to_string(id) : std::string(); }; // treat 0-value as blank
+
   for (const auto& adj : _v)
   {
     if (adj.deleted) continue;
-    if (adj.from) os << adj.from; // treat 0-value as blank
-    os << ';';
-    if (adj.to) os << adj.to; // treat 0-value as blank
-    os << ';' << adj.type << ';';
-    if (adj.through) os << adj.through; // treat 0-value as blank
-    os << ";-1;-1;-1;-1;" << adj.comment << '\n';
+    fmt::print(f, "{};{};{};{};-1;-1;-1;-1;{}\n",
+               id_str(adj.from), id_str(adj.to), adj.type, id_str(adj.through), adj.comment);
   }
 }
 
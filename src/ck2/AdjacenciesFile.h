@@ -32,7 +32,10 @@ public:
 public:
   AdjacenciesFile() {}
   AdjacenciesFile(const VFS&, const DefaultMap&);
-  void write(const fs::path&);
+
+  // write back to a file (atomically replacing it) or to an already-open stream
+  void write(const fs::path&) const;
+  void write(std::FILE*) const;
 
   /* give this type a container-like interface and C++11 range-based-for support */
   auto size()  const noexcept { return _v.size(); }
@@ -1,132 +1,130 @@
 
 #include "DefaultMap.h"
-#include "parser.h"
-#include <cassert>
-#include <string>
-#include <unordered_map>
-#include <string_view>
+#include "bind.h"
+#include <array>
+#include <limits>
+#include <tuple>
+#include <vector>
 
 
 NAMESPACE_CK2;
 
 
-DefaultMap::DefaultMap(const VFS& vfs)
-: _max_prov_id(0),
-  _req_path_map({
-    {"definitions", _definitions_path},
-    {"provinces", _province_map_path},
-    {"positions", _positions_path},
-    {"terrain", _terrain_map_path},
-    {"rivers", _river_map_path},
-    {"terrain_definition", _terrain_path},
-    {"heightmap", _height_map_path},
-    {"tree_definition", _tree_map_path},
-    {"continent", _continent_path},
-    {"adjacencies", _adjacencies_path},
-    {"climate", _climate_path},
-    {"geographical_region", _geo_region_path},
-    {"region", _island_region_path},
-    {"static", _statics_path},
-    {"seasons", _seasons_path},
-  })
-{
-  parser prs( vfs["map/default.map"] );
-
-  // first, do a full scan for the 'max_provinces' value so that we may validate as we go on the next pass
-
-  for (const auto& s : *prs.root_block())
-  {
-    if (s.key() == "max_provinces")
-    {
-      if (!s.value().is_integer())
-        throw prs.err(s.value(), "Invalid value type for 'max_provinces' (requires an integer)");
+namespace {
+  // the parts of default.map which we marshal, as bound straight from the file's tokens
+  struct default_map_script {
+    located<int> max_provinces;
+    fs::path     definitions;
+    fs::path     provinces;
+    fs::path     positions;
+    fs::path     terrain;
+    fs::path     rivers;
+    fs::path     terrain_definition;
+    fs::path     heightmap;
+    fs::path     tree_definition;
+    fs::path     continent;
+    fs::path     adjacencies;
+    fs::path     climate;
+    fs::path     geographical_region;
+    fs::path     region;
+    fs::path     statics;
+    fs::path     seasons;
+    std::vector<located<std::array<located<int>, 2>>> sea_zones;
+    std::vector<std::vector<located<int>>> major_rivers;
+  };
+}
 
-      const auto max_provinces = s.value().as_integer();
-      const auto min_cap = 2;
-      const auto max_cap = std::numeric_limits<uint16_t>::max();
 
-      if (max_provinces < min_cap)
-        throw prs.err(s.value(),
-                "'max_provinces' value ({}) too low (should be at least {})",
-                max_provinces, min_cap);
+template<>
+struct bind_schema<default_map_script> {
+  using S = default_map_script;
+  static constexpr auto REQ = bind_flag::REQUIRED;
 
-      if (max_provinces > max_cap)
-        throw prs.err(s.value(),
-                "'max_provinces' value ({}) too high (should be no more than {})",
-                max_provinces, max_cap);
+  // TODO: marshal & validate externals and ocean_region too!
+  static constexpr auto fields = std::make_tuple(
+    bind_field{ "max_provinces",       &S::max_provinces,       REQ },
+    bind_field{ "definitions",         &S::definitions,         REQ },
+    bind_field{ "provinces",           &S::provinces,           REQ },
+    bind_field{ "positions",           &S::positions,           REQ },
+    bind_field{ "terrain",             &S::terrain,             REQ },
+    bind_field{ "rivers",              &S::rivers,              REQ },
+    bind_field{ "terrain_definition",  &S::terrain_definition,  REQ },
+    bind_field{ "heightmap",           &S::heightmap,           REQ },
+    bind_field{ "tree_definition",     &S::tree_definition,     REQ },
+    bind_field{ "continent",           &S::continent,           REQ },
+    bind_field{ "adjacencies",         &S::adjacencies,         REQ },
+    bind_field{ "climate",             &S::climate,             REQ },
+    bind_field{ "geographical_region", &S::geographical_region, REQ },
+    bind_field{ "region",              &S::region,              REQ },
+    bind_field{ "static",              &S::statics,             REQ },
+    bind_field{ "seasons",             &S::seasons,             REQ },
+    bind_field{ "sea_zones",           &S::sea_zones,           REQ | bind_flag::REPEATED },
+    bind_field{ "major_rivers",        &S::major_rivers,        bind_flag::REPEATED });
+};
 
-      _max_prov_id = max_provinces - 1;
-    }
-  }
 
-  if (!_max_prov_id)
-    throw prs.err("'max_provinces' not defined");
+DefaultMap::DefaultMap(const VFS& vfs)
+: _max_prov_id(0)
+{
+  const auto f = vfs.open("map/default.map");
+  const auto data = (f.in_archive()) ? f.read() : std::string();
+  buffer_input in(data);
+  bind_reader r = (f.in_archive()) ? bind_reader(in, f.path) : bind_reader(f.path);
+  auto dm = bind<default_map_script>(r);
 
-  for (const auto& s : *prs.root_block())
   {
-    if (s.key() == "sea_zones")
-    {
-      const auto& obj_list = *s.value().as_list();
-
-      if (obj_list.size() != 2)
-        throw prs.err(s.key(),
-                "'sea_zones' range has invalid number of elements (needs exactly 2 province IDs)");
-
-      int i = 0, prov_id_range[2];
-
-      for (auto& o : obj_list)
-      {
-        if (!o.is_integer())
-          throw prs.err(o, "Non-integer found within 'sea_zones' range (may only contain province IDs)");
+    const auto& [max_provinces, loc] = dm.max_provinces;
+    const auto min_cap = 2;
+    const auto max_cap = std::numeric_limits<uint16_t>::max();
 
-        auto& prov_id = prov_id_range[i++] = o.as_integer();
+    if (max_provinces < min_cap)
+      throw r.err(loc, "'max_provinces' value ({}) too low (should be at least {})", max_provinces, min_cap);
 
-        if (!is_valid_province(prov_id))
-          throw prs.err(o, "Invalid province ID #{} in 'sea_zones' range", prov_id);
-      }
+    if (max_provinces > max_cap)
+      throw r.err(loc, "'max_provinces' value ({}) too high (should be no more than {})",
+                  max_provinces, max_cap);
 
-      if (auto [start, end] = prov_id_range; start <= end)
-        _seazone_vec.emplace_back( SeaRange{uint(start), uint(end)} );
-      else
-        throw prs.err(s.key(), "In 'sea_zones' range, start ID #{} is greater than end ID #{}", start, end);
-    }
-    else if (s.key() == "major_rivers")
-    {
-      if (!s.value().is_list())
-        throw prs.err(s.value(), "Invalid value type for 'major_rivers' clause (needs province ID list)");
-
-      const auto& obj_list = *s.value().as_list();
+    _max_prov_id = max_provinces - 1;
+  }
 
-      for (auto& o : obj_list)
-      {
-        if (!o.is_integer())
-          throw prs.err(o, "Non-integer in 'major_rivers' clause (may only contain province IDs)");
+  for (const auto& [range, range_loc] : dm.sea_zones)
+  {
+    for (const auto& [prov_id, loc] : range)
+      if (!is_valid_province(prov_id))
+        throw r.err(loc, "Invalid province ID #{} in 'sea_zones' range", prov_id);
+
+    if (auto start = range[0].value, end = range[1].value; start <= end)
+      _seazone_vec.emplace_back( SeaRange{uint(start), uint(end)} );
+    else
+      throw r.err(range_loc, "In 'sea_zones' range, start ID #{} is greater than end ID #{}", start, end);
+  }
 
-        if (int prov_id = o.as_integer(); is_valid_province(prov_id))
-          _major_river_set.insert(prov_id);
-        else
-          throw prs.err(o, "Invalid province ID #{} in 'major_rivers' clause", prov_id);
-      }
-    }
-    else if (s.key().is_string())
+  for (const auto& rivers : dm.major_rivers)
+  {
+    for (const auto& [prov_id, loc] : rivers)
     {
-      if (auto it = _req_path_map.find(s.key().as_string()); it != _req_path_map.end()) {
-        auto&& [k, v] = *it;
-
-        if (!s.value().is_string())
-          throw prs.err(s.value(), "Invalid value type for '{}' (requires a string)", k);
-
-        v = s.value().as_string();
-      }
+      if (is_valid_province(prov_id))
+        _major_river_set.insert(prov_id);
+      else
+        throw r.err(loc, "Invalid province ID #{} in 'major_rivers' clause", prov_id);
     }
   }
 
-  // TODO: marshal & validate externals and ocean_region too!
-
-  if (_seazone_vec.empty()) throw prs.err("No 'sea_zones' range(s) defined");
-
-  for (auto&& [k, v] : _req_path_map)
-    if (v.empty()) throw prs.err("Required key '{}' not defined (value should be a path)", k);
+  _definitions_path   = std::move(dm.definitions);
+  _province_map_path  = std::move(dm.provinces);
+  _positions_path     = std::move(dm.positions);
+  _terrain_map_path   = std::move(dm.terrain);
+  _river_map_path     = std::move(dm.rivers);
+  _terrain_path       = std::move(dm.terrain_definition);
+  _height_map_path    = std::move(dm.heightmap);
+  _tree_map_path      = std::move(dm.tree_definition);
+  _continent_path     = std::move(dm.continent);
+  _adjacencies_path   = std::move(dm.adjacencies);
+  _climate_path       = std::move(dm.climate);
+  _geo_region_path    = std::move(dm.geographical_region);
+  _island_region_path = std::move(dm.region);
+  _statics_path       = std::move(dm.statics);
+  _seasons_path       = std::move(dm.seasons);
 }
 
 
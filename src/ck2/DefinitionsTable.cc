@@ -119,16 +119,11 @@ DefinitionsTable::DefinitionsTable(const VFS& vfs, const DefaultMap& dm)
 
 
 void DefinitionsTable::write(const fs::path& path) const {
-  auto spath = path.generic_string();
-
-  // in the future, use a unique_file_ptr that doesn't discard the return value of std::fclose(FILE*) and checks
-  // it for an error condition.
-  unique_file_ptr ufp( std::fopen(spath.c_str(), "wb"), std::fclose );
-  auto f = ufp.get();
+  write_file_atomic(path, [this](std::FILE* f) { write(f); });
+}
 
-  if (f == nullptr)
-    throw Error("Failed to open file for writing: {}: {}", strerror(errno), spath);
 
+void DefinitionsTable::write(std::FILE* f) const {
   fmt::print(f, "province;red;green;blue;name;x\n");
 
   for (const auto& r : *this)
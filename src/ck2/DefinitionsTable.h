@@ -35,8 +35,9 @@ public:
   // construct from an existing file
   DefinitionsTable(const VFS&, const DefaultMap&);
 
-  // write back to a file
+  // write back to a file (atomically replacing it) or to an already-open stream
   void write(const fs::path& output_path) const;
+  void write(std::FILE*) const;
 
   /* act somewhat like an STL container... */
 
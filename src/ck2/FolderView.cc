@@ -0,0 +1,132 @@
+
+#include "FolderView.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <exception>
+
+
+NAMESPACE_CK2;
+
+
+const std::vector<FolderView::def> FolderView::s_no_defs;
+
+
+FolderView::FolderView(const VFS& vfs, const fs::path& virt_dir, std::string_view ext, uint n_threads,
+                       nest_fn nested)
+: _n_keys(0)
+{
+  const auto vfiles = vfs.list_dir(virt_dir, ext);
+  std::vector<std::shared_ptr<const parser>> parsed(vfiles.size());
+  std::vector<std::string> errs(vfiles.size());
+
+  // largest first, so that a big file picked up late can't serialize the tail of the load
+  std::vector<std::pair<uintmax_t, size_t>> order;
+  order.reserve(vfiles.size());
+
+  for (size_t i = 0; i < vfiles.size(); ++i)
+  {
+    std::error_code ec;
+    const auto& f = vfiles[i];
+    const uintmax_t sz = (f.in_archive()) ? f.p_entry->size : fs::file_size(f.path, ec);
+    order.emplace_back((ec) ? 0 : sz, i);
+  }
+
+  std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  parallel_for(order.size(), [&](size_t k)
+  {
+    const size_t i = order[k].second;
+
+    try
+    {
+      parsed[i] = vfiles[i].parse();
+    }
+    catch (const std::exception& e)
+    {
+      errs[i] = e.what();
+    }
+  }, n_threads);
+
+  for (size_t i = 0; i < vfiles.size(); ++i)
+  {
+    if (parsed[i])
+      _files.push_back(std::move(parsed[i]));
+    else
+      _errors.push_back(load_error{ vfiles[i].virt_path, vfiles[i].path, std::move(errs[i]) });
+  }
+
+  build_index(n_threads, nested);
+}
+
+
+FolderView::FolderView(std::vector<std::shared_ptr<const parser>> files, uint n_threads, nest_fn nested)
+: _files(std::move(files)), _n_keys(0)
+{
+  build_index(n_threads, nested);
+}
+
+
+void FolderView::build_index(uint n_threads, nest_fn nested)
+{
+  struct entry {
+    std::string_view key;
+    def d;
+  };
+
+  /* bucket each file's top-level string keys (& the nested keys beneath them, if any) by shard */
+
+  std::vector<std::vector<std::vector<entry>>> buckets(_files.size()); // [file][shard]
+
+  parallel_for(_files.size(), [&](size_t f)
+  {
+    auto& fb = buckets[f];
+    fb.resize(N_SHARDS);
+
+    auto add = [&](const statement& s)
+    {
+      const auto key = s.key().as_string_view();
+      fb[shard_of(key)].push_back(entry{ key, def{ &s, static_cast<uint>(f) } });
+    };
+
+    // the keys nested in the block of an accepted key
+    auto add_nested = [&](const statement& parent, auto& add_nested) -> void
+    {
+      if (!parent.value().is_block())
+        return;
+
+      for (const auto& s : *parent.value().as_block())
+        if (s.key().is_string() && nested(s.key().as_string()))
+        {
+          add(s);
+          add_nested(s, add_nested);
+        }
+    };
+
+    for (const auto& s : *_files[f]->root_block())
+      if (s.key().is_string())
+      {
+        add(s);
+
+        if (nested && nested(s.key().as_string()))
+          add_nested(s, add_nested);
+      }
+  }, n_threads);
+
+  /* fill each shard's map, visiting the files in load order so that each key's definitions end up in order */
+
+  parallel_for(N_SHARDS, [&](size_t sh)
+  {
+    auto& m = _shards[sh];
+
+    for (const auto& fb : buckets)
+      for (const auto& e : fb[sh])
+        m[e.key].push_back(e.d);
+  }, n_threads);
+
+  for (const auto& m : _shards)
+    _n_keys += m.size();
+}
+
+
+NAMESPACE_CK2_END;
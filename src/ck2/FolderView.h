@@ -0,0 +1,103 @@
+#ifndef LIBCK2_FOLDER_VIEW_H
+#define LIBCK2_FOLDER_VIEW_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "bulk_load.h"
+#include "parser.h"
+#include "VFS.h"
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+/* FOLDER_VIEW -- the merged namespace of a folder whose files the game reads as one (e.g.,
+ * common/landed_titles, common/cultures, common/traits)
+ *
+ * the game reads such a folder's files in filename order, and a top-level key that's defined again later (in
+ * the same file or a later one) replaces the earlier definition. the view indexes every top-level string key
+ * across every file, so "where is k_france defined, and what does it shadow?" is a hash lookup rather than a
+ * scan of hundreds of trees. the index is built in parallel: each file's keys are bucketed by hash
+ * concurrently, and then each bucket's map is filled concurrently (visiting the files in order, so no locking
+ * is needed).
+ *
+ * some folders nest their definitions: common/landed_titles defines k_france within e_francia, and so on down
+ * to baronies. for those, pass a predicate on keys (e.g., looks_like_title) as `nested`, and the blocks of
+ * top-level keys it accepts are searched for further keys it accepts, recursively, which are indexed as well
+ * (in document order, after their parent).
+ */
+
+class FolderView {
+public:
+  struct def {
+    const statement* p_stmt;
+    uint             file_idx; // into files()
+  };
+
+  using nest_fn = bool (*)(const char* key);
+
+  // load & index the folder's files (w/ mod overrides applied; see VFS::list_dir). files which fail to parse
+  // are reported in errors() and otherwise skipped. n_threads = 0 means one per hardware thread.
+  FolderView(const VFS&, const fs::path& virt_dir, std::string_view ext = ".txt", uint n_threads = 0,
+             nest_fn nested = nullptr);
+
+  // index already-parsed files, given in load order (e.g., from a Workspace)
+  FolderView(std::vector<std::shared_ptr<const parser>> files, uint n_threads = 0, nest_fn nested = nullptr);
+
+  const auto& files()  const noexcept { return _files; }
+  const auto& errors() const noexcept { return _errors; }
+
+  // every definition of a key in load order, so the winner is last, and the rest are those it shadows. empty if
+  // the key isn't defined.
+  const std::vector<def>& defs(std::string_view key) const noexcept
+  {
+    const auto& m = _shards[shard_of(key)];
+    auto i = m.find(key);
+    return (i != m.end()) ? i->second : s_no_defs;
+  }
+
+  // the winning definition of a key, or nullptr
+  const def* winner(std::string_view key) const noexcept
+  {
+    const auto& v = defs(key);
+    return (v.empty()) ? nullptr : &v.back();
+  }
+
+  // the winning statement of a key, or nullptr
+  const statement* find(std::string_view key) const noexcept
+  {
+    auto p = winner(key);
+    return (p) ? p->p_stmt : nullptr;
+  }
+
+  FLoc floc(const def& d) const { return _files[d.file_idx]->floc(d.p_stmt->key()); }
+
+  size_t key_count() const noexcept { return _n_keys; }
+
+private:
+  static const size_t N_SHARDS = 64;
+
+  using key_map = std::unordered_map<std::string_view, std::vector<def>>; // keys point into the trees
+
+  static size_t shard_of(std::string_view key) noexcept
+  {
+    return std::hash<std::string_view>{}(key) % N_SHARDS;
+  }
+
+  void build_index(uint n_threads, nest_fn nested);
+
+  static const std::vector<def> s_no_defs;
+
+  std::vector<std::shared_ptr<const parser>> _files;
+  std::vector<load_error> _errors;
+  key_map _shards[N_SHARDS];
+  size_t  _n_keys;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,215 @@
+
+#include "HistoryTimeline.h"
+#include "parallel.h"
+#include "strutil.h"
+
+#include <algorithm>
+#include <cctype>
+
+
+NAMESPACE_CK2;
+
+
+const date HistoryTimeline::BEGINNING(std::numeric_limits<int16_t>::min(), 1, 1);
+
+
+const char* HistoryTimeline::virt_dir(history_kind k) noexcept
+{
+  switch (k)
+  {
+    case history_kind::PROVINCES:  return "history/provinces";
+    case history_kind::TITLES:     return "history/titles";
+    case history_kind::CHARACTERS: return "history/characters";
+  }
+
+  return "";
+}
+
+
+HistoryTimeline::HistoryTimeline(const VFS& vfs, history_kind kind, uint n_threads)
+: _kind(kind)
+{
+  auto r = bulk_load(vfs, { std::string(virt_dir(kind)) + "/*.txt" }, n_threads);
+
+  // the game loads files in case-insensitive path order, whereas r.files is ordered byte-wise (`B.txt` first)
+  std::vector<std::pair<std::string, std::unique_ptr<parser>*>> order;
+  order.reserve(r.files.size());
+
+  for (auto& [virt_path, p_prs] : r.files)
+    order.emplace_back(strutil::ascii_lower(virt_path), &p_prs);
+
+  std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  for (auto& [folded, pp_prs] : order)
+    _files.push_back(std::move(*pp_prs));
+
+  _errors = std::move(r.errors);
+  build_index(n_threads);
+}
+
+
+HistoryTimeline::HistoryTimeline(std::vector<std::shared_ptr<const parser>> files, history_kind kind,
+                                 uint n_threads)
+: _kind(kind), _files(std::move(files))
+{
+  build_index(n_threads);
+}
+
+
+namespace {
+  // the change points of one entity, as gathered from its history
+  class entity_builder {
+    std::unordered_map<std::string_view, std::vector<HistoryTimeline::change>> _attrs;
+
+  public:
+    void add(const block& b, uint file_idx)
+    {
+      for (const auto& s : b)
+      {
+        if (s.key().is_string())
+          _attrs[s.key().as_string_view()].push_back({ HistoryTimeline::BEGINNING, file_idx, &s.value() });
+        else if (s.key().is_date() && s.value().is_block())
+          for (const auto& t : *s.value().as_block())
+            if (t.key().is_string())
+              _attrs[t.key().as_string_view()].push_back({ s.key().as_date(), file_idx, &t.value() });
+      }
+    }
+
+    std::vector<HistoryTimeline::attribute> finish()
+    {
+      std::vector<HistoryTimeline::attribute> v;
+      v.reserve(_attrs.size());
+
+      for (auto& [name, changes] : _attrs)
+      {
+        // stable, so that of changes on the same date, the last one in the input remains the last
+        std::stable_sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) {
+          return a.d < b.d;
+        });
+        v.push_back({ name, std::move(changes) });
+      }
+
+      std::sort(v.begin(), v.end(), [](const auto& a, const auto& b) { return a.name < b.name; });
+      return v;
+    }
+  };
+
+  // the change in effect on the date, or nullptr
+  const HistoryTimeline::change* change_on(const std::vector<HistoryTimeline::change>& changes, date d) noexcept
+  {
+    auto it = std::upper_bound(changes.begin(), changes.end(), d, [](date x, const auto& c) {
+      return x < c.d;
+    });
+    return (it != changes.begin()) ? &*(it - 1) : nullptr;
+  }
+
+  // a history file's entity key, for the kinds w/ a file per entity
+  std::string file_entity_key(const parser& prs, history_kind kind)
+  {
+    auto stem = prs.path().stem().string();
+
+    if (kind == history_kind::PROVINCES) // "<id> - <name>"
+    {
+      const auto n = std::find_if(stem.begin(), stem.end(), [](char c) { return !isdigit(c); }) - stem.begin();
+      if (n > 0) stem.resize(n);
+    }
+
+    return stem;
+  }
+}
+
+
+void HistoryTimeline::build_index(uint n_threads)
+{
+  struct file_entity {
+    std::string key;
+    std::vector<std::pair<const block*, uint>> blocks; // (history, file index), in load order
+  };
+
+  /* find each file's entities. with a file per entity, that's trivial, but character files hold many. */
+
+  std::vector<file_entity> ents;
+  {
+    std::unordered_map<std::string, size_t> idx;
+
+    auto add = [&](std::string key, const block* p_blk, uint file_idx) {
+      auto [it, inserted] = idx.emplace(key, ents.size());
+      if (inserted) ents.push_back({ std::move(key), {} });
+      ents[it->second].blocks.emplace_back(p_blk, file_idx);
+    };
+
+    for (uint f = 0; f < _files.size(); ++f)
+    {
+      const auto& prs = *_files[f];
+
+      if (_kind != history_kind::CHARACTERS)
+        add(file_entity_key(prs, _kind), prs.root_block().get(), f);
+      else
+        for (const auto& s : *prs.root_block())
+          if (s.value().is_block() && (s.key().is_integer() || s.key().is_string()))
+            add((s.key().is_integer()) ? std::to_string(s.key().as_integer()) : s.key().as_string(),
+                s.value().as_block(), f);
+    }
+  }
+
+  /* gather & sort each entity's change points, concurrently */
+
+  _entities.resize(ents.size());
+
+  parallel_for(ents.size(), [&](size_t i)
+  {
+    entity_builder eb;
+
+    for (const auto& [p_blk, file_idx] : ents[i].blocks)
+      eb.add(*p_blk, file_idx);
+
+    _entities[i] = entity{ std::move(ents[i].key), eb.finish() };
+  }, n_threads);
+
+  _by_key.reserve(_entities.size());
+
+  for (size_t i = 0; i < _entities.size(); ++i)
+    _by_key.emplace(_entities[i].key, i);
+}
+
+
+const std::vector<HistoryTimeline::change>*
+HistoryTimeline::changes(const entity& e, std::string_view attr) const noexcept
+{
+  auto it = std::lower_bound(e.attrs.begin(), e.attrs.end(), attr,
+                             [](const attribute& a, std::string_view n) { return a.name < n; });
+
+  return (it != e.attrs.end() && it->name == attr) ? &it->changes : nullptr;
+}
+
+
+const HistoryTimeline::change*
+HistoryTimeline::change_at(const entity& e, std::string_view attr, date d) const noexcept
+{
+  const auto p_changes = changes(e, attr);
+  return (p_changes) ? change_on(*p_changes, d) : nullptr;
+}
+
+
+HistoryTimeline::entity_state HistoryTimeline::state_at(const entity& e, date d) const
+{
+  entity_state st{ &e, {} };
+  st.attrs.reserve(e.attrs.size());
+
+  for (const auto& a : e.attrs)
+    if (auto p_chg = change_on(a.changes, d))
+      st.attrs.emplace_back(a.name, p_chg->p_value);
+
+  return st;
+}
+
+
+std::vector<HistoryTimeline::entity_state> HistoryTimeline::snapshot(date d, uint n_threads) const
+{
+  std::vector<entity_state> v(_entities.size());
+  parallel_for(_entities.size(), [&](size_t i) { v[i] = state_at(_entities[i], d); }, n_threads);
+  return v;
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,126 @@
+#ifndef LIBCK2_HISTORY_TIMELINE_H
+#define LIBCK2_HISTORY_TIMELINE_H
+
+#include "common.h"
+#include "bulk_load.h"
+#include "date.h"
+#include "parser.h"
+#include "VFS.h"
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+enum class history_kind {
+  PROVINCES,  // history/provinces: a file per province, named "<id> - <name>.txt"
+  TITLES,     // history/titles: a file per title, named "<title>.txt"
+  CHARACTERS, // history/characters: files of "<id> = { ... }" blocks, a character each
+};
+
+
+/* HISTORY_TIMELINE -- point-in-time state of history entities (provinces, titles, or characters)
+ *
+ * an entity's history is a sequence of statements: undated ones set its initial attributes, and each
+ * "<date> = { ... }" block changes attributes as of that date. answering "who held c_paris on 1066.9.15" by
+ * replaying the blocks in order is a scan per query, so the timeline instead stores each attribute of each
+ * entity as an array of change points sorted by date, making a point-in-time lookup a binary search. initial
+ * attributes are change points at BEGINNING.
+ *
+ * entities are extracted from their files in parallel, and snapshot(...) evaluates every entity at a date in
+ * parallel. values are the objects in the parse trees, which the timeline keeps alive.
+ */
+
+class HistoryTimeline {
+public:
+  struct change {
+    date          d;
+    uint          file_idx; // into files()
+    const object* p_value;
+  };
+
+  struct attribute {
+    std::string_view    name;
+    std::vector<change> changes; // sorted by date; of changes on the same date, the last one in the input wins
+  };
+
+  struct entity {
+    std::string            key;   // province ID, title, or character ID
+    std::vector<attribute> attrs; // sorted by name
+  };
+
+  // an entity's attribute values in effect on a date (omitting attributes which have yet to be set)
+  struct entity_state {
+    const entity* p_entity;
+    std::vector<std::pair<std::string_view, const object*>> attrs;
+  };
+
+  static const date BEGINNING;
+
+  static const char* virt_dir(history_kind) noexcept;
+
+  // load & index the kind's history folder (w/ mod overrides applied). files which fail to parse are reported
+  // in errors() and otherwise skipped. n_threads = 0 means one per hardware thread.
+  HistoryTimeline(const VFS&, history_kind, uint n_threads = 0);
+
+  // index already-parsed history files, given in load order, which is by case-insensitive virtual path (so not
+  // the byte-wise order of a Workspace's trees, e.g.)
+  HistoryTimeline(std::vector<std::shared_ptr<const parser>> files, history_kind, uint n_threads = 0);
+
+  // (move-only, as _by_key's keys view the entities' own keys)
+  HistoryTimeline(const HistoryTimeline&) = delete;
+  HistoryTimeline& operator=(const HistoryTimeline&) = delete;
+  HistoryTimeline(HistoryTimeline&&) = default;
+  HistoryTimeline& operator=(HistoryTimeline&&) = default;
+
+  auto        kind()     const noexcept { return _kind; }
+  const auto& files()    const noexcept { return _files; }
+  const auto& errors()   const noexcept { return _errors; }
+  const auto& entities() const noexcept { return _entities; }
+
+  const entity* find(std::string_view key) const noexcept
+  {
+    auto i = _by_key.find(key);
+    return (i != _by_key.end()) ? &_entities[i->second] : nullptr;
+  }
+
+  // the entity's changes to the attribute, or nullptr if it never sets it
+  const std::vector<change>* changes(const entity&, std::string_view attr) const noexcept;
+
+  // the change in effect on the date (i.e., the final one on or before it), or nullptr
+  const change* change_at(const entity&, std::string_view attr, date) const noexcept;
+
+  // the attribute's value in effect on the date, or nullptr (e.g., at("c_paris", "holder", date(1066, 9, 15)))
+  const object* at(std::string_view key, std::string_view attr, date d) const noexcept
+  {
+    const auto p_ent = find(key);
+    const auto p_chg = (p_ent) ? change_at(*p_ent, attr, d) : nullptr;
+    return (p_chg) ? p_chg->p_value : nullptr;
+  }
+
+  entity_state state_at(const entity&, date) const;
+
+  // the state of every entity on the date, in entities() order
+  std::vector<entity_state> snapshot(date, uint n_threads = 0) const;
+
+  FLoc floc(const change& c) const { return _files[c.file_idx]->floc(*c.p_value); }
+
+private:
+  void build_index(uint n_threads);
+
+  history_kind _kind;
+  std::vector<std::shared_ptr<const parser>> _files;
+  std::vector<load_error> _errors;
+  std::vector<entity> _entities;
+  std::unordered_map<std::string_view, size_t> _by_key; // keys point into _entities, which is fixed after ctor
+};
+
+
+NAMESPACE_CK2_END;
+#endif
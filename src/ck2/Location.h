@@ -58,5 +58,22 @@ private:
 using Loc = Location;
 
 
+// a half-open range [begin, end) of byte offsets into the source text from which a token or syntax tree node was
+// read. a default-constructed src_span is null, which means that the node it describes was not parsed at all
+// (e.g., it was composed programmatically).
+struct src_span {
+  static constexpr uint NONE = std::numeric_limits<uint>::max();
+
+  uint begin;
+  uint end;
+
+  constexpr src_span() : begin(NONE), end(NONE) {}
+  constexpr src_span(uint begin_, uint end_) : begin(begin_), end(end_) {}
+
+  constexpr bool null()  const noexcept { return begin == NONE; }
+  constexpr uint size()  const noexcept { return (null()) ? 0 : end - begin; }
+};
+
+
 NAMESPACE_CK2_END;
 #endif
@@ -16,8 +16,7 @@ NAMESPACE_CK2;
 
 
 ProvEdgeSet::ProvEdgeSet(const ProvMap& pm)
-  : _M_grid(pm.data())
-  , _M_width(pm.width())
+  : _M_width(pm.width())
   , _M_height(pm.height())
 #ifdef DEBUG
   , _M_paraxial_seg_count(0)
@@ -38,44 +37,38 @@ ProvEdgeSet::ProvEdgeSet(const ProvMap& pm)
   std::vector<Segment> vertical_seg(_M_width); // vertical segments (fixed x-coord)
   Segment horizontal_seg; // horizontal segment (fixed y-coord) -- in scan order, so only 1 is required
 
-  auto p_pix = _M_grid;
+  // Each row is scanned along w/ the row below it. A row-major map's rows are used in place, whereas a tiled
+  // map's are copied out (alternating between two buffers, so that the row below stays put as the next row).
 
-  /* handle top row */
+  std::vector<prov_id_t> buf(_M_width), next_buf(_M_width);
+  const prov_id_t* p_row = pm.row(0, buf.data());
 
-  for (uint x = 0; x < max_x; ++x, ++p_pix) {
-    // handle top-left corner + top-center row
-    try_vertical_edge(x, 0, p_pix, vertical_seg[x], endpoint_map);
-    try_horizontal_edge(x, 0, p_pix, horizontal_seg, endpoint_map);
-  }
-
-  // handle top-right corner
-  if (try_horizontal_edge(max_x, 0, p_pix++, horizontal_seg, endpoint_map))
-    finish_segment(Direction::Horizontal, 0, horizontal_seg, endpoint_map);
-
-  horizontal_seg.reset();
-
-  /* handle middle rows */
+  /* handle top & middle rows */
 
-  for (uint y = 1; y < max_y; ++y)
+  for (uint y = 0; y < max_y; ++y)
   {
-    for (uint x = 0; x < max_x; ++x, ++p_pix)
+    const prov_id_t* p_below = pm.row(y + 1, next_buf.data());
+
+    for (uint x = 0; x < max_x; ++x)
     {
-      // handle middle-left pixel + middle-center row
-      try_vertical_edge(x, y, p_pix, vertical_seg[x], endpoint_map);
-      try_horizontal_edge(x, y, p_pix, horizontal_seg, endpoint_map);
+      // handle left pixel + center of row
+      try_vertical_edge(x, y, &p_row[x], vertical_seg[x], endpoint_map);
+      try_horizontal_edge(x, y, p_row[x], p_below[x], horizontal_seg, endpoint_map);
     }
 
-    // handle middle-right pixel
-    if (try_horizontal_edge(max_x, y, p_pix++, horizontal_seg, endpoint_map))
+    // handle right pixel
+    if (try_horizontal_edge(max_x, y, p_row[max_x], p_below[max_x], horizontal_seg, endpoint_map))
       finish_segment(Direction::Horizontal, y, horizontal_seg, endpoint_map);
 
     horizontal_seg.reset();
+    p_row = p_below;
+    std::swap(buf, next_buf);
   }
 
   /* handle bottom row */
 
-  for (uint x = 0; x < max_x; ++x, ++p_pix)
-    if (try_vertical_edge(x, max_y, p_pix, vertical_seg[x], endpoint_map))
+  for (uint x = 0; x < max_x; ++x)
+    if (try_vertical_edge(x, max_y, &p_row[x], vertical_seg[x], endpoint_map))
       finish_segment(Direction::Vertical, x, vertical_seg[x], endpoint_map);
 
   // ... and the bottom-right pixel actually cannot produce any new paraxial edges, so we're done with paraxial
@@ -127,11 +127,14 @@ private:
                     map);
   }
 
-  auto try_horizontal_edge(coord_t x, coord_t y, const prov_id_t* p, Segment& seg, EndpointMap& map) {
+  // Between a pixel & the one below it (as they're in different rows, they're passed by value)
+  auto try_horizontal_edge(coord_t x, coord_t y, prov_id_t id, prov_id_t id_below, Segment& seg,
+                           EndpointMap& map)
+  {
     return try_edge(Direction::Horizontal,
                     y,
                     x,
-                    std::make_pair(*p, *(p + _M_width)),
+                    std::make_pair(id, id_below),
                     seg,
                     map);
   }
@@ -153,7 +156,6 @@ private:
   void trace_edge_end(const EdgeEnd, uint edge_idx, EndpointMap&);
 
   std::vector< std::unique_ptr< ProvEdge > > _M_edges;
-  const prov_id_t* _M_grid; // row-major order
   coord_t          _M_width;
   coord_t          _M_height;
 
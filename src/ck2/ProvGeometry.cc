@@ -0,0 +1,161 @@
+#include "ProvGeometry.h"
+
+#include <algorithm>
+
+#include "Error.h"
+#include "ProvMap.h"
+#include "parallel.h"
+
+
+NAMESPACE_CK2;
+
+
+namespace {
+
+// One band's partial results, indexed by province ID
+struct band_partial {
+  std::vector<uint32_t>             counts; // after the merge, the band's write cursor into each ID's pixels
+  std::vector<uint64_t>             sum_x;
+  std::vector<uint64_t>             sum_y;
+  std::vector<ProvGeometry::bounds> bounds;
+};
+
+
+// Call fn(y, x, n, id) for each run of n pixels w/ the same ID starting at (x, y) in rows [y0, y1), in order
+template<typename F>
+void for_each_run(const ProvMap& pm, uint y0, uint y1, std::vector<prov_id_t>& row_buf, F&& fn)
+{
+  const uint cols = pm.width();
+
+  for (uint y = y0; y < y1; ++y)
+  {
+    const prov_id_t* p_row = pm.row(y, row_buf.data());
+
+    for (uint x = 0; x < cols; )
+    {
+      const prov_id_t id = p_row[x];
+      uint end = x + 1;
+      while (end < cols && p_row[end] == id) ++end;
+
+      fn(y, x, end - x, id);
+      x = end;
+    }
+  }
+}
+
+}
+
+
+ProvGeometry::ProvGeometry(const ProvMap& pm, uint n_threads)
+: _cols(pm.width()),
+  _rows(pm.height())
+{
+  constexpr uint COORD_MAX = std::numeric_limits<pixel::value_type>::max();
+
+  if (_cols > COORD_MAX || _rows > COORD_MAX)
+    throw Error("ProvGeometry requires a province map of at most {0}x{0} pixels, found {1}x{2}",
+                COORD_MAX, _cols, _rows);
+
+  if (n_threads == 0)
+    n_threads = default_thread_count();
+
+  /* the rows are split into one contiguous band per thread, so that each band's pixels of a given province
+   * follow those of the band before it, and the merged pixel lists come out in row-major order. */
+
+  const uint n_bands = std::max(1u, std::min(n_threads, _rows));
+  auto band_begin = [&](size_t b) { return static_cast<uint>(size_t(_rows) * b / n_bands); };
+
+  std::vector<band_partial> parts(n_bands);
+
+  /* pass 1: each band's areas, coordinate sums, & bounding boxes, a run of same-ID pixels at a time */
+
+  parallel_for(n_bands, [&](size_t b)
+  {
+    auto& part = parts[b];
+    part.counts.assign(ID_RANGE, 0);
+    part.sum_x.assign(ID_RANGE, 0);
+    part.sum_y.assign(ID_RANGE, 0);
+    part.bounds.assign(ID_RANGE, bounds());
+
+    std::vector<prov_id_t> row_buf(_cols);
+
+    for_each_run(pm, band_begin(b), band_begin(b + 1), row_buf, [&](uint y, uint x, uint n, prov_id_t id)
+    {
+      part.counts[id] += n;
+      part.sum_x[id] += uint64_t(n) * x + uint64_t(n) * (n - 1) / 2; // x + (x + 1) + ... + (x + n - 1)
+      part.sum_y[id] += uint64_t(n) * y;
+
+      auto& bb = part.bounds[id];
+      bb.x0 = std::min(bb.x0, x);
+      bb.x1 = std::max(bb.x1, x + n);
+      bb.y0 = std::min(bb.y0, y);
+      bb.y1 = y + 1;
+    });
+  }, n_threads);
+
+  /* merge the partials, turning each band's counts into its write cursors into the pixel array */
+
+  _offsets.resize(ID_RANGE + 1);
+  _bounds.resize(ID_RANGE);
+  _centroids.resize(ID_RANGE);
+
+  uint32_t offset = 0;
+
+  for (size_t id = 0; id < ID_RANGE; ++id)
+  {
+    _offsets[id] = offset;
+    uint64_t sum_x = 0;
+    uint64_t sum_y = 0;
+    auto& bb = _bounds[id];
+
+    for (auto& part : parts)
+    {
+      const uint32_t n = part.counts[id];
+      part.counts[id] = offset;
+      offset += n;
+
+      sum_x += part.sum_x[id];
+      sum_y += part.sum_y[id];
+
+      const auto& pb = part.bounds[id];
+      bb.x0 = std::min(bb.x0, pb.x0);
+      bb.x1 = std::max(bb.x1, pb.x1);
+      bb.y0 = std::min(bb.y0, pb.y0);
+      bb.y1 = std::max(bb.y1, pb.y1);
+    }
+
+    if (const uint32_t area = offset - _offsets[id]; area > 0)
+      _centroids[id] = Point<double>(double(sum_x) / area + 0.5, double(sum_y) / area + 0.5);
+  }
+
+  _offsets[ID_RANGE] = offset;
+
+  for (auto& part : parts)
+  {
+    std::vector<uint64_t>().swap(part.sum_x);
+    std::vector<uint64_t>().swap(part.sum_y);
+    std::vector<bounds>().swap(part.bounds);
+  }
+
+  /* pass 2: scatter each band's pixels into its ranges of the pixel array */
+
+  _pixels.resize(offset);
+
+  parallel_for(n_bands, [&](size_t b)
+  {
+    auto& cursors = parts[b].counts;
+    std::vector<prov_id_t> row_buf(_cols);
+
+    for_each_run(pm, band_begin(b), band_begin(b + 1), row_buf, [&](uint y, uint x, uint n, prov_id_t id)
+    {
+      pixel* p = &_pixels[cursors[id]];
+      cursors[id] += n;
+
+      for (uint i = 0; i < n; ++i)
+        p[i] = pixel(static_cast<uint16_t>(x + i), static_cast<uint16_t>(y));
+    });
+  }, n_threads);
+}
+
+
+NAMESPACE_CK2_END;
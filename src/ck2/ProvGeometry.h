@@ -0,0 +1,88 @@
+#ifndef LIBCK2_PROV_GEOMETRY_H
+#define LIBCK2_PROV_GEOMETRY_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Point.h"
+#include "ProvMapRLE.h"
+#include "common.h"
+
+
+NAMESPACE_CK2;
+
+
+struct ProvMap;
+
+
+// A ProvGeometry holds per-province geometry derived from a ProvMap: the area (pixel count), bounding box, and
+// centroid of each province ID, plus every province's pixels. These are all computed together in one pass over
+// the map, divided among threads as contiguous bands of rows. Each thread accumulates partial results (counts,
+// bounds, coordinate sums) for its band, and these are merged at the end. A second pass over the bands then
+// scatters the pixels into place.
+//
+// Pixels are stored in compressed-sparse-row form: one array holds the pixels of province 0, then those of
+// province 1, and so on, and an offset array locates each province's range. So, pixels(id) is a contiguous
+// span, and area(id) is simply its length. Within a province, pixels are in row-major order.
+//
+// Everything is indexed by ID over the entire ID range, including the reserved IDs (PM_OCEAN, PM_IMPASSABLE).
+// Maps may be at most 65535 pixels wide & high.
+
+struct ProvGeometry
+{
+  using pixel  = Point<uint16_t>;
+  using bounds = ProvMapRLE::bounds;
+
+  // A contiguous range of pixels
+  class pixel_span {
+    const pixel* _begin;
+    const pixel* _end;
+
+  public:
+    pixel_span(const pixel* begin, const pixel* end) noexcept : _begin(begin), _end(end) {}
+
+    auto begin() const noexcept { return _begin; }
+    auto end()   const noexcept { return _end; }
+    auto size()  const noexcept { return size_t(_end - _begin); }
+    auto empty() const noexcept { return _begin == _end; }
+
+    const pixel& operator[](size_t i) const noexcept { return _begin[i]; }
+  };
+
+  // n_threads = 0 means one per hardware thread
+  explicit ProvGeometry(const ProvMap&, uint n_threads = 0);
+
+  auto width()  const noexcept { return _cols; }
+  auto height() const noexcept { return _rows; }
+
+  uint32_t area(prov_id_t id) const noexcept { return _offsets[size_t(id) + 1] - _offsets[id]; }
+  bool     present(prov_id_t id) const noexcept { return area(id) > 0; }
+
+  // Empty for IDs absent from the map
+  const bounds& bounding_box(prov_id_t id) const noexcept { return _bounds[id]; }
+
+  // The mean of the centers of the province's pixels (so the centroid of the single pixel (x, y) is
+  // (x + 0.5, y + 0.5)), or (0, 0) for IDs absent from the map
+  Point<double> centroid(prov_id_t id) const noexcept { return _centroids[id]; }
+
+  pixel_span pixels(prov_id_t id) const noexcept
+  {
+    return pixel_span(_pixels.data() + _offsets[id], _pixels.data() + _offsets[size_t(id) + 1]);
+  }
+
+  // The ID range over which everything is indexed
+  static constexpr size_t ID_RANGE = size_t(std::numeric_limits<prov_id_t>::max()) + 1;
+
+private:
+  std::vector<pixel>         _pixels;    // all pixels, grouped by province ID
+  std::vector<uint32_t>      _offsets;   // index of each ID's first pixel in _pixels, plus a final total
+  std::vector<bounds>        _bounds;
+  std::vector<Point<double>> _centroids;
+  uint _cols;
+  uint _rows;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,200 @@
+#include "ProvGraph.h"
+
+#include <string_view>
+
+#include "AdjacenciesFile.h"
+#include "DefaultMap.h"
+#include "ProvMap.h"
+#include "parallel.h"
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+
+NAMESPACE_CK2;
+
+
+namespace {
+
+// An undirected pair of differing IDs, the lesser in the upper half
+using pair_key = uint32_t;
+
+void add_pair(prov_id_t a, prov_id_t b, std::vector<pair_key>& keys)
+{
+  const pair_key k = (a < b) ? pair_key(a) << 16 | b : pair_key(b) << 16 | a;
+
+  if (keys.empty() || keys.back() != k) // (borders repeat the same pair many times in succession)
+    keys.push_back(k);
+}
+
+
+// Add the pairs (a[i], b[i]) for which a[i] != b[i], for i in [0, n)
+void add_differing(const prov_id_t* a, const prov_id_t* b, uint n, std::vector<pair_key>& keys)
+{
+  uint i = 0;
+
+#ifdef __SSE2__
+  /* compare 8 IDs at a time, & only look at the individual IDs of blocks which differ somewhere. most don't, as
+   * borders are a small fraction of the pixels. */
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+
+    if (_mm_movemask_epi8(eq) != 0xFFFF)
+      for (uint j = i; j < i + 8; ++j)
+        if (a[j] != b[j])
+          add_pair(a[j], b[j], keys);
+  }
+#endif
+
+  for (; i < n; ++i)
+    if (a[i] != b[i])
+      add_pair(a[i], b[i], keys);
+}
+
+
+// A directed edge before the merge, keyed by (from, to)
+struct edge_rec {
+  uint32_t  key;
+  prov_id_t through;
+  uint8_t   flags;
+};
+
+
+uint8_t adjacency_type_flag(std::string_view type)
+{
+  if (type == "sea")         return ProvGraph::STRAIT;
+  if (type == "portage")     return ProvGraph::PORTAGE;
+  if (type == "major_river") return ProvGraph::RIVER;
+  return 0;
+}
+
+}
+
+
+ProvGraph::ProvGraph(const ProvMap& pm, const DefaultMap& dm, const AdjacenciesFile& adj_file, uint n_threads)
+{
+  const uint cols = pm.width();
+  const uint rows = pm.height();
+
+  /* scan each band for pairs of horizontally or vertically neighboring pixels w/ differing IDs */
+
+  const uint n_bands = (rows + BAND_ROWS - 1) / BAND_ROWS;
+  std::vector<std::vector<pair_key>> band_keys(n_bands);
+
+  parallel_for(n_bands, [&](size_t band)
+  {
+    const uint y0 = band * BAND_ROWS;
+    const uint y1 = std::min(rows, y0 + BAND_ROWS);
+    auto& keys = band_keys[band];
+
+    std::vector<prov_id_t> buf(cols), next_buf(cols); // (for a tiled map's rows; see ProvMap::row)
+    const prov_id_t* p_row = pm.row(y0, buf.data());
+
+    for (uint y = y0; y < y1; ++y)
+    {
+      if (cols > 1)
+        add_differing(p_row, p_row + 1, cols - 1, keys);
+
+      if (y + 1 < rows) // (the last row of a band is compared to the first of the next)
+      {
+        const prov_id_t* p_next = pm.row(y + 1, next_buf.data());
+        add_differing(p_row, p_next, cols, keys);
+        p_row = p_next;
+        std::swap(buf, next_buf); // (so that p_row's buffer isn't overwritten by the next row)
+      }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }, n_threads);
+
+  /* merge the bands' pairs & the adjacencies.csv entries into directed edge records */
+
+  std::vector<edge_rec> recs;
+
+  {
+    std::vector<pair_key> keys;
+    size_t n_keys = 0;
+    for (const auto& bk : band_keys) n_keys += bk.size();
+    keys.reserve(n_keys);
+
+    for (auto& bk : band_keys)
+    {
+      keys.insert(keys.end(), bk.begin(), bk.end());
+      std::vector<pair_key>().swap(bk);
+    }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    recs.reserve(2 * keys.size() + 2 * adj_file.size());
+
+    for (const pair_key k : keys)
+    {
+      recs.push_back({ k, 0, BORDER });
+      recs.push_back({ k << 16 | k >> 16, 0, BORDER });
+    }
+  }
+
+  for (const auto& adj : adj_file)
+  {
+    if (adj.deleted || adj.from == 0 || adj.to == 0 || adj.from == adj.to)
+      continue;
+
+    const uint8_t flags = ADJACENCY | adjacency_type_flag(adj.type);
+    const auto through = static_cast<prov_id_t>(adj.through);
+    recs.push_back({ uint32_t(adj.from) << 16 | adj.to, through, flags });
+    recs.push_back({ uint32_t(adj.to) << 16 | adj.from, through, flags });
+  }
+
+  // stable, so that records of the same pair stay in file order & the first nonzero `through` listed wins
+  std::stable_sort(recs.begin(), recs.end(), [](const edge_rec& a, const edge_rec& b) { return a.key < b.key; });
+
+  /* which provinces are water, for the SEA flag */
+
+  std::vector<bool> water(ID_RANGE, false);
+  water[ProvMap::PM_OCEAN] = true;
+
+  for (const auto& sr : dm.seazone_ranges())
+    for (uint id = sr.start_id; id <= sr.end_id && id <= ProvMap::PM_REAL_ID_MAX; ++id)
+      water[id] = true;
+
+  /* combine records of the same (from, to) into a single edge & lay the edges out by source */
+
+  _offsets.assign(ID_RANGE + 1, 0);
+  _edges.reserve(recs.size());
+
+  for (size_t i = 0; i < recs.size(); )
+  {
+    const uint32_t key = recs[i].key;
+    const auto from = static_cast<prov_id_t>(key >> 16);
+    const auto to   = static_cast<prov_id_t>(key);
+    edge e = { to, 0, 0 };
+
+    for (; i < recs.size() && recs[i].key == key; ++i)
+    {
+      e.flags |= recs[i].flags;
+      if (e.through == 0) e.through = recs[i].through;
+    }
+
+    if (water[from] || water[to])
+      e.flags |= SEA;
+
+    if (from == ProvMap::PM_IMPASSABLE || to == ProvMap::PM_IMPASSABLE)
+      e.flags |= IMPASSABLE;
+
+    _edges.push_back(e);
+    ++_offsets[size_t(from) + 1];
+  }
+
+  for (size_t id = 0; id < ID_RANGE; ++id)
+    _offsets[id + 1] += _offsets[id];
+
+  _edges.shrink_to_fit();
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,107 @@
+#ifndef LIBCK2_PROV_GRAPH_H
+#define LIBCK2_PROV_GRAPH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "common.h"
+
+
+NAMESPACE_CK2;
+
+
+class AdjacenciesFile;
+class DefaultMap;
+struct ProvMap;
+
+
+// A ProvGraph is the province adjacency graph: which provinces border province N, whether by sharing pixel
+// borders in the ProvMap or by an entry in adjacencies.csv (straits, portages, major rivers). It's stored in
+// compressed-sparse-row form: one array holds the edges out of province 0, then those out of province 1, and
+// so on, each province's sorted by neighbor ID, and an offset array locates each province's range. So,
+// neighbors(id) is a contiguous span, and testing a particular pair is a binary search over one province's
+// neighbors.
+//
+// Every edge is stored in both directions. The nodes are the entire ID range, including the reserved IDs, so
+// provinces bordering the unassigned ocean or impassable terrain have edges to PM_OCEAN or PM_IMPASSABLE,
+// flagged accordingly.
+//
+// The map is scanned in parallel bands of rows, comparing each row to itself shifted by one pixel (horizontal
+// neighbors) and to the row below (vertical neighbors) eight IDs at a time. Each band collects its pairs of
+// differing IDs, and these are merged w/ the adjacencies.csv entries at the end.
+
+struct ProvGraph
+{
+  // Edge flags
+  enum : uint8_t {
+    BORDER     = 1 << 0, // the provinces share a pixel border
+    ADJACENCY  = 1 << 1, // listed in adjacencies.csv (any type)
+    STRAIT     = 1 << 2, // adjacencies.csv type "sea": a crossing through a sea zone
+    PORTAGE    = 1 << 3, // adjacencies.csv type "portage"
+    RIVER      = 1 << 4, // adjacencies.csv type "major_river"
+    SEA        = 1 << 5, // either province is water (a sea zone per default.map, or PM_OCEAN)
+    IMPASSABLE = 1 << 6, // either province is PM_IMPASSABLE
+  };
+
+  struct edge {
+    prov_id_t to;
+    prov_id_t through; // for adjacencies.csv entries, the province crossed (e.g., a strait's sea zone), else 0
+    uint8_t   flags;
+
+    bool has(uint8_t f) const noexcept { return (flags & f) != 0; }
+  };
+
+  // A contiguous range of edges
+  class edge_span {
+    const edge* _begin;
+    const edge* _end;
+
+  public:
+    edge_span(const edge* begin, const edge* end) noexcept : _begin(begin), _end(end) {}
+
+    auto begin() const noexcept { return _begin; }
+    auto end()   const noexcept { return _end; }
+    auto size()  const noexcept { return size_t(_end - _begin); }
+    auto empty() const noexcept { return _begin == _end; }
+
+    const edge& operator[](size_t i) const noexcept { return _begin[i]; }
+  };
+
+  // n_threads = 0 means one per hardware thread
+  ProvGraph(const ProvMap&, const DefaultMap&, const AdjacenciesFile&, uint n_threads = 0);
+
+  uint degree(prov_id_t id) const noexcept { return _offsets[size_t(id) + 1] - _offsets[id]; }
+
+  edge_span neighbors(prov_id_t id) const noexcept
+  {
+    return edge_span(_edges.data() + _offsets[id], _edges.data() + _offsets[size_t(id) + 1]);
+  }
+
+  // The edge from -> to, or nullptr if there's none
+  const edge* find(prov_id_t from, prov_id_t to) const noexcept
+  {
+    const auto nb = neighbors(from);
+    auto it = std::lower_bound(nb.begin(), nb.end(), to, [](const edge& e, prov_id_t id) { return e.to < id; });
+    return (it != nb.end() && it->to == to) ? it : nullptr;
+  }
+
+  bool adjacent(prov_id_t a, prov_id_t b) const noexcept { return find(a, b) != nullptr; }
+
+  auto edge_count() const noexcept { return _edges.size(); } // counting both directions
+
+  // The ID range over which the nodes are indexed
+  static constexpr size_t ID_RANGE = size_t(std::numeric_limits<prov_id_t>::max()) + 1;
+
+  // Rows per band of the map scan
+  static constexpr uint BAND_ROWS = 64;
+
+private:
+  std::vector<edge>     _edges;   // all edges, grouped by source province ID & sorted by target
+  std::vector<uint32_t> _offsets; // index of each ID's first edge in _edges, plus a final total
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -1,52 +1,160 @@
-#ifndef LIBCK2_PROVINCE_MAP_H
-#define LIBCK2_PROVINCE_MAP_H
-
-#include <limits>
-
-#include "common.h"
-#include "filesystem.h"
-
-
-NAMESPACE_CK2;
-
-
-class DefinitionsTable;
-class DefaultMap;
-class VFS;
-
-
-// A ProvMap class opens & processes the raw bitmap from 'provinces.bmp' & allocates it into a buffer(s) of
-// 16-bit province IDs. It then provides read-only access to that mapping of IDs to raster (x, y) grid coordinates.
-// Some province IDs at the very top of the ID range are reserved for useful classifications.
-
-struct ProvMap
-{
-  ProvMap(const VFS&, const DefaultMap&, const DefinitionsTable&);
-
-  // We always maintain 0 as the 'null province.' For ProvMap, this actually doesn't matter for now, so this is
-  // practically documentation.
-  static constexpr prov_id_t PM_NULL = 0;
-
-  // But these definitely matter right now for ProvMap:
-  static constexpr prov_id_t PM_IMPASSABLE  = std::numeric_limits<prov_id_t>::max();
-  static constexpr prov_id_t PM_OCEAN       = std::numeric_limits<prov_id_t>::max() - 1;
-  static constexpr prov_id_t PM_REAL_ID_MAX = std::numeric_limits<prov_id_t>::max() - 2;
-
-  auto width()  const noexcept { return _cols; }
-  auto height() const noexcept { return _rows; }
-
-  auto& operator()(uint x, uint y)       noexcept { return _map[ y * _cols + x ]; }
-  auto& operator()(uint x, uint y) const noexcept { return _map[ y * _cols + x ]; }
-
-  auto data()       noexcept { return _map.get(); }
-  auto data() const noexcept { return _map.get(); }
-
-private:
-  std::unique_ptr<prov_id_t[]> _map;
-  uint _cols;
-  uint _rows;
-};
-
-
-NAMESPACE_CK2_END;
-#endif
+#ifndef LIBCK2_PROVINCE_MAP_H
+#define LIBCK2_PROVINCE_MAP_H
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+#include "common.h"
+#include "filesystem.h"
+#include "parallel.h"
+
+
+NAMESPACE_CK2;
+
+
+class DefinitionsTable;
+class DefaultMap;
+class VFS;
+
+
+// A ProvMap class opens & processes the raw bitmap from 'provinces.bmp' & allocates it into a buffer(s) of
+// 16-bit province IDs. It then provides read-only access to that mapping of IDs to raster (x, y) grid coordinates.
+// Some province IDs at the very top of the ID range are reserved for useful classifications.
+//
+// The bitmap is converted by prov_bitmap, in parallel bands of rows & a run of same-colored pixels at a time.
+// For a representation which takes far less memory, see ProvMapRLE.
+//
+// The IDs are stored either row by row (Layout::RowMajor) or in square tiles of TILE_SZ pixels
+// (Layout::Tiled), each tile row-major within itself & the tiles row-major in turn. 2D neighborhood passes
+// (vertical neighbors, flood fills, distance transforms) touch a new cache line per row in the row-major layout
+// but stay within a tile in the tiled one. Either way, the accessors are the same, and for_each_tile(...)
+// visits the map a tile at a time w/ direct pointers into the tile's rows.
+
+struct ProvMap
+{
+  enum class Layout
+  {
+    RowMajor,
+    Tiled,
+  };
+
+  static constexpr uint TILE_SHIFT = 6;
+  static constexpr uint TILE_SZ    = 1 << TILE_SHIFT; // tile width & height (in both layouts, for tile views)
+
+  // n_threads = 0 means one per hardware thread
+  ProvMap(const VFS&, const DefaultMap&, const DefinitionsTable&, uint n_threads = 0,
+          Layout layout = Layout::RowMajor);
+
+  // We always maintain 0 as the 'null province.' For ProvMap, this actually doesn't matter for now, so this is
+  // practically documentation.
+  static constexpr prov_id_t PM_NULL = 0;
+
+  // But these definitely matter right now for ProvMap:
+  static constexpr prov_id_t PM_IMPASSABLE  = std::numeric_limits<prov_id_t>::max();
+  static constexpr prov_id_t PM_OCEAN       = std::numeric_limits<prov_id_t>::max() - 1;
+  static constexpr prov_id_t PM_REAL_ID_MAX = std::numeric_limits<prov_id_t>::max() - 2;
+
+  auto width()  const noexcept { return _cols; }
+  auto height() const noexcept { return _rows; }
+  auto layout() const noexcept { return _layout; }
+
+  // the offset of pixel (x, y) in data(), e.g. for side arrays which share the map's layout
+  size_t index(uint x, uint y) const noexcept
+  {
+    if (_layout == Layout::RowMajor)
+      return size_t(y) * _cols + x;
+
+    constexpr uint MASK = TILE_SZ - 1;
+    return ((size_t(y >> TILE_SHIFT) * _tiles_x + (x >> TILE_SHIFT)) << (2 * TILE_SHIFT)) +
+           ((y & MASK) << TILE_SHIFT) + (x & MASK);
+  }
+
+  auto& operator()(uint x, uint y)       noexcept { return _map[ index(x, y) ]; }
+  auto& operator()(uint x, uint y) const noexcept { return _map[ index(x, y) ]; }
+
+  // the IDs in the map's layout. tiled maps are padded w/ PM_NULL to a whole number of tiles, so size() may
+  // exceed width() * height().
+  auto data()       noexcept { return _map.get(); }
+  auto data() const noexcept { return _map.get(); }
+  auto size() const noexcept { return _size; }
+
+  // copy row y's IDs into out (which has room for width() IDs)
+  void copy_row(uint y, prov_id_t* out) const noexcept;
+
+  // row y's IDs: in place in a row-major map, else copied into scratch (which has room for width() IDs). callers
+  // which keep a row while fetching the next should alternate between two scratch buffers.
+  const prov_id_t* row(uint y, prov_id_t* scratch) const noexcept
+  {
+    if (_layout == Layout::RowMajor)
+      return _map.get() + size_t(y) * _cols;
+
+    copy_row(y, scratch);
+    return scratch;
+  }
+
+  // a view of the pixels [x0, x1) by [y0, y1), whose rows are contiguous at stride apart
+  template<typename T>
+  struct basic_tile {
+    uint   x0, y0, x1, y1;
+    size_t stride;
+    T*     p; // pixel (x0, y0)
+
+    T* row(uint y) const noexcept { return p + size_t(y - y0) * stride; }
+    T& operator()(uint x, uint y) const noexcept { return row(y)[x - x0]; }
+    bool contains(uint x, uint y) const noexcept { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+
+    // a tile converts to a const_tile, so fn(const const_tile&) may visit a mutable map's tiles
+    template<typename U, typename = std::enable_if_t<std::is_same_v<U, const T>>>
+    operator basic_tile<U>() const noexcept { return { x0, y0, x1, y1, stride, p }; }
+  };
+
+  using tile       = basic_tile<prov_id_t>;
+  using const_tile = basic_tile<const prov_id_t>;
+
+  // the map's TILE_SZ-square tiles (partial at the right & bottom edges) in row-major order, in either layout
+  uint tiles_x()    const noexcept { return _tiles_x; }
+  uint tiles_y()    const noexcept { return (_rows + TILE_SZ - 1) >> TILE_SHIFT; }
+  uint tile_count() const noexcept { return tiles_x() * tiles_y(); }
+
+  tile       get_tile(uint i)       noexcept { return make_tile<prov_id_t>(_map.get(), i); }
+  const_tile get_tile(uint i) const noexcept { return make_tile<const prov_id_t>(_map.get(), i); }
+
+  // call fn(tile) for every tile upon n_threads threads (0 means one per hardware thread), handing out tiles in
+  // row-major order. fn may read pixels outside its tile (e.g., neighbors across tile edges) via operator().
+  template<typename F>
+  void for_each_tile(F&& fn, uint n_threads = 0) const
+  {
+    parallel_for(tile_count(), [&](size_t i) { fn(get_tile(i)); }, n_threads);
+  }
+
+  template<typename F>
+  void for_each_tile(F&& fn, uint n_threads = 0)
+  {
+    parallel_for(tile_count(), [&](size_t i) { fn(get_tile(i)); }, n_threads);
+  }
+
+private:
+  template<typename T, typename P>
+  basic_tile<T> make_tile(P* p_map, uint i) const noexcept
+  {
+    const uint x0 = (i % _tiles_x) << TILE_SHIFT;
+    const uint y0 = (i / _tiles_x) << TILE_SHIFT;
+    const uint x1 = std::min(x0 + TILE_SZ, _cols);
+    const uint y1 = std::min(y0 + TILE_SZ, _rows);
+    const size_t stride = (_layout == Layout::RowMajor) ? _cols : TILE_SZ;
+    return basic_tile<T>{ x0, y0, x1, y1, stride, p_map + index(x0, y0) };
+  }
+
+  std::unique_ptr<prov_id_t[]> _map;
+  uint   _cols;
+  uint   _rows;
+  Layout _layout;
+  uint   _tiles_x;
+  size_t _size;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
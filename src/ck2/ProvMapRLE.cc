@@ -0,0 +1,121 @@
+#include "ProvMapRLE.h"
+
+#include "FileLocation.h"
+#include "ProvMap.h"
+#include "prov_bitmap.h"
+
+
+NAMESPACE_CK2;
+
+
+ProvMapRLE::ProvMapRLE(const VFS& vfs, const DefaultMap& dm, const DefinitionsTable& def_tbl, uint n_threads)
+: _cols(0),
+  _rows(0)
+{
+  const prov_bitmap bmp(vfs, dm, def_tbl);
+
+  if (bmp.width() > std::numeric_limits<uint16_t>::max())
+    throw FLError(FLoc(bmp.path()), "Format unsupported: Run-length encoding requires a width of at most {}, "
+                  "found {}", std::numeric_limits<uint16_t>::max(), bmp.width());
+
+  _cols = bmp.width();
+  _rows = bmp.height();
+
+  // each row's runs are collected separately, since rows are scanned concurrently
+  std::vector<std::vector<run>> rows(_rows);
+
+  bmp.scan([&](uint y, uint x, uint, prov_id_t id)
+  {
+    auto& r = rows[y];
+
+    if (r.empty() || r.back().id != id) // (runs of different colors may still share an ID)
+      r.push_back({ static_cast<uint16_t>(x), id });
+  }, n_threads);
+
+  set_rows(rows);
+}
+
+
+ProvMapRLE::ProvMapRLE(const ProvMap& pm)
+: _cols(pm.width()),
+  _rows(pm.height())
+{
+  if (_cols > std::numeric_limits<uint16_t>::max())
+    throw Error("Run-length encoding requires a province map width of at most {}, found {}",
+                std::numeric_limits<uint16_t>::max(), _cols);
+
+  _row_offsets.reserve(size_t(_rows) + 1);
+  std::vector<prov_id_t> row_buf(_cols);
+
+  for (uint y = 0; y < _rows; ++y)
+  {
+    _row_offsets.push_back(static_cast<uint32_t>(_runs.size()));
+
+    const prov_id_t* const p_row = pm.row(y, row_buf.data());
+
+    for (uint x = 0; x < _cols; )
+    {
+      const prov_id_t id = p_row[x];
+      _runs.push_back({ static_cast<uint16_t>(x), id });
+      while (++x < _cols && p_row[x] == id) {}
+    }
+  }
+
+  _row_offsets.push_back(static_cast<uint32_t>(_runs.size()));
+  _runs.shrink_to_fit();
+}
+
+
+void ProvMapRLE::set_rows(std::vector<std::vector<run>>& rows)
+{
+  size_t n_runs = 0;
+  for (const auto& r : rows) n_runs += r.size();
+
+  if (n_runs > std::numeric_limits<uint32_t>::max())
+    throw Error("Province map has too many runs to index ({})", n_runs);
+
+  _runs.reserve(n_runs);
+  _row_offsets.reserve(rows.size() + 1);
+
+  for (auto& r : rows)
+  {
+    _row_offsets.push_back(static_cast<uint32_t>(_runs.size()));
+    _runs.insert(_runs.end(), r.begin(), r.end());
+    std::vector<run>().swap(r);
+  }
+
+  _row_offsets.push_back(static_cast<uint32_t>(_runs.size()));
+}
+
+
+std::vector<uint32_t> ProvMapRLE::areas() const
+{
+  std::vector<uint32_t> v(ID_RANGE, 0);
+
+  for (uint y = 0; y < _rows; ++y)
+    for (const auto& s : row(y))
+      v[s.id] += s.x1 - s.x0;
+
+  return v;
+}
+
+
+std::vector<ProvMapRLE::bounds> ProvMapRLE::bounding_boxes() const
+{
+  std::vector<bounds> v(ID_RANGE);
+
+  for (uint y = 0; y < _rows; ++y)
+    for (const auto& s : row(y))
+    {
+      auto& b = v[s.id];
+      b.x0 = std::min(b.x0, s.x0);
+      b.x1 = std::max(b.x1, s.x1);
+      b.y0 = std::min(b.y0, y);
+      b.y1 = y + 1;
+    }
+
+  return v;
+}
+
+
+NAMESPACE_CK2_END;
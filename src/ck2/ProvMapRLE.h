@@ -0,0 +1,169 @@
+#ifndef LIBCK2_PROVINCE_MAP_RLE_H
+#define LIBCK2_PROVINCE_MAP_RLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+#include "common.h"
+
+
+NAMESPACE_CK2;
+
+
+class DefinitionsTable;
+class DefaultMap;
+class VFS;
+struct ProvMap;
+
+
+// A ProvMapRLE holds the same mapping of raster (x, y) coordinates to province IDs as a ProvMap, but run-length
+// encoded: each row is an array of runs (a starting column & a province ID, extending to the next run), and a
+// row offset index locates each row's runs. As provinces form long horizontal runs, this takes a small fraction
+// of ProvMap's 2 bytes per pixel, random access is a binary search within a row, and algorithms over regions
+// (areas, bounding boxes, borders) can process a run at a time rather than a pixel at a time.
+//
+// Adjacent runs in a row always differ in province ID. Maps may be at most 65535 pixels wide.
+
+struct ProvMapRLE
+{
+  // a run begins at column x & extends until the next run in its row (or to the row's end)
+  struct run {
+    uint16_t  x;
+    prov_id_t id;
+  };
+
+  // a run w/ its extent resolved: the columns [x0, x1)
+  struct span {
+    uint      x0;
+    uint      x1;
+    prov_id_t id;
+  };
+
+  // a half-open rectangle, [x0, x1) by [y0, y1)
+  struct bounds {
+    uint x0 = std::numeric_limits<uint>::max();
+    uint y0 = std::numeric_limits<uint>::max();
+    uint x1 = 0;
+    uint y1 = 0;
+
+    bool empty() const noexcept { return x0 >= x1; }
+    uint width()  const noexcept { return (empty()) ? 0 : x1 - x0; }
+    uint height() const noexcept { return (empty()) ? 0 : y1 - y0; }
+  };
+
+  class span_iterator {
+    const run* _p;
+    const run* _end;
+    uint       _width;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = span;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = span;
+
+    span_iterator(const run* p, const run* end, uint width) noexcept : _p(p), _end(end), _width(width) {}
+
+    span operator*() const noexcept { return { _p->x, (_p + 1 != _end) ? (_p + 1)->x : _width, _p->id }; }
+
+    span_iterator& operator++()    noexcept { ++_p; return *this; }
+    span_iterator  operator++(int) noexcept { auto it = *this; ++_p; return it; }
+
+    bool operator==(const span_iterator& o) const noexcept { return _p == o._p; }
+    bool operator!=(const span_iterator& o) const noexcept { return _p != o._p; }
+  };
+
+  // a row's runs, which iterate as spans
+  class row_view {
+    const run* _begin;
+    const run* _end;
+    uint       _width;
+
+  public:
+    row_view(const run* begin, const run* end, uint width) noexcept : _begin(begin), _end(end), _width(width) {}
+
+    auto begin() const noexcept { return span_iterator(_begin, _end, _width); }
+    auto end()   const noexcept { return span_iterator(_end, _end, _width); }
+    auto size()  const noexcept { return size_t(_end - _begin); }
+
+    const run* runs_begin() const noexcept { return _begin; }
+    const run* runs_end()   const noexcept { return _end; }
+  };
+
+  // load provinces.bmp directly into runs (as ProvMap's ctor does into pixels). n_threads = 0 means one per
+  // hardware thread.
+  ProvMapRLE(const VFS&, const DefaultMap&, const DefinitionsTable&, uint n_threads = 0);
+
+  explicit ProvMapRLE(const ProvMap&);
+
+  auto width()     const noexcept { return _cols; }
+  auto height()    const noexcept { return _rows; }
+  auto run_count() const noexcept { return _runs.size(); }
+
+  // bytes taken by the runs & the row offset index
+  size_t memory_size() const noexcept
+  {
+    return _runs.size() * sizeof(run) + _row_offsets.size() * sizeof(_row_offsets[0]);
+  }
+
+  prov_id_t operator()(uint x, uint y) const noexcept
+  {
+    const auto r = row(y);
+    auto it = std::upper_bound(r.runs_begin(), r.runs_end(), x, [](uint x, const run& rn) { return x < rn.x; });
+    return (it - 1)->id;
+  }
+
+  row_view row(uint y) const noexcept
+  {
+    return row_view(_runs.data() + _row_offsets[y], _runs.data() + _row_offsets[y + 1], _cols);
+  }
+
+  // the pixel count of each province ID, indexed by ID over the entire ID range (including the reserved IDs)
+  std::vector<uint32_t> areas() const;
+
+  // the bounding box of each province ID, indexed as with areas() (empty for IDs absent from the map)
+  std::vector<bounds> bounding_boxes() const;
+
+  // call fn(x0, x1, upper_id, lower_id) for each maximal span of columns [x0, x1) over which rows y & y + 1
+  // each have a single province ID. spans w/ differing IDs lie along horizontal province borders (and the
+  // starts of runs mark the vertical ones).
+  template<typename F>
+  void for_each_row_pair(uint y, F&& fn) const
+  {
+    const auto upper = row(y);
+    const auto lower = row(y + 1);
+    auto u = upper.begin();
+    auto l = lower.begin();
+
+    for (uint x = 0; x < _cols; )
+    {
+      const span su = *u;
+      const span sl = *l;
+      const uint x1 = std::min(su.x1, sl.x1);
+
+      fn(x, x1, su.id, sl.id);
+
+      if (su.x1 == x1) ++u;
+      if (sl.x1 == x1) ++l;
+      x = x1;
+    }
+  }
+
+private:
+  static constexpr size_t ID_RANGE = size_t(std::numeric_limits<prov_id_t>::max()) + 1;
+
+  void set_rows(std::vector<std::vector<run>>& rows);
+
+  std::vector<run>      _runs;
+  std::vector<uint32_t> _row_offsets; // index of each row's first run in _runs, plus a final _runs.size()
+  uint _cols;
+  uint _rows;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,397 @@
+#include "ProvPathfinder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "ProvGeometry.h"
+#include "ProvMap.h"
+#include "parallel.h"
+
+
+NAMESPACE_CK2;
+
+
+ProvPathfinder::ProvPathfinder(const ProvGraph& graph, const ProvGeometry& geom, uint8_t avoid)
+: _node_of(ProvGraph::ID_RANGE, NONE)
+{
+  /* the nodes are the real provinces present in the map, in ID order */
+
+  for (uint id = 1; id <= ProvMap::PM_REAL_ID_MAX; ++id)
+    if (geom.present(id))
+    {
+      _node_of[id] = static_cast<uint32_t>(_ids.size());
+      _ids.push_back(id);
+      _pos.push_back(geom.centroid(id));
+    }
+
+  /* keep the edges between nodes which have none of the avoided flags */
+
+  _offsets.reserve(_ids.size() + 1);
+
+  for (const prov_id_t id : _ids)
+  {
+    _offsets.push_back(static_cast<uint32_t>(_edges.size()));
+    const uint32_t node = _node_of[id];
+
+    for (const auto& e : graph.neighbors(id))
+    {
+      const uint32_t to = _node_of[e.to];
+
+      if (to == NONE || e.has(avoid))
+        continue;
+
+      const double dx = _pos[to].x - _pos[node].x;
+      const double dy = _pos[to].y - _pos[node].y;
+      _edges.push_back({ to, static_cast<float>(std::sqrt(dx * dx + dy * dy)) });
+    }
+  }
+
+  _offsets.push_back(static_cast<uint32_t>(_edges.size()));
+}
+
+
+ProvPathfinder::~ProvPathfinder() = default;
+
+
+/* SEARCH_STATE */
+
+
+ProvPathfinder::search_state::search_state(const ProvPathfinder& pf)
+: _p_pf(&pf),
+  _dist(pf.node_count()),
+  _parent(pf.node_count()),
+  _stamp_of(pf.node_count(), 0),
+  _target_of(pf.node_count(), 0),
+  _stamp(0)
+{
+  // each settled node pushes at most its out-degree of entries, plus one for the source
+  _heap.reserve(pf.edge_count() + 1);
+}
+
+
+void ProvPathfinder::search_state::begin() noexcept
+{
+  _heap.clear();
+
+  if (++_stamp == 0) // wrapped around, so old stamps could collide w/ new ones
+  {
+    std::fill(_stamp_of.begin(), _stamp_of.end(), 0);
+    std::fill(_target_of.begin(), _target_of.end(), 0);
+    _stamp = 1;
+  }
+}
+
+
+float ProvPathfinder::search_state::distance(prov_id_t id) const noexcept
+{
+  const uint32_t node = _p_pf->_node_of[id];
+  return (node == NONE) ? UNREACHABLE : g(node);
+}
+
+
+void ProvPathfinder::search_state::path_to(prov_id_t id, std::vector<prov_id_t>& path) const
+{
+  path.clear();
+  uint32_t node = _p_pf->_node_of[id];
+
+  if (node == NONE || !reached(node))
+    return;
+
+  for (; node != NONE; node = _parent[node])
+    path.push_back(_p_pf->_ids[node]);
+
+  std::reverse(path.begin(), path.end());
+}
+
+
+/* SEARCHES */
+
+
+float ProvPathfinder::heuristic(uint32_t node, uint32_t goal) const noexcept
+{
+  const double dx = _pos[goal].x - _pos[node].x;
+  const double dy = _pos[goal].y - _pos[node].y;
+
+  // rounded down a hair, so that float rounding can't make it overestimate the (float) path lengths
+  return static_cast<float>(std::sqrt(dx * dx + dy * dy) * (1.0 - 1e-6));
+}
+
+
+float ProvPathfinder::astar(uint32_t src, uint32_t dst, search_state& st) const
+{
+  st.begin();
+  st._dist[src] = 0;
+  st._parent[src] = NONE;
+  st._stamp_of[src] = st._stamp;
+  st._heap.push_back({ heuristic(src, dst), 0, src });
+
+  auto& heap = st._heap;
+
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+    const auto top = heap.back();
+    heap.pop_back();
+
+    if (top.g > st._dist[top.node])
+      continue; // stale (the node was since reached by a shorter path)
+
+    if (top.node == dst)
+      return top.g;
+
+    for (uint32_t i = _offsets[top.node]; i < _offsets[top.node + 1]; ++i)
+    {
+      const auto& e = _edges[i];
+      const float g = top.g + e.w;
+
+      if (g < st.g(e.to))
+      {
+        st._dist[e.to] = g;
+        st._parent[e.to] = top.node;
+        st._stamp_of[e.to] = st._stamp;
+        heap.push_back({ g + heuristic(e.to, dst), g, e.to });
+        std::push_heap(heap.begin(), heap.end(), std::greater<>());
+      }
+    }
+  }
+
+  return UNREACHABLE;
+}
+
+
+template<typename F>
+void ProvPathfinder::dijkstra(uint32_t src, float radius, search_state& st, F&& on_settle) const
+{
+  st._dist[src] = 0;
+  st._parent[src] = NONE;
+  st._stamp_of[src] = st._stamp;
+  st._heap.push_back({ 0, 0, src });
+
+  auto& heap = st._heap;
+
+  while (!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+    const auto top = heap.back();
+    heap.pop_back();
+
+    if (top.g > st._dist[top.node])
+      continue;
+
+    if (top.g > radius)
+    {
+      // the nodes yet to be settled are all beyond the radius, so they don't count as reached
+      st._stamp_of[top.node] = 0;
+
+      for (const auto& h : heap)
+        if (st._dist[h.node] > radius)
+          st._stamp_of[h.node] = 0;
+
+      return;
+    }
+
+    if (on_settle(top.node, top.g))
+      return;
+
+    for (uint32_t i = _offsets[top.node]; i < _offsets[top.node + 1]; ++i)
+    {
+      const auto& e = _edges[i];
+      const float g = top.g + e.w;
+
+      if (g < st.g(e.to))
+      {
+        st._dist[e.to] = g;
+        st._parent[e.to] = top.node;
+        st._stamp_of[e.to] = st._stamp;
+        heap.push_back({ g, g, e.to });
+        std::push_heap(heap.begin(), heap.end(), std::greater<>());
+      }
+    }
+  }
+}
+
+
+float ProvPathfinder::distance(prov_id_t from, prov_id_t to, search_state& st) const
+{
+  const uint32_t src = _node_of[from];
+  const uint32_t dst = _node_of[to];
+
+  if (src == NONE || dst == NONE)
+    return UNREACHABLE;
+
+  return astar(src, dst, st);
+}
+
+
+float ProvPathfinder::path(prov_id_t from, prov_id_t to, search_state& st, std::vector<prov_id_t>& path) const
+{
+  const float d = distance(from, to, st);
+
+  if (d == UNREACHABLE)
+    path.clear();
+  else
+    st.path_to(to, path);
+
+  return d;
+}
+
+
+void ProvPathfinder::search(prov_id_t from, search_state& st, float radius) const
+{
+  const uint32_t src = _node_of[from];
+
+  st.begin();
+
+  if (src != NONE)
+    dijkstra(src, radius, st, [](uint32_t, float) { return false; });
+}
+
+
+/* BATCHED QUERIES */
+
+
+std::unique_ptr<ProvPathfinder::search_state> ProvPathfinder::acquire_state() const
+{
+  {
+    std::lock_guard<std::mutex> lock(_pool_mutex);
+
+    if (!_pool.empty())
+    {
+      auto p = std::move(_pool.back());
+      _pool.pop_back();
+      return p;
+    }
+  }
+
+  return std::make_unique<search_state>(*this);
+}
+
+
+void ProvPathfinder::release_state(std::unique_ptr<search_state> p) const
+{
+  std::lock_guard<std::mutex> lock(_pool_mutex);
+  _pool.push_back(std::move(p));
+}
+
+
+template<typename F>
+void ProvPathfinder::for_each_chunk(size_t n, uint n_threads, F&& fn) const
+{
+  if (n_threads == 0)
+    n_threads = default_thread_count();
+
+  // several chunks per thread, so that chunks of slower queries still balance out
+  const size_t chunk_sz = std::max<size_t>(1, n / (size_t(n_threads) * 8));
+  const size_t n_chunks = (n + chunk_sz - 1) / chunk_sz;
+
+  parallel_for(n_chunks, [&](size_t c)
+  {
+    auto p_st = acquire_state();
+    fn(c * chunk_sz, std::min(n, (c + 1) * chunk_sz), *p_st);
+    release_state(std::move(p_st));
+  }, n_threads);
+}
+
+
+void ProvPathfinder::distances(const std::vector<query>& queries, std::vector<float>& out, uint n_threads) const
+{
+  out.resize(queries.size());
+
+  for_each_chunk(queries.size(), n_threads, [&](size_t begin, size_t end, search_state& st)
+  {
+    for (size_t i = begin; i < end; ++i)
+      out[i] = distance(queries[i].from, queries[i].to, st);
+  });
+}
+
+
+void ProvPathfinder::one_to_many(const std::vector<prov_id_t>& sources, const std::vector<prov_id_t>& targets,
+                                 std::vector<float>& out, uint n_threads) const
+{
+  const size_t n_targets = targets.size();
+  out.assign(sources.size() * n_targets, UNREACHABLE);
+
+  for_each_chunk(sources.size(), n_threads, [&](size_t begin, size_t end, search_state& st)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const uint32_t src = _node_of[sources[i]];
+
+      if (src == NONE)
+        continue;
+
+      /* mark the targets, so that the search can stop once it has settled all of them */
+
+      st.begin();
+      size_t n_left = 0;
+
+      for (const prov_id_t id : targets)
+        if (const uint32_t node = _node_of[id]; node != NONE && st._target_of[node] != st._stamp)
+        {
+          st._target_of[node] = st._stamp;
+          ++n_left;
+        }
+
+      if (n_left > 0)
+        dijkstra(src, UNREACHABLE, st, [&](uint32_t node, float)
+        {
+          return st._target_of[node] == st._stamp && --n_left == 0;
+        });
+
+      float* const p_out = &out[i * n_targets];
+
+      for (size_t j = 0; j < n_targets; ++j)
+        p_out[j] = st.distance(targets[j]);
+    }
+  });
+}
+
+
+std::vector<ProvPathfinder::reach>
+ProvPathfinder::within_radius(const std::vector<prov_id_t>& sources, float radius, uint n_threads) const
+{
+  std::vector<std::vector<reach>> per_source(sources.size());
+
+  for_each_chunk(sources.size(), n_threads, [&](size_t begin, size_t end, search_state& st)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const prov_id_t from = sources[i];
+      const uint32_t src = _node_of[from];
+
+      if (src == NONE)
+        continue;
+
+      auto& v = per_source[i];
+      st.begin();
+
+      dijkstra(src, radius, st, [&](uint32_t node, float g)
+      {
+        if (node != src)
+          v.push_back({ from, _ids[node], g });
+
+        return false;
+      });
+    }
+  });
+
+  std::vector<reach> all;
+  size_t n = 0;
+  for (const auto& v : per_source) n += v.size();
+  all.reserve(n);
+
+  for (const auto& v : per_source)
+    all.insert(all.end(), v.begin(), v.end());
+
+  return all;
+}
+
+
+std::vector<ProvPathfinder::reach> ProvPathfinder::within_radius(float radius, uint n_threads) const
+{
+  return within_radius(_ids, radius, n_threads);
+}
+
+
+NAMESPACE_CK2_END;
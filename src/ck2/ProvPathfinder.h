@@ -0,0 +1,161 @@
+#ifndef LIBCK2_PROV_PATHFINDER_H
+#define LIBCK2_PROV_PATHFINDER_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Point.h"
+#include "ProvGraph.h"
+#include "common.h"
+
+
+NAMESPACE_CK2;
+
+
+struct ProvGeometry;
+
+
+// A ProvPathfinder finds shortest paths between provinces over a ProvGraph, weighting each edge by the
+// straight-line distance between the provinces' centroids (from a ProvGeometry), in pixels. Single queries use
+// A* (w/ the straight-line distance to the goal as its heuristic, which never overestimates under these
+// weights), and one-to-many & radius queries use Dijkstra's algorithm, stopping as soon as the answer is known.
+//
+// The graph is compacted at construction: its nodes are the provinces present in the map (no reserved IDs),
+// renumbered densely, and each edge is just a target node & a weight. Edges w/ any of the flags in avoid (by
+// default, those touching impassable terrain) are left out, e.g., pass ProvGraph::SEA | ProvGraph::IMPASSABLE
+// for land-only paths.
+//
+// A search_state holds the working arrays of a search (distances, parents, the heap), sized for the graph once,
+// so that searches don't allocate. Hold one per thread for single queries. The batched queries spread their
+// queries across threads in chunks, each chunk taking a search_state from a pool kept by the pathfinder, so
+// they don't allocate either past their first use (other than for their results).
+
+class ProvPathfinder
+{
+public:
+  static constexpr float UNREACHABLE = std::numeric_limits<float>::infinity();
+
+  class search_state;
+
+  ProvPathfinder(const ProvGraph&, const ProvGeometry&, uint8_t avoid = ProvGraph::IMPASSABLE);
+  ~ProvPathfinder();
+
+  auto node_count() const noexcept { return _ids.size(); }
+  auto edge_count() const noexcept { return _edges.size(); }
+  bool is_node(prov_id_t id) const noexcept { return _node_of[id] != NONE; }
+
+  /* Single queries, using the caller's search_state */
+
+  // The length of the shortest path (A*), or UNREACHABLE
+  float distance(prov_id_t from, prov_id_t to, search_state&) const;
+
+  // As distance(...), but also replace path's contents w/ the path's provinces, from first & to last (or leave
+  // it empty, if unreachable)
+  float path(prov_id_t from, prov_id_t to, search_state&, std::vector<prov_id_t>& path) const;
+
+  // Dijkstra's algorithm from a province until all provinces within radius are settled, after which the
+  // search_state answers distance(id) & path_to(id) for them
+  void search(prov_id_t from, search_state&, float radius = UNREACHABLE) const;
+
+  /* Batched queries, upon n_threads threads (0 means one per hardware thread) */
+
+  struct query {
+    prov_id_t from;
+    prov_id_t to;
+  };
+
+  // out[i] = distance(queries[i].from, queries[i].to)
+  void distances(const std::vector<query>& queries, std::vector<float>& out, uint n_threads = 0) const;
+
+  // out[i * targets.size() + j] = distance(sources[i], targets[j]), by a Dijkstra search per source
+  void one_to_many(const std::vector<prov_id_t>& sources, const std::vector<prov_id_t>& targets,
+                   std::vector<float>& out, uint n_threads = 0) const;
+
+  struct reach {
+    prov_id_t from;
+    prov_id_t to;
+    float     dist;
+  };
+
+  // Every (from, to) w/ from in sources, to != from, & distance(from, to) <= radius, grouped by source in order
+  // of sources & then by increasing distance
+  std::vector<reach> within_radius(const std::vector<prov_id_t>& sources, float radius,
+                                   uint n_threads = 0) const;
+
+  // As above, w/ every node as a source
+  std::vector<reach> within_radius(float radius, uint n_threads = 0) const;
+
+  class search_state {
+  public:
+    explicit search_state(const ProvPathfinder&);
+
+    // Results of the last search(...): the distance to a province (UNREACHABLE if it wasn't reached within the
+    // radius), & the path to it as by path(...)
+    float distance(prov_id_t id) const noexcept;
+    void  path_to(prov_id_t id, std::vector<prov_id_t>& path) const;
+
+  private:
+    friend class ProvPathfinder;
+
+    struct heap_entry {
+      float    key; // g + h (just g for Dijkstra)
+      float    g;
+      uint32_t node;
+
+      bool operator>(const heap_entry& o) const noexcept { return key > o.key; }
+    };
+
+    void begin() noexcept;
+
+    bool  reached(uint32_t node) const noexcept { return _stamp_of[node] == _stamp; }
+    float g(uint32_t node)       const noexcept { return (reached(node)) ? _dist[node] : UNREACHABLE; }
+
+    const ProvPathfinder*   _p_pf;
+    std::vector<float>      _dist;
+    std::vector<uint32_t>   _parent;
+    std::vector<uint32_t>   _stamp_of;  // the search in which a node's _dist & _parent were set
+    std::vector<uint32_t>   _target_of; // the search in which a node is a target
+    std::vector<heap_entry> _heap;      // reserved for the most entries a search can push
+    uint32_t                _stamp;
+  };
+
+private:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  struct edge {
+    uint32_t to; // node
+    float    w;
+  };
+
+  float heuristic(uint32_t node, uint32_t goal) const noexcept;
+
+  float astar(uint32_t src, uint32_t dst, search_state&) const;
+
+  // Dijkstra's algorithm from src (in a search_state which has begun), calling on_settle(node, g) as each node
+  // is settled until it returns true or the next node is beyond radius
+  template<typename F>
+  void dijkstra(uint32_t src, float radius, search_state&, F&& on_settle) const;
+
+  // Call fn(begin, end, state) for chunks of [0, n) upon n_threads threads, each w/ a pooled search_state
+  template<typename F>
+  void for_each_chunk(size_t n, uint n_threads, F&& fn) const;
+
+  std::unique_ptr<search_state> acquire_state() const;
+  void release_state(std::unique_ptr<search_state>) const;
+
+  std::vector<edge>          _edges;   // grouped by source node
+  std::vector<uint32_t>      _offsets; // index of each node's first edge in _edges, plus a final total
+  std::vector<prov_id_t>     _ids;     // node -> province ID
+  std::vector<uint32_t>      _node_of; // province ID -> node (or NONE)
+  std::vector<Point<double>> _pos;     // node -> centroid
+
+  mutable std::mutex                                 _pool_mutex;
+  mutable std::vector<std::unique_ptr<search_state>> _pool;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
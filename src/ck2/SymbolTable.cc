@@ -0,0 +1,457 @@
+
+#include "SymbolTable.h"
+#include "parallel.h"
+#include "strutil.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+
+NAMESPACE_CK2;
+
+
+const char* to_string(symbol_kind k) noexcept
+{
+  switch (k)
+  {
+    case symbol_kind::TITLE:            return "title";
+    case symbol_kind::EVENT:            return "event";
+    case symbol_kind::CHARACTER:        return "character";
+    case symbol_kind::DYNASTY:          return "dynasty";
+    case symbol_kind::CULTURE:          return "culture";
+    case symbol_kind::RELIGION:         return "religion";
+    case symbol_kind::TRAIT:            return "trait";
+    case symbol_kind::SCRIPTED_TRIGGER: return "scripted_trigger";
+  }
+
+  return "invalid";
+}
+
+
+const SymbolTable::symbol SymbolTable::s_none;
+
+
+/* EXTRACTION */
+
+namespace {
+
+enum class folder
+{
+  OTHER,
+  LANDED_TITLES,
+  EVENTS,
+  CHARACTERS,
+  DYNASTIES,
+  CULTURES,
+  RELIGIONS,
+  TRAITS,
+  SCRIPTED_TRIGGERS,
+};
+
+
+folder folder_of(const std::string& virt_path)
+{
+  static const std::pair<const char*, folder> s_prefixes[] = {
+    { "common/landed_titles/",     folder::LANDED_TITLES },
+    { "events/",                   folder::EVENTS },
+    { "history/characters/",       folder::CHARACTERS },
+    { "common/dynasties/",         folder::DYNASTIES },
+    { "common/cultures/",          folder::CULTURES },
+    { "common/religions/",         folder::RELIGIONS },
+    { "common/traits/",            folder::TRAITS },
+    { "common/scripted_triggers/", folder::SCRIPTED_TRIGGERS },
+  };
+
+  const auto folded = strutil::ascii_lower(virt_path);
+
+  for (const auto& [prefix, f] : s_prefixes)
+    if (folded.compare(0, strlen(prefix), prefix) == 0)
+      return f;
+
+  return folder::OTHER;
+}
+
+
+bool is_one_of(const char* s, std::initializer_list<const char*> names) noexcept
+{
+  for (auto n : names)
+    if (strcmp(s, n) == 0)
+      return true;
+
+  return false;
+}
+
+
+bool ends_with(std::string_view s, std::string_view suffix) noexcept
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+// the name of a symbol given as a string or an integer (e.g., event IDs may be either), or "" if it's neither
+std::string scalar_name(const object& o)
+{
+  if (o.is_string())  return o.as_string();
+  if (o.is_integer()) return std::to_string(o.as_integer());
+  return std::string();
+}
+
+
+}
+
+
+class symbol_extractor {
+  using contribution = SymbolTable::contribution;
+
+  folder _folder;
+  std::vector<contribution>& _out;
+
+  void emit(symbol_kind k, bool is_def, std::string name, const Location& loc)
+  {
+    if (!name.empty())
+      _out.push_back(contribution{ k, is_def, 0, std::move(name), loc });
+  }
+
+  void def(symbol_kind k, std::string name, const Location& loc) { emit(k, true, std::move(name), loc); }
+  void ref(symbol_kind k, std::string name, const Location& loc) { emit(k, false, std::move(name), loc); }
+
+  void scan_value(const object& v)
+  {
+    if (v.is_string())
+    {
+      if (looks_like_title(v.as_string()))
+        ref(symbol_kind::TITLE, v.as_string(), v.loc());
+    }
+    else if (v.is_block())
+      scan_block(*v.as_block());
+    else if (v.is_list())
+      for (const auto& e : *v.as_list())
+        scan_value(e);
+  }
+
+  void scan_block(const block& b)
+  {
+    for (const auto& s : b)
+      scan_stmt(s);
+  }
+
+  void scan_stmt(const statement& s)
+  {
+    const auto& k = s.key();
+    const auto& v = s.value();
+
+    if (!k.is_string())
+    {
+      scan_value(v);
+      return;
+    }
+
+    const char* ks = k.as_string();
+
+    if (looks_like_title(ks))
+    {
+      if (_folder == folder::LANDED_TITLES && v.is_block())
+        def(symbol_kind::TITLE, ks, k.loc());
+      else
+        ref(symbol_kind::TITLE, ks, k.loc());
+    }
+    else if (v.is_integer())
+    {
+      if (strcmp(ks, "dynasty") == 0)
+        ref(symbol_kind::DYNASTY, scalar_name(v), v.loc());
+      else if (is_one_of(ks, { "holder", "father", "mother", "spouse", "add_spouse", "add_consort", "liege",
+                               "employer", "guardian", "lover", "killer", "add_lover", "add_friend",
+                               "add_rival" }))
+        ref(symbol_kind::CHARACTER, scalar_name(v), v.loc());
+    }
+    else if (v.is_string())
+    {
+      const char* vs = v.as_string();
+
+      if (is_one_of(ks, { "culture", "has_culture" }))
+        ref(symbol_kind::CULTURE, vs, v.loc());
+      else if (is_one_of(ks, { "religion", "secret_religion", "set_secret_religion" }))
+        ref(symbol_kind::RELIGION, vs, v.loc());
+      else if (is_one_of(ks, { "trait", "add_trait", "remove_trait", "has_trait" }))
+        ref(symbol_kind::TRAIT, vs, v.loc());
+      else if (strcmp(vs, "yes") == 0 || strcmp(vs, "no") == 0)
+        ref(symbol_kind::SCRIPTED_TRIGGER, ks, k.loc());
+    }
+    else if (v.is_block() && ends_with(ks, "_event"))
+    {
+      // firing an event from an effect: character_event = { id = X days = 3 }
+      if (auto i = v.as_block()->find_key("id"); i != v.as_block()->end())
+        ref(symbol_kind::EVENT, scalar_name(i->value()), i->value().loc());
+    }
+    else if (v.is_list() && strcmp(ks, "events") == 0) // on_actions
+    {
+      for (const auto& e : *v.as_list())
+        ref(symbol_kind::EVENT, scalar_name(e), e.loc());
+    }
+
+    scan_value(v);
+  }
+
+public:
+  symbol_extractor(folder f, std::vector<contribution>& out) : _folder(f), _out(out) {}
+
+  void scan_root(const block& root)
+  {
+    for (const auto& s : root)
+    {
+      const auto& k = s.key();
+      const auto& v = s.value();
+
+      switch (_folder)
+      {
+        case folder::EVENTS:
+          if (v.is_block())
+          {
+            if (auto i = v.as_block()->find_key("id"); i != v.as_block()->end())
+              def(symbol_kind::EVENT, scalar_name(i->value()), i->value().loc());
+
+            scan_block(*v.as_block());
+            continue;
+          }
+          break;
+
+        case folder::CHARACTERS:
+        case folder::DYNASTIES:
+          if (k.is_integer())
+          {
+            def((_folder == folder::CHARACTERS) ? symbol_kind::CHARACTER : symbol_kind::DYNASTY, scalar_name(k),
+                k.loc());
+            scan_value(v);
+            continue;
+          }
+          break;
+
+        case folder::CULTURES:
+        case folder::RELIGIONS:
+          if (v.is_block()) // a culture/religion group: its block-valued members are the cultures/religions
+          {
+            for (const auto& s2 : *v.as_block())
+            {
+              if (s2.key().is_string() && s2.value().is_block() && s2.key() != "alternate_start")
+              {
+                def((_folder == folder::CULTURES) ? symbol_kind::CULTURE : symbol_kind::RELIGION,
+                    s2.key().as_string(), s2.key().loc());
+                scan_value(s2.value());
+              }
+              else
+                scan_stmt(s2);
+            }
+
+            continue;
+          }
+          break;
+
+        case folder::TRAITS:
+        case folder::SCRIPTED_TRIGGERS:
+          if (k.is_string())
+          {
+            def((_folder == folder::TRAITS) ? symbol_kind::TRAIT : symbol_kind::SCRIPTED_TRIGGER, k.as_string(),
+                k.loc());
+            scan_value(v);
+            continue;
+          }
+          break;
+
+        default:
+          break;
+      }
+
+      scan_stmt(s);
+    }
+  }
+};
+
+
+void SymbolTable::extract(file_rec& f)
+{
+  f.contribs.clear();
+
+  if (f.p_parser)
+    symbol_extractor(folder_of(f.virt_path), f.contribs).scan_root(*f.p_parser->root_block());
+
+  for (auto& c : f.contribs)
+    c.shard = shard_of(symbol_key{ c.kind, c.name });
+
+  std::stable_sort(f.contribs.begin(), f.contribs.end(),
+                   [](const auto& a, const auto& b) { return a.shard < b.shard; });
+
+  f.shard_off.assign(N_SHARDS + 1, 0);
+
+  for (const auto& c : f.contribs)
+    ++f.shard_off[c.shard + 1];
+
+  for (uint sh = 0; sh < N_SHARDS; ++sh)
+    f.shard_off[sh + 1] += f.shard_off[sh];
+}
+
+
+/* INDEX MAINTENANCE */
+
+SymbolTable::SymbolTable(const Workspace::tree_map& trees, uint n_threads)
+: _n_threads(n_threads)
+{
+  _files.reserve(trees.size());
+
+  for (const auto& [virt_path, e] : trees)
+  {
+    _file_ids.emplace(virt_path, static_cast<uint>(_files.size()));
+    _files.push_back(file_rec{ virt_path, e.path, e.p_parser, {}, {} });
+  }
+
+  parallel_for(_files.size(), [&](size_t i) { extract(_files[i]); }, n_threads);
+
+  // each shard's map is only touched by its own task
+  parallel_for(N_SHARDS, [&](size_t sh)
+  {
+    for (uint id = 0; id < _files.size(); ++id)
+      add(id, sh);
+  }, n_threads);
+}
+
+
+void SymbolTable::add(uint id, size_t sh)
+{
+  const auto& f = _files[id];
+  auto& m = _shards[sh];
+
+  for (uint i = f.shard_off[sh]; i < f.shard_off[sh + 1]; ++i)
+  {
+    const auto& c = f.contribs[i];
+    auto j = m.find(symbol_key{ c.kind, c.name });
+
+    if (j == m.end())
+    {
+      // a new symbol's key must view the symbol's own copy of the name, which only has a stable address once its
+      // node exists, so the node is re-keyed after insertion (which doesn't move it)
+      j = m.emplace(symbol_key{ c.kind, c.name }, symbol{}).first;
+      j->second.name = c.name;
+
+      auto nh = m.extract(j);
+      nh.key() = symbol_key{ c.kind, nh.mapped().name };
+      j = m.insert(std::move(nh)).position;
+    }
+
+    auto& sym = j->second;
+    (c.is_def ? sym.defs : sym.refs).push_back(site{ id, c.loc });
+  }
+}
+
+
+void SymbolTable::withdraw(uint id)
+{
+  // a file may mention a symbol many times, but one pass per symbol does
+  std::unordered_set<symbol_key, symbol_key_hash> done;
+
+  for (const auto& c : _files[id].contribs)
+  {
+    const symbol_key key{ c.kind, c.name };
+
+    if (!done.insert(key).second)
+      continue;
+
+    auto& m = _shards[c.shard];
+    auto i = m.find(key);
+
+    if (i == m.end())
+      continue;
+
+    auto not_ours = [id](const site& s) { return s.file_id != id; };
+    auto& sym = i->second;
+    sym.defs.erase(std::stable_partition(sym.defs.begin(), sym.defs.end(), not_ours), sym.defs.end());
+    sym.refs.erase(std::stable_partition(sym.refs.begin(), sym.refs.end(), not_ours), sym.refs.end());
+
+    if (sym.defs.empty() && sym.refs.empty())
+      m.erase(i);
+  }
+
+  _files[id].contribs.clear();
+}
+
+
+uint SymbolTable::file_id(const std::string& virt_path)
+{
+  auto [i, inserted] = _file_ids.emplace(virt_path, static_cast<uint>(_files.size()));
+
+  if (inserted)
+    _files.push_back(file_rec{ virt_path, fs::path(), nullptr, {}, {} });
+
+  return i->second;
+}
+
+
+void SymbolTable::update(const std::string& virt_path, const fs::path& path,
+                         std::shared_ptr<const parser> p_parser)
+{
+  const uint id = file_id(virt_path);
+  auto& f = _files[id];
+
+  withdraw(id);
+  f.path = path;
+  f.p_parser = std::move(p_parser);
+  extract(f);
+
+  for (uint sh = 0; sh < N_SHARDS; ++sh)
+    add(id, sh);
+}
+
+
+void SymbolTable::remove(const std::string& virt_path)
+{
+  if (auto i = _file_ids.find(virt_path); i != _file_ids.end())
+  {
+    withdraw(i->second);
+    _files[i->second].p_parser.reset();
+  }
+}
+
+
+void SymbolTable::update(const Workspace::tree_map& trees, const Workspace::refresh_result& res)
+{
+  // extract the changed files' new symbols in parallel, but swap them into the shared maps serially
+  std::vector<uint> ids;
+  std::vector<file_rec> recs;
+
+  for (const auto& virt_path : res.changed)
+  {
+    ids.push_back(file_id(virt_path));
+    auto i = trees.find(virt_path);
+
+    if (i != trees.end())
+      recs.push_back(file_rec{ virt_path, i->second.path, i->second.p_parser, {}, {} });
+    else
+      recs.push_back(file_rec{ virt_path, fs::path(), nullptr, {}, {} });
+  }
+
+  parallel_for(recs.size(), [&](size_t i) { extract(recs[i]); }, _n_threads);
+
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    withdraw(ids[i]);
+    _files[ids[i]] = std::move(recs[i]);
+
+    for (uint sh = 0; sh < N_SHARDS; ++sh)
+      add(ids[i], sh);
+  }
+}
+
+
+size_t SymbolTable::size(symbol_kind k) const noexcept
+{
+  size_t n = 0;
+
+  for (const auto& m : _shards)
+    for (const auto& [key, sym] : m)
+      if (key.kind == k)
+        ++n;
+
+  return n;
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,174 @@
+#ifndef LIBCK2_SYMBOL_TABLE_H
+#define LIBCK2_SYMBOL_TABLE_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "Location.h"
+#include "FileLocation.h"
+#include "parser.h"
+#include "Workspace.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+class symbol_extractor;
+
+
+enum class symbol_kind : uint8_t
+{
+  TITLE,
+  EVENT,
+  CHARACTER,
+  DYNASTY,
+  CULTURE,
+  RELIGION,
+  TRAIT,
+  SCRIPTED_TRIGGER,
+};
+
+const char* to_string(symbol_kind) noexcept;
+
+
+/* SYMBOL_TABLE -- where every title, event, character, dynasty, culture, religion, trait & scripted trigger of
+ * a loaded mod is defined, and where it's referenced
+ *
+ * definitions are recognized by the folder of the file they're in:
+ *   common/landed_titles      block-valued title keys, at any depth (titles nest)
+ *   events                    the `id` of each top-level event block
+ *   history/characters        top-level integer keys
+ *   common/dynasties          top-level integer keys
+ *   common/cultures           block-valued keys inside each top-level culture group
+ *   common/religions          block-valued keys inside each top-level religion group
+ *   common/traits             top-level keys
+ *   common/scripted_triggers  top-level keys
+ *
+ * references are recognized anywhere: title-like strings (see looks_like_title); the integer values of holder,
+ * father, mother & other character-valued keys; dynasty, culture, religion & trait values; the ids of event
+ * blocks nested in effects (character_event = { id = X }, etc.) and the elements of `events` lists
+ * (on_actions). any `key = yes|no` statement is taken to be a possible scripted trigger reference, so those are
+ * only meaningful for names which are actually defined as scripted triggers.
+ *
+ * the table is built by extracting each file's symbols in parallel and then merging them in parallel, one hash
+ * shard per task. it remembers each file's contribution, so re-indexing a single file (e.g., after a
+ * Workspace::refresh) only withdraws & re-adds that file's sites.
+ */
+
+class SymbolTable {
+public:
+  struct site {
+    uint     file_id; // see file_path()
+    Location loc;
+  };
+
+  SymbolTable() = default;
+
+  // (move-only, as the symbols' keys view their own names)
+  SymbolTable(const SymbolTable&) = delete;
+  SymbolTable& operator=(const SymbolTable&) = delete;
+  SymbolTable(SymbolTable&&) = default;
+  SymbolTable& operator=(SymbolTable&&) = default;
+
+  // index every tree of a workspace. n_threads = 0 means one per hardware thread (for later updates, too).
+  SymbolTable(const Workspace::tree_map&, uint n_threads = 0);
+
+  // (re-)index a single file, replacing whatever it contributed before. `path` is its real path (see
+  // VFS::file), for floc().
+  void update(const std::string& virt_path, const fs::path& path, std::shared_ptr<const parser>);
+  void remove(const std::string& virt_path);
+
+  // re-index the files which a workspace refresh changed
+  void update(const Workspace::tree_map&, const Workspace::refresh_result&);
+
+  // definition & reference sites of a symbol, in no particular order (empty if there are none)
+  const auto& defs(symbol_kind k, std::string_view name) const noexcept { return get(k, name).defs; }
+  const auto& refs(symbol_kind k, std::string_view name) const noexcept { return get(k, name).refs; }
+
+  const std::string& file_path(uint file_id) const noexcept { return _files[file_id].virt_path; }
+
+  // location of a site, w/ the file's real path
+  FLoc floc(const site& s) const { return FLoc(_files[s.file_id].path, s.loc); }
+
+  // number of distinct symbols of a kind w/ any definitions or references
+  size_t size(symbol_kind) const noexcept;
+
+private:
+  friend class symbol_extractor;
+
+  static const uint N_SHARDS = 64;
+
+  // a definition or reference found in a file
+  struct contribution {
+    symbol_kind kind;
+    bool        is_def;
+    uint8_t     shard;
+    std::string name;
+    Location    loc;
+  };
+
+  struct file_rec {
+    std::string virt_path;
+    fs::path    path; // of the file (as its tree may be shared w/ another file; see Workspace::entry)
+    std::shared_ptr<const parser> p_parser; // null if removed
+    std::vector<contribution> contribs;     // sorted by shard
+    std::vector<uint> shard_off;            // [N_SHARDS + 1] offset into contribs of each shard's first
+  };
+
+  struct symbol {
+    std::string       name; // (which its key views)
+    std::vector<site> defs;
+    std::vector<site> refs;
+  };
+
+  // a symbol's key views its name, so that lookups needn't copy the name they're given
+  struct symbol_key {
+    symbol_kind      kind;
+    std::string_view name;
+
+    bool operator==(const symbol_key& o) const noexcept { return kind == o.kind && name == o.name; }
+  };
+
+  struct symbol_key_hash {
+    size_t operator()(const symbol_key& k) const noexcept
+    {
+      return std::hash<std::string_view>{}(k.name) * 31 + static_cast<size_t>(k.kind);
+    }
+  };
+
+  using symbol_map = std::unordered_map<symbol_key, symbol, symbol_key_hash>;
+
+  static uint8_t shard_of(const symbol_key& key) noexcept
+  {
+    return static_cast<uint8_t>(symbol_key_hash{}(key) % N_SHARDS);
+  }
+
+  static void extract(file_rec&);
+
+  const symbol& get(symbol_kind k, std::string_view name) const noexcept
+  {
+    const symbol_key key{ k, name };
+    const auto& m = _shards[shard_of(key)];
+    auto i = m.find(key);
+    return (i != m.end()) ? i->second : s_none;
+  }
+
+  void add(uint file_id, size_t shard);
+  void withdraw(uint file_id);
+  uint file_id(const std::string& virt_path);
+
+  static const symbol s_none;
+
+  uint                  _n_threads = 0;
+  std::vector<file_rec> _files;
+  std::unordered_map<std::string, uint> _file_ids; // by virtual path
+  symbol_map _shards[N_SHARDS];
+};
+
+
+NAMESPACE_CK2_END;
+#endif
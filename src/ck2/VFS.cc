@@ -0,0 +1,512 @@
+
+#include "VFS.h"
+#include "lexer.h"
+#include "parser.h"
+#include "strutil.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+
+NAMESPACE_CK2;
+
+
+std::shared_ptr<const VFS::index> VFS::get_index() const
+{
+  auto p_cache = _p_cache;
+  std::lock_guard<std::mutex> lk(p_cache->mtx);
+
+  if (!p_cache->p_idx)
+    p_cache->p_idx = build_index();
+
+  return p_cache->p_idx;
+}
+
+
+static std::string parent_dir(const std::string& path)
+{
+  const auto slash = path.rfind('/');
+  return (slash == std::string::npos) ? std::string() : path.substr(0, slash);
+}
+
+
+void VFS::add_file(index& idx, candidate c, std::unordered_set<std::string>* p_touched)
+{
+  auto folded = strutil::ascii_lower(c.rel_path);
+  auto [i, inserted] = idx.by_folded.emplace(folded, idx.files.size());
+
+  if (inserted)
+  {
+    idx.files.emplace_back();
+
+    if (p_touched) // (else the directory listings are built in bulk once every root has been walked)
+    {
+      auto dir = parent_dir(folded);
+      idx.dirs[dir].push_back(i->second);
+      p_touched->insert(std::move(dir));
+    }
+  }
+
+  idx.by_path.emplace(c.rel_path, i->second);
+
+  // keep the candidates in order of precedence (the roots are walked from the top down when the index is built, so
+  // then this is always the end)
+  auto& cands = idx.files[i->second];
+  auto pos = std::find_if(cands.begin(), cands.end(), [&](const candidate& o) { return o.root_idx < c.root_idx; });
+  cands.insert(pos, std::move(c));
+}
+
+
+void VFS::remove_file(index& idx, uint root_idx, const std::string& rel_path, std::unordered_set<std::string>& touched)
+{
+  auto folded = strutil::ascii_lower(rel_path);
+  auto i = idx.by_folded.find(folded);
+
+  if (i == idx.by_folded.end())
+    return;
+
+  auto& cands = idx.files[i->second];
+
+  cands.erase(std::remove_if(cands.begin(), cands.end(), [&](const candidate& c)
+  {
+    return c.root_idx == root_idx && c.rel_path == rel_path;
+  }), cands.end());
+
+  if (std::none_of(cands.begin(), cands.end(), [&](const candidate& c) { return c.rel_path == rel_path; }))
+    idx.by_path.erase(rel_path);
+
+  // an emptied slot in `files` stays behind, unreachable, until the index is next built from scratch
+  if (cands.empty())
+  {
+    idx.by_folded.erase(i);
+    touched.insert(parent_dir(folded));
+  }
+}
+
+
+// walk a directory under a directory root, adding every file beneath it & recording the stamps of its directories
+void VFS::scan_dir(index& idx, uint root_idx, const std::string& rel_dir,
+                   std::unordered_set<std::string>* p_touched) const
+{
+  const auto& rt = _roots[root_idx];
+  const auto dir_path = (rel_dir.empty()) ? rt.path : rt.path / rel_dir;
+  auto& stamps = idx.dir_stamps[root_idx];
+
+  std::error_code ec;
+  const auto opts = fs::directory_options::follow_directory_symlink | fs::directory_options::skip_permission_denied;
+
+  // stamps are taken before their directories are listed, so an entry added meanwhile moves them again
+  stamps[rel_dir] = fs::last_write_time(dir_path, ec);
+
+  for (auto it = fs::recursive_directory_iterator(dir_path, opts, ec); it != fs::recursive_directory_iterator();
+       it.increment(ec))
+  {
+    if (ec) break;
+
+    std::error_code ec_stamp;
+
+    if (it->is_directory(ec))
+      stamps[it->path().lexically_relative(rt.path).generic_string()] = it->last_write_time(ec_stamp);
+    else if (it->is_regular_file(ec))
+      add_file(idx, candidate{ root_idx, it->path().lexically_relative(rt.path).generic_string(), nullptr }, p_touched);
+  }
+
+  if (ec)
+    throw PathError(fmt::format("Failed to index directory: {}: {}", ec.message(), dir_path.generic_string()),
+                    dir_path);
+}
+
+
+// re-list a directory whose stamp moved: add & remove the files directly within it, walk its new subdirectories,
+// and drop those which are gone (or all of it, if it's gone itself)
+void VFS::rescan_dir(index& idx, uint root_idx, const std::string& rel_dir,
+                     std::unordered_set<std::string>& touched) const
+{
+  const auto& rt = _roots[root_idx];
+  const auto dir_path = (rel_dir.empty()) ? rt.path : rt.path / rel_dir;
+  auto& stamps = idx.dir_stamps[root_idx];
+
+  auto prefix_of = [](const std::string& dir) { return (dir.empty()) ? dir : dir + '/'; };
+
+  auto is_child = [](const std::string& path, const std::string& prefix)
+  {
+    return path.size() > prefix.size() && path.compare(0, prefix.size(), prefix) == 0 &&
+           path.find('/', prefix.size()) == std::string::npos;
+  };
+
+  // the files of this root directly within a directory
+  auto files_in = [&](const std::string& dir)
+  {
+    std::vector<std::string> v;
+    const auto prefix = prefix_of(dir);
+
+    if (auto i = idx.dirs.find(strutil::ascii_lower(dir)); i != idx.dirs.end())
+      for (auto file_idx : i->second)
+        for (const auto& c : idx.files[file_idx])
+          if (c.root_idx == root_idx && is_child(c.rel_path, prefix))
+            v.push_back(c.rel_path);
+
+    return v;
+  };
+
+  auto remove_tree = [&](const std::string& dir)
+  {
+    const auto prefix = prefix_of(dir);
+    std::vector<std::string> gone;
+
+    for (const auto& [d, stamp] : stamps)
+      if (d == dir || (d.size() > prefix.size() && d.compare(0, prefix.size(), prefix) == 0))
+        gone.push_back(d);
+
+    for (const auto& d : gone)
+    {
+      for (const auto& f : files_in(d))
+        remove_file(idx, root_idx, f, touched);
+
+      stamps.erase(d);
+    }
+  };
+
+  std::error_code ec;
+  const auto stamp = fs::last_write_time(dir_path, ec);
+
+  if (ec || !fs::is_directory(dir_path, ec))
+  {
+    remove_tree(rel_dir);
+    return;
+  }
+
+  stamps[rel_dir] = stamp;
+
+  const auto prefix = prefix_of(rel_dir);
+  const auto old_files = files_in(rel_dir);
+  std::unordered_set<std::string> unlisted(old_files.begin(), old_files.end());
+  std::unordered_set<std::string> subdirs;
+  std::vector<std::string> new_subdirs;
+
+  for (auto it = fs::directory_iterator(dir_path, fs::directory_options::skip_permission_denied, ec);
+       it != fs::directory_iterator(); it.increment(ec))
+  {
+    if (ec) break;
+
+    auto rel_path = prefix + it->path().filename().generic_string();
+
+    if (it->is_directory(ec))
+    {
+      if (stamps.find(rel_path) == stamps.end())
+        new_subdirs.push_back(rel_path);
+
+      subdirs.insert(std::move(rel_path));
+    }
+    else if (it->is_regular_file(ec) && unlisted.erase(rel_path) == 0)
+      add_file(idx, candidate{ root_idx, std::move(rel_path), nullptr }, &touched);
+  }
+
+  if (ec)
+    throw PathError(fmt::format("Failed to index directory: {}: {}", ec.message(), dir_path.generic_string()),
+                    dir_path);
+
+  for (const auto& f : unlisted)
+    remove_file(idx, root_idx, f, touched);
+
+  std::vector<std::string> gone_subdirs;
+
+  for (const auto& [d, s] : stamps)
+    if (is_child(d, prefix) && subdirs.count(d) == 0)
+      gone_subdirs.push_back(d);
+
+  for (const auto& d : gone_subdirs)
+    remove_tree(d);
+
+  for (const auto& d : new_subdirs)
+    scan_dir(idx, root_idx, d, &touched);
+}
+
+
+std::shared_ptr<const VFS::index> VFS::build_index() const
+{
+  auto p_idx = std::make_shared<index>();
+  auto& idx = *p_idx;
+
+  idx.dir_stamps.resize(_roots.size());
+
+  /* walk roots from the top of the stack down, so that each file's candidates are in order of precedence */
+  for (uint r = static_cast<uint>(_roots.size()); r-- > 0;)
+  {
+    const auto& rt = _roots[r];
+
+    if (rt.p_zip)
+    {
+      for (const auto& e : rt.p_zip->entries())
+        if (!e.is_dir())
+          add_file(idx, candidate{ r, e.name, &e }, nullptr);
+
+      continue;
+    }
+
+    if (fs::is_directory(rt.path))
+      scan_dir(idx, r, std::string(), nullptr);
+  }
+
+  /* group by (case-folded) parent directory, sorted by case-folded filename */
+
+  std::vector<const std::string*> folded_paths(idx.files.size());
+
+  for (const auto& [folded, i] : idx.by_folded)
+  {
+    idx.dirs[parent_dir(folded)].push_back(i);
+    folded_paths[i] = &folded;
+  }
+
+  for (auto& [dir, v] : idx.dirs)
+    std::sort(v.begin(), v.end(), [&](size_t a, size_t b) { return *folded_paths[a] < *folded_paths[b]; });
+
+  return p_idx;
+}
+
+
+std::shared_ptr<const VFS::index> VFS::update_index(const std::shared_ptr<const index>& p_old) const
+{
+  /* find the directories whose stamps moved before copying anything, as usually none have */
+
+  std::vector<std::vector<std::string>> changed(_roots.size());
+  bool any_changed = false;
+
+  for (uint r = 0; r < _roots.size(); ++r)
+  {
+    if (_roots[r].p_zip)
+      continue;
+
+    const auto& stamps = p_old->dir_stamps[r];
+    std::error_code ec;
+
+    if (stamps.empty()) // (the root didn't exist)
+    {
+      if (fs::is_directory(_roots[r].path, ec))
+        changed[r].emplace_back();
+    }
+    else
+      for (const auto& [d, stamp] : stamps)
+        if (fs::last_write_time((d.empty()) ? _roots[r].path : _roots[r].path / d, ec) != stamp || ec)
+          changed[r].push_back(d);
+
+    any_changed |= !changed[r].empty();
+  }
+
+  if (!any_changed)
+    return p_old;
+
+  auto p_idx = std::make_shared<index>(*p_old);
+  auto& idx = *p_idx;
+  std::unordered_set<std::string> touched; // case-folded directories whose listings gained or lost paths
+
+  for (uint r = 0; r < _roots.size(); ++r)
+  {
+    std::sort(changed[r].begin(), changed[r].end()); // (parents first)
+
+    for (const auto& d : changed[r])
+      if (d.empty() || idx.dir_stamps[r].count(d)) // (else it went along with its parent)
+        rescan_dir(idx, r, d, touched);
+  }
+
+  for (const auto& dir : touched)
+  {
+    auto i = idx.dirs.find(dir);
+
+    if (i == idx.dirs.end())
+      continue;
+
+    auto& v = i->second;
+    v.erase(std::remove_if(v.begin(), v.end(), [&](size_t f) { return idx.files[f].empty(); }), v.end());
+
+    if (v.empty())
+    {
+      idx.dirs.erase(i);
+      continue;
+    }
+
+    std::vector<std::pair<std::string, size_t>> keyed;
+    keyed.reserve(v.size());
+
+    for (auto f : v)
+      keyed.emplace_back(strutil::ascii_lower(idx.files[f].front().rel_path), f);
+
+    std::sort(keyed.begin(), keyed.end());
+
+    for (size_t k = 0; k < v.size(); ++k)
+      v[k] = keyed[k].second;
+  }
+
+  return p_idx;
+}
+
+
+void VFS::refresh()
+{
+  std::shared_ptr<const index> p_old;
+
+  {
+    std::lock_guard<std::mutex> lk(_p_cache->mtx);
+    p_old = _p_cache->p_idx;
+  }
+
+  auto p_cache = std::make_shared<index_cache>();
+
+  if (p_old)
+    p_cache->p_idx = update_index(p_old);
+
+  _p_cache = std::move(p_cache);
+}
+
+
+static std::string normal_key(const fs::path& virt_path)
+{
+  auto key = virt_path.lexically_normal().generic_string();
+
+  while (!key.empty() && key.back() == '/') key.pop_back();
+  if (key == ".") key.clear();
+
+  return key;
+}
+
+
+const std::vector<VFS::candidate>* VFS::find(const index& idx, const fs::path& virt_path) const
+{
+  const auto key = normal_key(virt_path);
+
+  if (auto i = idx.by_path.find(key); i != idx.by_path.end())
+    return &idx.files[i->second];
+
+  if (auto i = idx.by_folded.find(strutil::ascii_lower(key)); i != idx.by_folded.end())
+    return &idx.files[i->second];
+
+  return nullptr;
+}
+
+
+VFS::file VFS::to_file(const candidate& c) const
+{
+  const auto& rt = _roots[c.root_idx];
+  return file{ rt.path / c.rel_path, rt.p_zip.get(), c.p_entry, c.rel_path };
+}
+
+
+bool VFS::resolve(file* p_file, const fs::path& virt_path) const
+{
+  const auto p_idx = get_index();
+  const auto p_cands = find(*p_idx, virt_path);
+
+  if (p_cands == nullptr)
+    return false;
+
+  *p_file = to_file(p_cands->front());
+  return true;
+}
+
+
+std::vector<VFS::file> VFS::candidates(const fs::path& virt_path) const
+{
+  const auto p_idx = get_index();
+  std::vector<file> v;
+
+  if (auto p_cands = find(*p_idx, virt_path))
+    for (const auto& c : *p_cands)
+      v.push_back(to_file(c));
+
+  return v;
+}
+
+
+std::vector<VFS::file> VFS::list_dir(const fs::path& virt_dir, std::string_view ext) const
+{
+  const auto p_idx = get_index();
+  const auto folded_ext = strutil::ascii_lower(ext);
+  std::vector<file> v;
+
+  auto i = p_idx->dirs.find(strutil::ascii_lower(normal_key(virt_dir)));
+
+  if (i == p_idx->dirs.end())
+    return v;
+
+  for (auto file_idx : i->second)
+  {
+    const auto& c = p_idx->files[file_idx].front();
+
+    if (!folded_ext.empty() && (c.rel_path.size() < folded_ext.size() ||
+        strutil::ascii_lower(std::string_view(c.rel_path).substr(c.rel_path.size() - folded_ext.size())) != folded_ext))
+      continue;
+
+    v.push_back(to_file(c));
+  }
+
+  return v;
+}
+
+
+std::vector<VFS::file> VFS::glob(std::string_view pattern) const
+{
+  const auto p_idx = get_index();
+  const auto folded_pat = strutil::ascii_lower(normal_key(fs::path(pattern)));
+
+  std::vector<std::pair<const std::string*, size_t>> matches;
+
+  for (const auto& [folded, i] : p_idx->by_folded)
+    if (strutil::glob_match(folded_pat, folded, '/'))
+      matches.emplace_back(&folded, i);
+
+  std::sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) { return *a.first < *b.first; });
+
+  std::vector<file> v;
+  v.reserve(matches.size());
+
+  for (const auto& m : matches)
+    v.push_back(to_file(p_idx->files[m.second].front()));
+
+  return v;
+}
+
+
+std::string VFS::file::read() const
+{
+  if (in_archive())
+    return p_zip->read(*p_entry);
+
+  auto spath = path.generic_string();
+  unique_file_ptr ufp( std::fopen(spath.c_str(), "rb"), std::fclose );
+
+  if (!ufp)
+    throw Error("Failed to open file: {}: {}", strerror(errno), spath);
+
+  std::string s;
+  char buf[65536];
+
+  while (size_t n = std::fread(buf, 1, sizeof(buf), ufp.get()))
+    s.append(buf, n);
+
+  if (std::ferror(ufp.get()))
+    throw Error("Failed to read file: {}: {}", strerror(errno), spath);
+
+  return s;
+}
+
+
+std::unique_ptr<parser> VFS::file::parse(bool is_save) const
+{
+  if (!in_archive())
+    return std::make_unique<parser>(path, is_save);
+
+  const auto data = read();
+  buffer_input in(data);
+  return std::make_unique<parser>(in, path, is_save);
+}
+
+
+std::unique_ptr<parser> VFS::parse(const fs::path& virt_path, bool is_save) const
+{
+  return open(virt_path).parse(is_save);
+}
+
+
+NAMESPACE_CK2_END;
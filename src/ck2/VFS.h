@@ -1,60 +1,185 @@
-#ifndef LIBCK2_VFS_H
-#define LIBCK2_VFS_H
-
-
-#include "common.h"
-#include "filesystem.h"
-#include <vector>
-#include <string>
-
-
-NAMESPACE_CK2;
-
-
-struct VFS {
-  VFS(const fs::path& base_path) : _root_paths({ base_path }) {}
-
-  void push_mod_path(const fs::path& p) {
-    if (!fs::exists(p)) throw PathNotFoundError(p);
-    if (!fs::is_directory(p)) throw PathTypeError(p);
-    _root_paths.push_back(p);
-  }
-
-  bool resolve_path(fs::path* p_real_path, const fs::path& virt_path) const {
-    /* search path vector for a filesystem hit in reverse */
-    for (auto i = _root_paths.crbegin(); i != _root_paths.crend(); ++i)
-      if (fs::exists( *p_real_path = *i / virt_path ))
-        return true;
-    return false;
-  }
-
-  /* a more convenient accessor which auto-throws on a nonexistent path */
-  fs::path operator[](const fs::path& virt_path) const {
-    fs::path p;
-    if (!resolve_path(&p, virt_path)) throw PathNotFoundError(p);
-    return p;
-  }
-
-  auto to_string() {
-    std::string s = "{";
-
-    if (_root_paths.empty())
-      return s += '}';
-
-    // iterate from "bottom" (top of stack) to "top" (bottom of stack) of our vector
-    for (auto it = _root_paths.crbegin(); it != _root_paths.crend(); ++it) {
-      s.append("\n\t");
-      s.append((*it).string());
-    }
-
-    s.append("\n}");
-    return s;
-  }
-
-private:
-  std::vector<fs::path> _root_paths;
-};
-
-
-NAMESPACE_CK2_END;
-#endif
+#ifndef LIBCK2_VFS_H
+#define LIBCK2_VFS_H
+
+
+#include "common.h"
+#include "filesystem.h"
+#include "zip.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+
+NAMESPACE_CK2;
+
+
+class parser;
+
+
+/* VFS -- virtual filesystem: a stack of roots (the game folder, then mods in load order), where a virtual path
+ * resolves to the file in the topmost root which has it. a mod root may be a directory or a zip archive; an archive's
+ * central directory is indexed once when it's pushed, and its entries are decompressed on demand.
+ *
+ * upon the first lookup after the root stack changes, every file under every root is indexed in memory, so lookups &
+ * directory listings make no syscalls. as in the game on Windows, paths are case-insensitive: a file overrides
+ * those in lower roots whose paths only differ in case, and lookups fall back to a case-folded match. the index is
+ * a snapshot, so call refresh() if files are added or removed underneath the VFS afterward.
+ *
+ * the index also records the modification stamp of every directory it walked. refresh() re-lists only those
+ * directories whose stamps moved (adding or removing an entry moves its directory's stamp) & recomputes the winners
+ * of only the paths added or removed there. like any stamp-based check, an entry added & another removed within the
+ * filesystem's timestamp granularity of the last refresh may go unnoticed until the directory's stamp moves again. */
+
+struct VFS {
+  VFS(const fs::path& base_path) : _roots({ root{ base_path, nullptr } }), _p_cache(std::make_shared<index_cache>()) {}
+
+  void push_mod_path(const fs::path& p) {
+    if (!fs::exists(p)) throw PathNotFoundError(p);
+
+    if (fs::is_directory(p))
+      _roots.push_back(root{ p, nullptr });
+    else if (fs::is_regular_file(p) && is_zip_file(p))
+      _roots.push_back(root{ p, std::make_shared<zip_archive>(p) });
+    else
+      throw PathTypeError(p);
+
+    reset_index();
+  }
+
+  // bring the path index up to date with files added or removed underneath the VFS since it was built (a no-op if
+  // it hasn't been built yet). copies of the VFS keep the index they had.
+  void refresh();
+
+  /* a file resolved via the VFS, either on disk or as an entry of a mounted archive (in which case its path is the
+   * archive's path joined with the entry name, which is only meaningful in diagnostics) */
+  struct file {
+    fs::path                  path;
+    const zip_archive*        p_zip   = nullptr;
+    const zip_archive::entry* p_entry = nullptr;
+    std::string               virt_path; // as spelled in the root which provides the file
+
+    bool in_archive() const noexcept { return p_zip != nullptr; }
+
+    // whole file contents (decompressed, if in an archive)
+    std::string read() const;
+
+    // parse the file, from disk or from the archive
+    std::unique_ptr<parser> parse(bool is_save = false) const;
+  };
+
+  bool resolve(file* p_file, const fs::path& virt_path) const;
+
+  // resolve a path which must be a real file on disk (i.e., not in a mounted archive)
+  bool resolve_path(fs::path* p_real_path, const fs::path& virt_path) const {
+    file f;
+    if (!resolve(&f, virt_path) || f.in_archive()) return false;
+    *p_real_path = std::move(f.path);
+    return true;
+  }
+
+  /* a more convenient accessor which auto-throws on a nonexistent path */
+  fs::path operator[](const fs::path& virt_path) const {
+    file f;
+    if (!resolve(&f, virt_path)) throw PathNotFoundError(virt_path);
+    if (f.in_archive()) throw PathTypeError(f.path);
+    return f.path;
+  }
+
+  // like operator[], but the file may also reside in a mounted archive
+  file open(const fs::path& virt_path) const {
+    file f;
+    if (!resolve(&f, virt_path)) throw PathNotFoundError(virt_path);
+    return f;
+  }
+
+  // resolve & parse a file, wherever it resides (archive entries are decompressed into memory & parsed from there)
+  std::unique_ptr<parser> parse(const fs::path& virt_path, bool is_save = false) const;
+
+  // the winning files directly within a virtual directory (e.g., "common/landed_titles"), w/ mod overrides applied
+  // and sorted by filename. if `ext` is given (e.g., ".txt"), only files with that extension are included.
+  std::vector<file> list_dir(const fs::path& virt_dir, std::string_view ext = "") const;
+
+  // the winning files whose virtual paths match a glob pattern (e.g., "common/*/*.txt"), sorted by path. '*' matches
+  // any run of characters and '?' any one character, but neither matches '/'. matching is case-insensitive.
+  std::vector<file> glob(std::string_view pattern) const;
+
+  // every file which a virtual path resolves to in any root, from the winner down to the most overridden
+  std::vector<file> candidates(const fs::path& virt_path) const;
+
+  // paths of the roots which are directories (i.e., not archives), from the base up
+  std::vector<fs::path> dir_root_paths() const {
+    std::vector<fs::path> v;
+    for (const auto& r : _roots) if (!r.p_zip) v.push_back(r.path);
+    return v;
+  }
+
+  auto to_string() {
+    std::string s = "{";
+
+    if (_roots.empty())
+      return s += '}';
+
+    // iterate from "bottom" (top of stack) to "top" (bottom of stack) of our vector
+    for (auto it = _roots.crbegin(); it != _roots.crend(); ++it) {
+      s.append("\n\t");
+      s.append(it->path.string());
+    }
+
+    s.append("\n}");
+    return s;
+  }
+
+private:
+  struct root {
+    fs::path path;
+    std::shared_ptr<const zip_archive> p_zip; // null for directory roots
+  };
+
+  // a file in a particular root
+  struct candidate {
+    uint                      root_idx;
+    std::string               rel_path; // as spelled in that root (generic)
+    const zip_archive::entry* p_entry;  // null for directory roots
+  };
+
+  struct index {
+    // per (case-folded) virtual path, the roots which have it, topmost (i.e., winning) first
+    std::vector<std::vector<candidate>> files;
+    std::unordered_map<std::string, size_t> by_path;   // every spelling seen => index into `files`
+    std::unordered_map<std::string, size_t> by_folded; // case-folded path => index into `files`
+    std::unordered_map<std::string, std::vector<size_t>> dirs; // case-folded dir => its files' indices, sorted
+
+    // per root, the modification stamp of each directory walked under it, by path relative to the root (the root
+    // itself is ""). empty for archive roots & directory roots which didn't exist.
+    std::vector<std::unordered_map<std::string, fs::file_time_type>> dir_stamps;
+  };
+
+  struct index_cache {
+    std::mutex mtx;
+    std::shared_ptr<const index> p_idx;
+  };
+
+  std::vector<root> _roots;
+  std::shared_ptr<index_cache> _p_cache; // shared by copies of the VFS until either changes its roots
+
+  // discard the path index, so that it will be rebuilt upon the next lookup
+  void reset_index() { _p_cache = std::make_shared<index_cache>(); }
+
+  std::shared_ptr<const index> get_index() const;
+  std::shared_ptr<const index> build_index() const;
+  std::shared_ptr<const index> update_index(const std::shared_ptr<const index>&) const;
+  void scan_dir(index&, uint root_idx, const std::string& rel_dir, std::unordered_set<std::string>* p_touched) const;
+  void rescan_dir(index&, uint root_idx, const std::string& rel_dir, std::unordered_set<std::string>& touched) const;
+  static void add_file(index&, candidate, std::unordered_set<std::string>* p_touched);
+  static void remove_file(index&, uint root_idx, const std::string& rel_path, std::unordered_set<std::string>& touched);
+  const std::vector<candidate>* find(const index&, const fs::path& virt_path) const;
+  file to_file(const candidate&) const;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,328 @@
+
+#include "Workspace.h"
+#include "lexer.h"
+#include "parallel.h"
+#include "strutil.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <unordered_map>
+#include <unordered_set>
+
+
+NAMESPACE_CK2;
+
+
+static uint64_t content_hash(std::string_view s) noexcept
+{
+  // FNV-1a, 64-bit
+  uint64_t h = 14695981039346656037ull;
+
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+
+  return h;
+}
+
+
+// a parser for `path` with the tree of p, which was parsed from identical content
+static std::shared_ptr<const parser> share_tree(const std::shared_ptr<const parser>& p, const fs::path& path)
+{
+  return (p->path() == path) ? p : std::make_shared<const parser>(*p, path);
+}
+
+
+Workspace::refresh_result Workspace::refresh()
+{
+  static constexpr size_t NO_PARSE = SIZE_MAX;
+
+  struct job {
+    VFS::file   file;
+    entry       e;
+    std::string data;
+    std::string err;
+    size_t      parse_idx; // index into parses of the parse that provides this file's tree, or NO_PARSE
+  };
+
+  struct parse_job {
+    size_t job_idx; // the first file with this content, whose data gets parsed
+    std::shared_ptr<const parser> p_parser;
+    std::string err;
+  };
+
+  // a loaded file whose tree another file with the same content hash may share, once their bytes compare equal
+  struct source {
+    const VFS::file* p_file;
+    const std::string* p_data; // the file's content, if it was read by this refresh
+    const entry* p_entry;
+  };
+
+  refresh_result res;
+
+  _vfs.refresh();
+  auto p_old = trees();
+  auto p_new = std::make_shared<tree_map>();
+
+  /* resolve the globs. winners which are the same file w/ the same size & stamp as before keep their trees. */
+
+  std::vector<job> jobs;
+  std::vector<VFS::file> kept; // the files which keep their trees
+  std::unordered_set<std::string> seen;
+
+  for (const auto& g : _globs)
+    for (auto& f : _vfs.glob(g))
+    {
+      if (!seen.insert(f.virt_path).second)
+        continue;
+
+      job j{ std::move(f), entry{}, std::string(), std::string(), NO_PARSE };
+      j.e.path = j.file.path;
+
+      if (j.file.in_archive())
+      {
+        j.e.size = j.file.p_entry->size;
+        j.e.stamp = j.file.p_entry->crc32;
+      }
+      else
+      {
+        std::error_code ec;
+        j.e.size = fs::file_size(j.file.path, ec);
+        const auto mtime = (ec) ? fs::file_time_type() : fs::last_write_time(j.file.path, ec);
+        j.e.stamp = static_cast<uint64_t>(mtime.time_since_epoch().count());
+
+        if (ec)
+        {
+          res.errors.push_back(load_error{ j.file.virt_path, j.file.path, ec.message() });
+          continue;
+        }
+      }
+
+      if (auto i = p_old->find(j.file.virt_path); i != p_old->end())
+      {
+        const auto& old = i->second;
+
+        if (old.path == j.e.path && old.size == j.e.size && old.stamp == j.e.stamp)
+        {
+          p_new->emplace(j.file.virt_path, old);
+          kept.push_back(std::move(j.file));
+          ++res.n_reused;
+          continue;
+        }
+      }
+
+      if (auto i = _failed.find(j.file.virt_path); i != _failed.end()) // don't retry it until it changes
+      {
+        const auto& f = i->second;
+
+        if (f.path == j.e.path && f.size == j.e.size && f.stamp == j.e.stamp)
+        {
+          res.errors.push_back(load_error{ j.file.virt_path, j.file.path, f.what });
+          continue;
+        }
+      }
+
+      jobs.push_back(std::move(j));
+    }
+
+  /* read & hash the rest */
+
+  parallel_for(jobs.size(), [&](size_t i)
+  {
+    auto& j = jobs[i];
+
+    try
+    {
+      j.data = j.file.read();
+      j.e.size = j.data.size();
+      j.e.hash = content_hash(j.data);
+    }
+    catch (const std::exception& e)
+    {
+      j.err = e.what();
+    }
+  }, _n_threads);
+
+  /* reuse trees whose content is unchanged or which are shared with another file of identical content, and plan
+   * one parse for each distinct new content. a hash match is only a candidate: the bytes are compared too. */
+
+  std::unordered_multimap<uint64_t, source> by_hash;
+
+  for (const auto& f : kept)
+  {
+    const auto& e = p_new->at(f.virt_path);
+    by_hash.emplace(e.hash, source{ &f, nullptr, &e });
+  }
+
+  auto same_content = [](const source& src, const std::string& data)
+  {
+    if (src.p_entry->size != data.size())
+      return false;
+
+    if (src.p_data)
+      return *src.p_data == data;
+
+    try
+    {
+      return src.p_file->read() == data;
+    }
+    catch (const std::exception&)
+    {
+      return false; // (so just don't share it)
+    }
+  };
+
+  std::vector<parse_job> parses;
+  std::unordered_multimap<uint64_t, size_t> parse_by_hash;
+
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    auto& j = jobs[i];
+
+    if (!j.err.empty())
+      continue;
+
+    if (auto it = p_old->find(j.file.virt_path); it != p_old->end())
+    {
+      const auto& old = it->second;
+
+      if (old.path == j.e.path && old.hash == j.e.hash && old.size == j.e.size)
+      {
+        j.e.p_parser = old.p_parser;
+        by_hash.emplace(j.e.hash, source{ &j.file, &j.data, &j.e });
+        ++res.n_reused;
+        continue;
+      }
+    }
+
+    bool shared = false;
+
+    for (auto [it, end] = by_hash.equal_range(j.e.hash); it != end && !shared; ++it)
+      if (same_content(it->second, j.data))
+      {
+        j.e.p_parser = share_tree(it->second.p_entry->p_parser, j.e.path);
+        shared = true;
+      }
+
+    for (auto [it, end] = parse_by_hash.equal_range(j.e.hash); it != end && !shared; ++it)
+      if (jobs[parses[it->second].job_idx].data == j.data)
+      {
+        j.parse_idx = it->second;
+        shared = true;
+      }
+
+    if (shared)
+    {
+      ++res.n_shared;
+      continue;
+    }
+
+    j.parse_idx = parses.size();
+    parse_by_hash.emplace(j.e.hash, parses.size());
+    parses.push_back(parse_job{ i, nullptr, std::string() });
+  }
+
+  /* parse, largest first */
+
+  std::vector<size_t> order(parses.size());
+
+  for (size_t k = 0; k < order.size(); ++k)
+    order[k] = k;
+
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+  {
+    return jobs[parses[a].job_idx].e.size > jobs[parses[b].job_idx].e.size;
+  });
+
+  parallel_for(order.size(), [&](size_t k)
+  {
+    auto& pj = parses[order[k]];
+    const auto& j = jobs[pj.job_idx];
+
+    try
+    {
+      buffer_input in(j.data);
+      pj.p_parser = std::make_unique<parser>(in, j.file.path);
+    }
+    catch (const std::exception& e)
+    {
+      pj.err = e.what();
+    }
+  }, _n_threads);
+
+  res.n_parsed = parses.size();
+
+  /* assemble the new trees */
+
+  for (const auto& j : jobs)
+    _failed.erase(j.file.virt_path);
+
+  for (auto& j : jobs)
+  {
+    if (j.parse_idx != NO_PARSE)
+    {
+      auto& pj = parses[j.parse_idx];
+
+      if (pj.p_parser)
+        j.e.p_parser = share_tree(pj.p_parser, j.e.path);
+      else
+        j.err = pj.err;
+    }
+
+    if (!j.err.empty())
+    {
+      _failed[j.file.virt_path] = failure{ j.e.path, j.e.size, j.e.stamp, j.err };
+      res.errors.push_back(load_error{ j.file.virt_path, j.file.path, std::move(j.err) });
+      continue;
+    }
+
+    p_new->emplace(std::move(j.file.virt_path), std::move(j.e));
+  }
+
+  /* diff against the old trees */
+
+  for (const auto& [virt_path, e] : *p_new)
+  {
+    auto i = p_old->find(virt_path);
+
+    if (i == p_old->end() || i->second.p_parser != e.p_parser)
+      res.changed.push_back(virt_path);
+  }
+
+  for (const auto& [virt_path, e] : *p_old)
+    if (p_new->find(virt_path) == p_new->end())
+      res.changed.push_back(virt_path);
+
+  for (auto i = _failed.begin(); i != _failed.end();) // forget failures of files which no longer match
+    i = (seen.count(i->first)) ? std::next(i) : _failed.erase(i);
+
+  std::sort(res.changed.begin(), res.changed.end());
+  std::sort(res.errors.begin(), res.errors.end(),
+            [](const auto& a, const auto& b) { return a.virt_path < b.virt_path; });
+
+  publish(std::move(p_new));
+  return res;
+}
+
+
+std::shared_ptr<const parser> Workspace::find(std::string_view virt_path) const
+{
+  const auto p_trees = trees();
+
+  if (auto i = p_trees->find(std::string(virt_path)); i != p_trees->end())
+    return i->second.p_parser;
+
+  // not spelled as in its root, so fall back to a case-insensitive match (as the VFS would resolve it)
+  const auto folded = strutil::ascii_lower(virt_path);
+
+  for (const auto& [k, e] : *p_trees)
+    if (k.size() == folded.size() && strutil::ascii_lower(k) == folded)
+      return e.p_parser;
+
+  return nullptr;
+}
+
+
+NAMESPACE_CK2_END;
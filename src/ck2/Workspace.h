@@ -0,0 +1,115 @@
+#ifndef LIBCK2_WORKSPACE_H
+#define LIBCK2_WORKSPACE_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "bulk_load.h"
+#include "parser.h"
+#include "VFS.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+/* WORKSPACE -- the parse trees of every file matching a set of VFS glob patterns, kept up to date incrementally
+ *
+ * the workspace remembers each file's size, modification stamp & content hash along with its tree. refresh()
+ * first refreshes the VFS index, which re-lists only the directories whose stamps moved & recomputes the winners of
+ * only the paths added or removed there (see VFS::refresh), and then:
+ *   - reuses a tree outright if its virtual path's winner is the same file with the same size & stamp
+ *   - otherwise reads & hashes the file, and reuses its previous tree anyway if the content didn't change
+ *   - shares the tree of any other file with identical content (e.g., the same file copied into several mods),
+ *     as found by hash & then compared byte for byte. each file still gets a parser of its own, so that its
+ *     path names that file.
+ *   - parses whatever remains, concurrently & largest-first (as bulk_load does)
+ *
+ * a file which fails to load isn't retried until its size or stamp changes, but its error is reported by every
+ * refresh until then.
+ *
+ * as with most build tools, a file rewritten with the same size within the filesystem's timestamp granularity
+ * of the last refresh isn't noticed until its stamp moves again.
+ *
+ * the trees are published as an immutable map which refresh() replaces wholesale, so readers on other threads
+ * always see a consistent set. refresh() itself must not be called concurrently with itself.
+ *
+ * the trees themselves must not be mutated either: they're shared by readers, by successive maps & among files with
+ * identical content, and only their roots are const (nested blocks & lists are still reachable through object's
+ * accessors). to edit a file's tree (e.g., to rewrite() it), parse the file into a parser of your own.
+ */
+
+class Workspace {
+public:
+  struct entry {
+    fs::path  path;  // of the winning file (see VFS::file)
+    uintmax_t size;
+    uint64_t  stamp; // modification time (files on disk) or CRC-32 (archive entries)
+    uint64_t  hash;  // of the content
+    std::shared_ptr<const parser> p_parser; // its tree is shared among files with identical content
+  };
+
+  using tree_map = std::map<std::string, entry>; // by virtual path (as spelled in the winning root)
+
+  struct refresh_result {
+    std::vector<std::string> changed; // virtual paths added, removed, or whose tree was replaced (sorted)
+    std::vector<load_error>  errors;  // files which failed to load (which are absent from the new trees)
+    size_t n_parsed = 0;
+    size_t n_reused = 0; // files whose content didn't change
+    size_t n_shared = 0; // files w/ new content identical to that of another file, so parsed once between them
+  };
+
+  // nothing is loaded until the first refresh(). n_threads = 0 means one per hardware thread.
+  Workspace(VFS vfs, std::vector<std::string> globs, uint n_threads = 0)
+  : _vfs(std::move(vfs)), _globs(std::move(globs)), _n_threads(n_threads),
+    _p_trees(std::make_shared<tree_map>()) {}
+
+  // the root stack may be changed (e.g., mods pushed) between refreshes
+  VFS&       vfs()       noexcept { return _vfs; }
+  const VFS& vfs() const noexcept { return _vfs; }
+
+  const auto& globs() const noexcept { return _globs; }
+
+  refresh_result refresh();
+
+  // the current trees
+  std::shared_ptr<const tree_map> trees() const
+  {
+    std::lock_guard<std::mutex> lk(_trees_mtx);
+    return _p_trees;
+  }
+
+  // the current tree of a virtual path (matched case-insensitively if it isn't spelled as in its root), or
+  // nullptr if it isn't loaded
+  std::shared_ptr<const parser> find(std::string_view virt_path) const;
+
+private:
+  struct failure {
+    fs::path    path;
+    uintmax_t   size;
+    uint64_t    stamp;
+    std::string what;
+  };
+
+  void publish(std::shared_ptr<const tree_map> p)
+  {
+    std::lock_guard<std::mutex> lk(_trees_mtx);
+    _p_trees = std::move(p);
+  }
+
+  VFS                      _vfs;
+  std::vector<std::string> _globs;
+  uint                     _n_threads;
+  std::shared_ptr<const tree_map> _p_trees;
+  mutable std::mutex       _trees_mtx;
+  std::unordered_map<std::string, failure>  _failed;  // files which failed to load, by virtual path
+};
+
+
+NAMESPACE_CK2_END;
+#endif
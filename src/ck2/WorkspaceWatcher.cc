@@ -0,0 +1,290 @@
+
+#include "WorkspaceWatcher.h"
+
+#ifdef __linux__
+
+#include "strutil.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+
+NAMESPACE_CK2;
+
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+
+// the case-folded virtual path of an entry in a virtual directory
+static std::string virt_child(const std::string& virt_dir, std::string_view name)
+{
+  auto folded = strutil::ascii_lower(name);
+  return (virt_dir.empty()) ? folded : virt_dir + '/' + folded;
+}
+
+
+WorkspaceWatcher::WorkspaceWatcher(Workspace& ws, std::chrono::milliseconds debounce)
+: _ws(ws), _debounce(debounce), _in_fd(-1), _stop_fd(-1), _next_sub_id(0)
+{
+  if ((_in_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    throw Error("Failed to initialize inotify: {}", strerror(errno));
+
+  if ((_stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+  {
+    const int e = errno;
+    close(_in_fd);
+    throw Error("Failed to create eventfd: {}", strerror(e));
+  }
+
+  for (const auto& g : _ws.globs())
+    _folded_globs.push_back(strutil::ascii_lower(fs::path(g).lexically_normal().generic_string()));
+
+  try
+  {
+    for (const auto& root : _ws.vfs().dir_root_paths())
+      watch_tree(root, "");
+  }
+  catch (...)
+  {
+    close(_stop_fd);
+    close(_in_fd);
+    throw;
+  }
+
+  _thread = std::thread([this]() { run(); });
+}
+
+
+WorkspaceWatcher::~WorkspaceWatcher() noexcept
+{
+  const uint64_t one = 1;
+  [[maybe_unused]] auto n = write(_stop_fd, &one, sizeof(one));
+
+  _thread.join();
+  close(_stop_fd);
+  close(_in_fd);
+}
+
+
+size_t WorkspaceWatcher::subscribe(subscriber fn)
+{
+  std::lock_guard<std::mutex> lk(_subs_mtx);
+  _subs.emplace(_next_sub_id, std::move(fn));
+  return _next_sub_id++;
+}
+
+
+void WorkspaceWatcher::unsubscribe(size_t id)
+{
+  std::lock_guard<std::mutex> lk(_subs_mtx);
+  _subs.erase(id);
+}
+
+
+void WorkspaceWatcher::watch_tree(const fs::path& dir, const std::string& virt_dir)
+{
+  const int wd = inotify_add_watch(_in_fd, dir.generic_string().c_str(), WATCH_MASK);
+
+  if (wd < 0)
+  {
+    if (errno == ENOENT || errno == ENOTDIR) // raced with its removal
+      return;
+
+    throw PathError(fmt::format("Failed to watch directory: {}", strerror(errno)), dir);
+  }
+
+  // inotify gives a directory that's already watched its existing descriptor, so a directory reached again (e.g.,
+  // via a symlink back up the tree) is neither renamed nor descended into a second time
+  if (!_watches.emplace(wd, watch{ dir, virt_dir }).second)
+    return;
+
+  std::error_code ec;
+
+  for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+    if (it->is_directory(ec))
+      watch_tree(it->path(), virt_child(virt_dir, it->path().filename().generic_string()));
+}
+
+
+bool WorkspaceWatcher::matches_glob(std::string_view virt_path) const noexcept
+{
+  for (const auto& g : _folded_globs)
+    if (strutil::glob_match(g, virt_path, '/'))
+      return true;
+
+  return false;
+}
+
+
+bool WorkspaceWatcher::drain_events()
+{
+  alignas(inotify_event) char buf[16 * 1024];
+  bool relevant = false;
+
+  while (true)
+  {
+    const ssize_t n = read(_in_fd, buf, sizeof(buf));
+
+    if (n <= 0) // EAGAIN: nothing more for now
+      break;
+
+    for (const char* p = buf; p < buf + n;)
+    {
+      const auto p_ev = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + p_ev->len;
+
+      if (p_ev->mask & IN_Q_OVERFLOW) // events were lost, so the refresh's own checks must do
+      {
+        relevant = true;
+        continue;
+      }
+
+      if (p_ev->mask & IN_IGNORED) // watch removed (its directory was deleted or moved away)
+      {
+        _watches.erase(p_ev->wd);
+        continue;
+      }
+
+      auto i = _watches.find(p_ev->wd);
+
+      if (i == _watches.end())
+        continue;
+
+      if (p_ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) // (its parent gets an event for it as well)
+      {
+        relevant = true;
+        continue;
+      }
+
+      if (p_ev->len == 0)
+        continue;
+
+      const auto virt_path = virt_child(i->second.virt_dir, p_ev->name);
+
+      if (p_ev->mask & IN_ISDIR) // a directory appeared or vanished, along with whatever files it holds
+      {
+        if (p_ev->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+          // (copy the watch's path first, as watching the new tree may rehash _watches)
+          const auto dir = i->second.dir / p_ev->name;
+
+          // (if it can't be watched, e.g., for lack of watches, the refresh still picks up its current files)
+          try { watch_tree(dir, virt_path); }
+          catch (const std::exception&) {}
+        }
+
+        relevant = true;
+      }
+      else if (matches_glob(virt_path))
+        relevant = true;
+    }
+  }
+
+  return relevant;
+}
+
+
+static bool same_errors(const std::vector<load_error>& a, const std::vector<load_error>& b)
+{
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y)
+  {
+    return x.virt_path == y.virt_path && x.what == y.what;
+  });
+}
+
+
+void WorkspaceWatcher::notify(const Workspace::refresh_result& res)
+{
+  if (res.changed.empty() && same_errors(res.errors, _last_errors))
+    return;
+
+  _last_errors = res.errors;
+
+  std::lock_guard<std::mutex> lk(_subs_mtx);
+
+  for (auto& [id, fn] : _subs)
+  {
+    try { fn(res); }
+    catch (...) {} // a subscriber's failure is its own business
+  }
+}
+
+
+void WorkspaceWatcher::run() noexcept
+{
+  using clock = std::chrono::steady_clock;
+
+  pollfd fds[2] = { { _stop_fd, POLLIN, 0 }, { _in_fd, POLLIN, 0 } };
+  bool dirty = false;
+  auto delay = _debounce; // until the next refresh attempt, while dirty (longer while refreshes keep failing)
+  auto deadline = clock::now(); // of the next refresh attempt, while dirty
+
+  while (true)
+  {
+    // while dirty, wait until the delay has passed since the last relevant event (unrelated events, such as an
+    // editor's swap files, mustn't postpone the refresh)
+    int timeout = -1;
+
+    if (dirty)
+    {
+      const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now());
+      timeout = static_cast<int>(std::max(left.count(), decltype(left.count())(0)));
+    }
+
+    const int n = poll(fds, 2, timeout);
+
+    if (n < 0)
+    {
+      if (errno == EINTR) continue;
+      return;
+    }
+
+    if (fds[0].revents)
+      return;
+
+    if (n > 0)
+    {
+      if (drain_events())
+      {
+        dirty = true;
+        deadline = clock::now() + delay;
+      }
+
+      if (!dirty || clock::now() < deadline)
+        continue;
+    }
+
+    Workspace::refresh_result res;
+
+    try
+    {
+      res = _ws.refresh();
+    }
+    catch (const std::exception& e) // e.g., a directory vanished mid-scan. stay dirty & retry after a while.
+    {
+      delay = std::min(std::max(delay * 2, std::chrono::milliseconds(1)), MAX_RETRY_DELAY);
+      deadline = clock::now() + delay;
+
+      Workspace::refresh_result failed;
+      failed.errors.push_back(load_error{ "", fs::path(), fmt::format("Failed to refresh workspace: {}",
+                                                                     e.what()) });
+      notify(failed);
+      continue;
+    }
+
+    dirty = false;
+    delay = _debounce;
+    notify(res);
+  }
+}
+
+
+NAMESPACE_CK2_END;
+
+#endif // __linux__
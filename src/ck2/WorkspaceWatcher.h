@@ -0,0 +1,91 @@
+#ifndef LIBCK2_WORKSPACE_WATCHER_H
+#define LIBCK2_WORKSPACE_WATCHER_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "Workspace.h"
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+#ifdef __linux__
+
+/* WORKSPACE_WATCHER -- keep a Workspace live by watching its VFS's directory roots with inotify (Linux-only)
+ *
+ * a background thread collects filesystem events under every directory root (incl. subdirectories created
+ * later), waits until the relevant ones have been quiet for the debounce interval (editors tend to save in bursts:
+ * temp file, rename, chmod), and then refreshes the workspace. events for files which no glob matches (e.g., an
+ * editor's backup & swap files) are ignored & don't postpone a pending refresh, but any event for a directory
+ * counts, as it may hold matching files.
+ *
+ * the refresh re-resolves overrides, so adding or deleting a file in a higher-priority mod switches its virtual
+ * path to the right winner, and it only re-parses files which actually changed. the new trees are swapped in
+ * atomically (see Workspace::trees), after which subscribers are called on the watcher thread with the
+ * refresh's result, provided that any trees or load errors changed.
+ *
+ * if a refresh fails outright (e.g., a directory vanished mid-scan), subscribers are called with a result that
+ * has no changes and a single error whose virtual path is empty, and the refresh is retried, backing off from
+ * the debounce interval up to MAX_RETRY_DELAY while it keeps failing.
+ *
+ * zip archive roots are mapped when they're mounted and so aren't watched. while the watcher runs, it owns the
+ * workspace's refreshes: don't refresh it, change its VFS, or use its VFS from other threads (use trees() and
+ * find() instead).
+ */
+
+class WorkspaceWatcher {
+public:
+  using subscriber = std::function<void(const Workspace::refresh_result&)>;
+
+  // starts watching immediately. the workspace must outlive the watcher.
+  WorkspaceWatcher(Workspace&, std::chrono::milliseconds debounce = std::chrono::milliseconds(30));
+  ~WorkspaceWatcher() noexcept;
+
+  WorkspaceWatcher(const WorkspaceWatcher&) = delete;
+  WorkspaceWatcher& operator=(const WorkspaceWatcher&) = delete;
+
+  static constexpr std::chrono::milliseconds MAX_RETRY_DELAY = std::chrono::milliseconds(5000);
+
+  // returns an ID for unsubscribe()
+  size_t subscribe(subscriber);
+  void   unsubscribe(size_t id);
+
+private:
+  struct watch {
+    fs::path    dir;
+    std::string virt_dir; // relative to its root, case-folded ("" for the root itself)
+  };
+
+  void run() noexcept;
+  void watch_tree(const fs::path& dir, const std::string& virt_dir);
+  bool matches_glob(std::string_view virt_path) const noexcept;
+  bool drain_events(); // returns true if any event concerned the workspace's files or their directories
+  void notify(const Workspace::refresh_result&);
+
+  Workspace&                _ws;
+  std::chrono::milliseconds _debounce;
+  int                       _in_fd;   // inotify instance
+  int                       _stop_fd; // eventfd signaled upon destruction
+  std::vector<std::string>  _folded_globs;
+  std::unordered_map<int, watch> _watches; // by watch descriptor
+  std::vector<load_error>           _last_errors;
+  std::mutex                     _subs_mtx;
+  std::map<size_t, subscriber>   _subs;
+  size_t                         _next_sub_id;
+  std::thread                    _thread;
+};
+
+#endif // __linux__
+
+
+NAMESPACE_CK2_END;
+#endif
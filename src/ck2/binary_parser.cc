@@ -0,0 +1,486 @@
+
+#include "binary_parser.h"
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+NAMESPACE_CK2;
+
+
+static const char BINARY_MAGIC[] = "CK2bin";
+static const size_t BINARY_MAGIC_LEN = sizeof(BINARY_MAGIC) - 1;
+
+
+/* binary date encoding: hours since 1.1.-5000, with every year 365 days long */
+
+static const uint DAYS_BEFORE_MONTH[13] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 };
+
+static int32_t encode_binary_date(date d) noexcept
+{
+  const int32_t days = (d.year() + 5000) * 365 + DAYS_BEFORE_MONTH[d.month() - 1] + d.day() - 1;
+  return days * 24;
+}
+
+// the least I32 key decoded as a date (1.1.1) when binary_options::date_keys is set
+static const int32_t MIN_DATE_KEY = (1 + 5000) * 365 * 24;
+
+static date decode_binary_date(int32_t hours) noexcept
+{
+  const int32_t days = hours / 24;
+  const int32_t doy = days % 365;
+  uint m = 1;
+
+  while (doy >= static_cast<int32_t>(DAYS_BEFORE_MONTH[m])) ++m;
+
+  return date(days / 365 - 5000, m, doy - DAYS_BEFORE_MONTH[m - 1] + 1);
+}
+
+
+/* BINARY_TOKEN_TABLE */
+
+binary_token_table::binary_token_table(const fs::path& path)
+{
+  auto spath = path.generic_string();
+  unique_file_ptr ufp( std::fopen(spath.c_str(), "rb"), std::fclose );
+  FILE* f = ufp.get();
+
+  if (f == nullptr)
+    throw Error("Failed to open file: {}: {}", strerror(errno), spath);
+
+  char buf[512];
+  uint n_line = 0;
+
+  auto floc = [&]() { return FLoc(path, n_line); };
+  auto flerr = FLErrorFactory(floc);
+
+  while (fgets(&buf[0], sizeof(buf), f) != nullptr)
+  {
+    ++n_line;
+
+    char* p = &buf[0];
+    while (*p == ' ' || *p == '\t') ++p;
+
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+    char* p_end;
+    errno = 0;
+    const unsigned long code = std::strtoul(p, &p_end, 0);
+
+    if (p_end == p || errno || code == 0 || code > UINT16_MAX)
+      throw flerr("Invalid token code (expected an integer in [1, 0xFFFF])");
+
+    p = p_end;
+    while (*p == ' ' || *p == '\t') ++p;
+
+    std::string_view name(p);
+    while (!name.empty() && (name.back() == '\n' || name.back() == '\r' || name.back() == ' ' || name.back() == '\t'))
+      name.remove_suffix(1);
+
+    if (name.empty())
+      throw flerr("Missing name for token code {:#06x}", code);
+
+    try {
+      add(static_cast<uint16_t>(code), name);
+    }
+    catch (const Error& e) {
+      throw FLError(floc(), e.what());
+    }
+  }
+}
+
+
+void binary_token_table::add(uint16_t code, std::string_view name)
+{
+  if (code == 0 || binary_code::is_reserved(code))
+    throw Error("Token code {:#06x} is reserved and cannot be mapped to a name ('{}')", code, name);
+
+  if (auto p_old = this->name(code)) {
+    if (name != p_old)
+      throw Error("Token code {:#06x} is mapped to both '{}' and '{}'", code, p_old, name);
+    return;
+  }
+
+  auto [i, inserted] = _names.emplace(code, std::string(name));
+  _codes.emplace(i->second, code); // if the name has multiple codes, the first is used for encoding
+}
+
+
+/* BINARY_PARSER */
+
+class binary_parser::reader {
+  const uint8_t* const _begin;
+  const uint8_t* const _end;
+  const uint8_t*       _p;
+  const fs::path&      _path;
+  const binary_token_table& _tt;
+  const std::unordered_set<std::string>& _date_fields;
+  const bool _date_keys;
+  std::unordered_set<uint16_t> _date_codes; // token codes of the date fields which have them
+  std::string _str; // NUL-terminated copy of the most recently read string payload
+
+public:
+  reader(std::string_view data, const fs::path& path, const binary_token_table& tt, const binary_options& opt)
+  : _begin(reinterpret_cast<const uint8_t*>(data.data()))
+  , _end(_begin + data.size())
+  , _p(_begin)
+  , _path(path)
+  , _tt(tt)
+  , _date_fields(opt.date_fields)
+  , _date_keys(opt.date_keys)
+  {
+    for (const auto& name : _date_fields)
+      if (auto code = _tt.code(name))
+        _date_codes.insert(code);
+
+    if (is_binary(data))
+      _p += BINARY_MAGIC_LEN;
+  }
+
+  void read_root(block& root) { read_block(root, true); }
+
+private:
+  template<typename... Args>
+  FLError err(const uint8_t* p, std::string_view format, const Args& ...args) const
+  {
+    return FLError(FLoc(_path), fmt::format("Binary data offset {:#x}: ", p - _begin) +
+                                fmt::vformat(format, fmt::make_format_args(args...)));
+  }
+
+  void need(const uint8_t* p, size_t n) const
+  {
+    if (static_cast<size_t>(_end - p) < n)
+      throw err(p, "Unexpected end of data");
+  }
+
+  static uint16_t u16_at(const uint8_t* p) noexcept { return uint16_t(p[0] | (p[1] << 8)); }
+  static uint32_t u32_at(const uint8_t* p) noexcept
+  {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+  }
+
+  uint16_t next_code()
+  {
+    need(_p, 2);
+    auto c = u16_at(_p);
+    _p += 2;
+    return c;
+  }
+
+  uint16_t peek_code(const uint8_t* p) const
+  {
+    need(p, 2);
+    return u16_at(p);
+  }
+
+  // size of the payload which follows a token code at p (which points just past the code)
+  size_t payload_size(uint16_t code, const uint8_t* p) const
+  {
+    switch (code) {
+      case binary_code::I32:
+      case binary_code::F32:
+      case binary_code::U32:  return 4;
+      case binary_code::BOOL: return 1;
+      case binary_code::QSTR:
+      case binary_code::STR:  need(p, 2); return 2 + u16_at(p);
+      default:                return 0;
+    }
+  }
+
+  uint32_t read_u32() { need(_p, 4); auto v = u32_at(_p); _p += 4; return v; }
+
+  const char* read_str()
+  {
+    need(_p, 2);
+    const size_t len = u16_at(_p);
+    need(_p + 2, len);
+    _str.assign(reinterpret_cast<const char*>(_p + 2), len);
+    _p += 2 + len;
+    return _str.c_str();
+  }
+
+  const char* token_name(uint16_t code, const uint8_t* p_code) const
+  {
+    auto name = _tt.name(code);
+
+    if (name == nullptr)
+      throw err(p_code, "Unknown token code {:#06x} (not in token table)", code);
+
+    return name;
+  }
+
+  object read_key(uint16_t code, const uint8_t* p_code)
+  {
+    switch (code) {
+      case binary_code::QSTR:
+      case binary_code::STR:   return object{ read_str() };
+      case binary_code::U32:   return object{ static_cast<int>(read_u32()) };
+      case binary_code::I32:
+      {
+        const auto i = static_cast<int32_t>(read_u32());
+        return (_date_keys && i >= MIN_DATE_KEY) ? object{ decode_binary_date(i) } : object{ i };
+      }
+      case binary_code::EQUAL:
+      case binary_code::OPEN:
+      case binary_code::CLOSE:
+      case binary_code::F32:
+      case binary_code::BOOL:  throw err(p_code, "Unexpected token code {:#06x} in key position", code);
+      default:                 return object{ token_name(code, p_code) };
+    }
+  }
+
+  object read_value(uint16_t code, const uint8_t* p_code, bool is_date)
+  {
+    switch (code) {
+      case binary_code::OPEN:  return read_compound();
+      case binary_code::QSTR:
+      case binary_code::STR:   return object{ read_str() };
+      case binary_code::U32:   return object{ static_cast<int>(read_u32()) };
+      case binary_code::F32:   return object{ fp3::from_raw(static_cast<int32_t>(read_u32())) };
+      case binary_code::BOOL:  need(_p, 1); return object{ (*_p++) ? "yes" : "no" };
+      case binary_code::I32:
+      {
+        const auto i = static_cast<int32_t>(read_u32());
+        return (is_date && i >= 0) ? object{ decode_binary_date(i) } : object{ i };
+      }
+      case binary_code::EQUAL:
+      case binary_code::CLOSE: throw err(p_code, "Unexpected token code {:#06x} in value position", code);
+      default:                 return object{ token_name(code, p_code) };
+    }
+  }
+
+  bool is_date_field(uint16_t key_code, const object& key) const
+  {
+    if (_date_fields.empty()) return false;
+    if (!binary_code::is_reserved(key_code)) return _date_codes.count(key_code) != 0;
+    return key.is_string() && _date_fields.count(key.as_string()) != 0;
+  }
+
+  void read_block(block& blk, bool is_root)
+  {
+    while (true)
+    {
+      if (_p == _end)
+      {
+        if (is_root) return;
+        throw err(_p, "Unexpected end of data (unclosed block)");
+      }
+
+      const auto p_key = _p;
+      const auto key_code = next_code();
+
+      if (key_code == binary_code::CLOSE)
+      {
+        if (is_root) // closing braces are only bad at root level
+          throw err(p_key, "Unmatched closing brace");
+        return;
+      }
+
+      auto key = read_key(key_code, p_key);
+
+      if (const auto p_op = _p; next_code() != binary_code::EQUAL)
+        throw err(p_op, "Expected EQUAL token code after key");
+
+      const auto p_val = _p;
+      const auto val_code = next_code();
+      auto val = read_value(val_code, p_val, is_date_field(key_code, key));
+
+      blk.push_back(statement{ std::move(key), std::move(val) });
+    }
+  }
+
+  // read a block or list whose OPEN code has just been consumed, deciding which by the same lookahead rule as the
+  // text parser (an EQUAL code after the first element means it's a block)
+  object read_compound()
+  {
+    const auto c1 = peek_code(_p);
+
+    if (c1 == binary_code::CLOSE) // empty block (or list, but we choose to see it as a block)
+    {
+      _p += 2;
+      return object{ std::make_shared<block>() };
+    }
+
+    bool is_list = (c1 == binary_code::OPEN);
+
+    if (!is_list)
+    {
+      const auto p2 = _p + 2 + payload_size(c1, _p + 2);
+      is_list = (peek_code(p2) != binary_code::EQUAL);
+    }
+
+    if (is_list)
+    {
+      auto p_list = std::make_shared<list>();
+      read_list(*p_list);
+      return object{ std::move(p_list) };
+    }
+
+    auto p_blk = std::make_shared<block>();
+    read_block(*p_blk, false);
+    return object{ std::move(p_blk) };
+  }
+
+  void read_list(list& l)
+  {
+    while (true)
+    {
+      const auto p_elem = _p;
+      const auto code = next_code();
+
+      if (code == binary_code::CLOSE)
+        return;
+
+      if (code == binary_code::OPEN)
+      {
+        auto p_blk = std::make_shared<block>();
+        read_block(*p_blk, false);
+        l.push_back(object{ std::move(p_blk) });
+      }
+      else
+        l.push_back(read_value(code, p_elem, false));
+    }
+  }
+};
+
+
+binary_parser::binary_parser(std::string_view data, const fs::path& path, const binary_token_table& tt,
+                             const binary_options& opt)
+: _p_root(std::make_shared<block>())
+, _path(path)
+{
+  reader(data, _path, tt, opt).read_root(*_p_root);
+}
+
+
+binary_parser::binary_parser(const fs::path& path, const binary_token_table& tt, const binary_options& opt)
+: _p_root(std::make_shared<block>())
+, _path(path)
+{
+  mapped_file mf(path);
+  reader(mf.chars(), _path, tt, opt).read_root(*_p_root);
+}
+
+
+bool binary_parser::is_binary(std::string_view data) noexcept
+{
+  return data.substr(0, BINARY_MAGIC_LEN) == BINARY_MAGIC;
+}
+
+
+/* BINARY ENCODING */
+
+namespace {
+
+class binary_writer {
+  std::string& _out;
+  const binary_token_table& _tt;
+
+public:
+  binary_writer(std::string& out, const binary_token_table& tt) : _out(out), _tt(tt) {}
+
+  void code(uint16_t c)
+  {
+    _out.push_back(static_cast<char>(c & 0xFF));
+    _out.push_back(static_cast<char>(c >> 8));
+  }
+
+  void scalar32(uint16_t c, uint32_t v)
+  {
+    code(c);
+    for (uint i = 0; i < 4; ++i, v >>= 8)
+      _out.push_back(static_cast<char>(v & 0xFF));
+  }
+
+  void str(uint16_t c, std::string_view s)
+  {
+    if (s.size() > UINT16_MAX)
+      throw Error("String too long for binary encoding ({} bytes)", s.size());
+
+    code(c);
+    code(static_cast<uint16_t>(s.size()));
+    _out.append(s);
+  }
+
+  void key(const object& k)
+  {
+    if (k.is_string()) {
+      if (auto c = _tt.code(k.as_string_view())) code(c);
+      else str(binary_code::STR, k.as_string_view());
+    }
+    else if (k.is_integer())
+      scalar32(binary_code::I32, static_cast<uint32_t>(k.as_integer()));
+    else if (k.is_date())
+      scalar32(binary_code::I32, static_cast<uint32_t>(encode_binary_date(k.as_date())));
+    else
+      throw Error("Cannot binary-encode a {}-type statement key", k.type_string());
+  }
+
+  void value(const object& v)
+  {
+    switch (v._type) {
+      case object::INTEGER: scalar32(binary_code::I32, static_cast<uint32_t>(v.as_integer())); break;
+      case object::DATE:    scalar32(binary_code::I32, static_cast<uint32_t>(encode_binary_date(v.as_date()))); break;
+      case object::DECIMAL: scalar32(binary_code::F32, static_cast<uint32_t>(v.as_decimal().raw())); break;
+      case object::STRING:
+        if (auto c = _tt.code(v.as_string_view())) code(c);
+        else str(binary_code::QSTR, v.as_string_view());
+        break;
+      case object::BLOCK:
+        code(binary_code::OPEN);
+        body(*v.as_block());
+        code(binary_code::CLOSE);
+        break;
+      case object::LIST:
+        code(binary_code::OPEN);
+        for (const auto& e : *v.as_list()) value(e);
+        code(binary_code::CLOSE);
+        break;
+      default:
+        throw Error("Cannot binary-encode a {}-type value", v.type_string());
+    }
+  }
+
+  void body(const block& b)
+  {
+    for (const auto& s : b)
+    {
+      if (s.op().as_binary_op() != binary_op::EQ)
+        throw Error("Cannot binary-encode operator '{}' (only '=' is supported)", to_string(s.op().as_binary_op()));
+
+      key(s.key());
+      code(binary_code::EQUAL);
+      value(s.value());
+    }
+  }
+};
+
+}
+
+
+void write_binary(std::string& out, const block& root, const binary_token_table& tt, bool with_magic)
+{
+  if (with_magic)
+    out.append(BINARY_MAGIC, BINARY_MAGIC_LEN);
+
+  binary_writer(out, tt).body(root);
+}
+
+
+void write_binary(const fs::path& out_path, const block& root, const binary_token_table& tt, bool with_magic)
+{
+  std::string buf;
+  write_binary(buf, root, tt, with_magic);
+
+  write_file_atomic(out_path, [&](std::FILE* f) {
+    if (std::fwrite(buf.data(), 1, buf.size(), f) != buf.size())
+      throw PathError("Failed to write binary file", out_path);
+  });
+}
+
+
+NAMESPACE_CK2_END;
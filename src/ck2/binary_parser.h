@@ -0,0 +1,140 @@
+#ifndef LIBCK2_BINARY_PARSER_H
+#define LIBCK2_BINARY_PARSER_H
+
+#include "common.h"
+#include "FileLocation.h"
+#include "filesystem.h"
+#include "parser.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+/* BINARY FORMAT -- Paradox's binary-token encoding of PDX script, as found in ironman/binary savegames
+ *
+ * a binary file is an optional 6-byte "CK2bin" magic followed by a stream of little-endian 16-bit token codes. a
+ * handful of codes are reserved for syntax & scalar types (below), and a scalar's code is followed by its payload.
+ * every other code names a string (mostly keys, but also enumerated values like culture names), and the mapping of
+ * those codes to names is game-version-specific and not included in the file, so it has to be supplied by the user
+ * as a binary_token_table.
+ *
+ * the format doesn't distinguish dates from integers: dates are stored as integers counting the hours since
+ * 1.1.-5000 (in 365-day years). binary_options::date_fields names the keys whose integer values are to be decoded as
+ * dates, and integer keys are decoded as dates by their range (see binary_options::date_keys).
+ */
+
+namespace binary_code {
+  enum : uint16_t {
+    EQUAL   = 0x0001,
+    OPEN    = 0x0003,
+    CLOSE   = 0x0004,
+    I32     = 0x000C, // int32
+    F32     = 0x000D, // int32 fixed-point decimal in thousandths
+    BOOL    = 0x000E, // uint8
+    QSTR    = 0x000F, // uint16 length + chars (quoted string)
+    U32     = 0x0014, // uint32
+    STR     = 0x0017, // uint16 length + chars (unquoted string)
+  };
+
+  constexpr bool is_reserved(uint16_t c) noexcept
+  {
+    return c == EQUAL || c == OPEN || c == CLOSE || c == I32 || c == F32 || c == BOOL || c == QSTR || c == U32 ||
+           c == STR;
+  }
+}
+
+
+/* BINARY_TOKEN_TABLE -- bidirectional mapping of (non-reserved) token codes to names */
+
+class binary_token_table {
+public:
+  binary_token_table() = default;
+
+  // load from a text file of lines of the form "<code> <name>", where the code is decimal or 0x-prefixed hex.
+  // blank lines and lines beginning with '#' are ignored.
+  binary_token_table(const fs::path&);
+
+  // throws if the code is reserved or is already mapped to a different name
+  void add(uint16_t code, std::string_view name);
+
+  // name of the token code, or nullptr if it's unmapped
+  const char* name(uint16_t code) const noexcept
+  {
+    auto i = _names.find(code);
+    return (i != _names.end()) ? i->second.c_str() : nullptr;
+  }
+
+  // code of the token name, or 0 if it isn't mapped (0 isn't a valid token code)
+  uint16_t code(std::string_view name) const noexcept
+  {
+    auto i = _codes.find(name);
+    return (i != _codes.end()) ? i->second : 0;
+  }
+
+  auto size()  const noexcept { return _names.size(); }
+  auto empty() const noexcept { return _names.empty(); }
+
+private:
+  std::unordered_map<uint16_t, std::string> _names;
+  std::unordered_map<std::string_view, uint16_t> _codes; // keys point into _names' values (node-based, so stable)
+};
+
+
+struct binary_options {
+  std::unordered_set<std::string> date_fields; // keys whose integer values are binary-encoded dates
+
+  // decode integer keys as dates when they encode a date of at least 1.1.1 (i.e., are at least 43808760, far
+  // beyond any ID used as a key), as in history blocks. clear this to read every integer key as an integer.
+  bool date_keys = true;
+};
+
+
+/* BINARY_PARSER -- construct a parse tree from a binary-token file, producing the same block/list/object trees as
+ * the text parser (sans source locations & spans, which are unavailable, so round-trip writing doesn't apply).
+ *
+ * being a simple walk over pre-tokenized input, this is much faster than lexing the equivalent text. */
+
+class binary_parser {
+public:
+  binary_parser(const fs::path& path, const binary_token_table&, const binary_options& = binary_options());
+
+  // parse an in-memory image (e.g., as decompressed from an archive), attributing errors to `path`
+  binary_parser(std::string_view data, const fs::path& path, const binary_token_table&,
+                const binary_options& = binary_options());
+
+  auto& root_block() noexcept { return _p_root; }
+  std::shared_ptr<const block> root_block() const noexcept { return _p_root; }
+
+  const auto& path() const noexcept { return _path; }
+
+  // is the data in the buffer binary-token-encoded? (i.e., does it begin with the "CK2bin" magic?)
+  static bool is_binary(std::string_view data) noexcept;
+
+private:
+  class reader;
+
+  std::shared_ptr<block> _p_root;
+  fs::path _path;
+};
+
+
+/* BINARY ENCODING -- the inverse of binary_parser
+ *
+ * string keys & values that have a token code are written as that code, and other strings as STR (keys) or QSTR
+ * (values) tokens. dates are written in the binary date encoding, so to read date values back as dates, list their
+ * keys in binary_options::date_fields (date keys are read back as dates by default). the binary format has no
+ * representation of operators other than '=', so an Error is thrown if the tree contains one.
+ */
+
+void write_binary(std::string& out, const block& root, const binary_token_table&, bool with_magic = true);
+void write_binary(const fs::path& out_path, const block& root, const binary_token_table&, bool with_magic = true);
+
+
+NAMESPACE_CK2_END;
+#endif
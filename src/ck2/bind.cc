@@ -0,0 +1,44 @@
+
+#include "bind.h"
+
+
+NAMESPACE_CK2;
+
+
+void bind_reader::next(token& t, bool eof_ok)
+{
+  _lex.read_token_into(t); // zerocopy: the text stays in the scanner's buffer until the next read
+
+  if (t.type() == token::END && !eof_ok)
+    throw err(t.loc(), "Unexpected EOF");
+
+  if (t.type() == token::FAIL)
+    throw err(t.loc(), "Unrecognized token");
+}
+
+
+void bind_reader::skip_value(token& t)
+{
+  if (t.type() == token::OPEN)
+  {
+    // whatever the braces contain (block, list, or a mix), it's skipped wholesale by matching them up
+    for (uint depth = 1; depth > 0;)
+    {
+      next(t);
+      if      (t.type() == token::OPEN)  ++depth;
+      else if (t.type() == token::CLOSE) --depth;
+    }
+  }
+  else if (t.type() != token::STR && t.type() != token::QSTR && t.type() != token::INTEGER &&
+           t.type() != token::DECIMAL && t.type() != token::DATE && t.type() != token::QDATE)
+    unexpected_token(t);
+}
+
+
+void bind_reader::unexpected_token(const token& t) const
+{
+  throw err(t.loc(), "Unexpected token type {}", t.type_name());
+}
+
+
+NAMESPACE_CK2_END;
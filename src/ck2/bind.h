@@ -0,0 +1,458 @@
+#ifndef LIBCK2_BIND_H
+#define LIBCK2_BIND_H
+
+#include "common.h"
+#include "FileLocation.h"
+#include "Location.h"
+#include "date.h"
+#include "filesystem.h"
+#include "fp_decimal.h"
+#include "keyword.h"
+#include "lexer.h"
+#include "token.h"
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+/* BINDING -- parse PDX script straight into C++ structs, per schemas declared at compile time
+ *
+ * a struct is made bindable by specializing bind_schema<T> with a constexpr tuple of its fields, each of which
+ * maps a key to a data member plus flags:
+ *
+ *   template<> struct bind_schema<my_struct> {
+ *     static constexpr auto fields = std::make_tuple(
+ *       bind_field{ "max_provinces", &my_struct::max_provinces, bind_flag::REQUIRED },
+ *       bind_field{ "sea_zones",     &my_struct::sea_zones,     bind_flag::REPEATED });
+ *   };
+ *
+ * the binder then fills the struct directly from the lexer's token stream: no parse tree is built, and the
+ * statements of unbound keys are skipped without being converted into anything. a member's type determines
+ * what's accepted:
+ *
+ *   integral types         integer (range-checked)
+ *   bool                   yes | no
+ *   std::string, fs::path  string (quoted or not)
+ *   date                   date (quoted or not)
+ *   fp_decimal<N>          decimal or integer
+ *   std::vector<T>         list of T, e.g. { 1 2 3 } (T may itself be a list or a bindable struct)
+ *   std::array<T, N>       list of exactly N T's
+ *   located<T>             T along with its source location, for the caller's own validation
+ *   bindable structs       block, recursively bound
+ *
+ * a REPEATED field's member must be a std::vector, to which each occurrence of its key appends a value.
+ * otherwise, as in a parse tree, the last occurrence of a key wins. type mismatches & missing REQUIRED keys
+ * throw an FLError which points at the offending token (or block).
+ */
+
+namespace bind_flag {
+  enum : uint {
+    OPTIONAL = 0,
+    REQUIRED = 1 << 0, // the key must occur at least once
+    REPEATED = 1 << 1, // the key may occur any number of times, each value appended to the (vector) member
+  };
+}
+
+
+template<typename S, typename M>
+struct bind_field {
+  std::string_view key;
+  M S::*           p_mem;
+  uint             flags;
+
+  constexpr bind_field(std::string_view key_, M S::* p_mem_, uint flags_ = bind_flag::OPTIONAL)
+  : key(key_), p_mem(p_mem_), flags(flags_) {}
+};
+
+
+// specialize with a `static constexpr auto fields = std::make_tuple(bind_field{ ... }, ...);` per bindable
+// struct
+template<typename T>
+struct bind_schema;
+
+
+// a bound value along with its location in the source
+template<typename T>
+struct located {
+  T   value;
+  Loc loc;
+};
+
+
+/* BIND_READER -- the token stream over which binding occurs, w/ the bits of the parser's syntax handling that
+ * the binder needs: reading tokens, skipping unbound values, and errors located in the input. */
+
+class bind_reader {
+public:
+  bind_reader(const fs::path& path) : _lex(path) {}
+  bind_reader(lexer_input& input, const fs::path& path) : _lex(input, path) {}
+
+  const auto& path() const noexcept { return _lex.path(); }
+
+  auto floc(const Location& loc) const noexcept { return FLoc(path(), loc); }
+  auto floc()                    const noexcept { return FLoc(path()); }
+
+  template<typename... Args>
+  auto err(const Location& loc, const char* format, Args&& ...args) const
+  {
+    return FLError(floc(loc), format, std::forward<Args>(args)...);
+  }
+
+  template<typename... Args>
+  auto err(const char* format, Args&& ...args) const
+  {
+    return FLError(floc(), format, std::forward<Args>(args)...);
+  }
+
+  // read the next token. its text is only valid until the next call.
+  void next(token& t, bool eof_ok = false);
+
+  // skip the rest of a statement's value, given its first token
+  void skip_value(token& t);
+
+  [[noreturn]] void unexpected_token(const token& t) const;
+
+private:
+  lexer _lex;
+};
+
+
+/* BIND_VALUE<T> -- conversion of a value, given its first token, into a member of type T. `key` is only used in
+ * error messages. */
+
+template<typename T, typename = void>
+struct bind_value;
+
+template<typename T, typename = void>
+struct is_bindable_struct : std::false_type {};
+
+template<typename T>
+struct is_bindable_struct<T, std::void_t<decltype(bind_schema<T>::fields)>> : std::true_type {};
+
+
+namespace bind_detail {
+  template<typename T>
+  [[noreturn]] void type_error(bind_reader& r, const token& t, std::string_view key)
+  {
+    throw r.err(t.loc(), "Invalid value type for '{}' (requires {})", key, bind_value<T>::DESC);
+  }
+
+  // bind the body of a block (just past its opening brace, or the whole file) into a bindable struct
+  template<typename T>
+  void bind_block(bind_reader&, T& out, const Location& open_loc, bool is_root);
+
+  // append a value to a vector. it's read into a local first, as std::vector<bool>::emplace_back() doesn't return
+  // a reference.
+  template<typename T>
+  void read_element(bind_reader& r, token& t, std::vector<T>& out, std::string_view key)
+  {
+    T v{};
+    bind_value<T>::read(r, t, v, key);
+    out.push_back(std::move(v));
+  }
+}
+
+
+template<typename T>
+struct bind_value<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+  static constexpr const char* DESC = "an integer";
+
+  static void read(bind_reader& r, token& t, T& out, std::string_view key)
+  {
+    if (t.type() != token::INTEGER) bind_detail::type_error<T>(r, t, key);
+
+    const long long v = std::strtoll(t.text(), nullptr, 10);
+
+    using lim = std::numeric_limits<T>;
+
+    if (v < static_cast<long long>(lim::min()) ||
+        (v > 0 && static_cast<unsigned long long>(v) > static_cast<unsigned long long>(lim::max())))
+      throw r.err(t.loc(), "Value {} for '{}' is out of range ({} to {})", v, key, +lim::min(), +lim::max());
+
+    out = static_cast<T>(v);
+  }
+};
+
+
+template<>
+struct bind_value<bool> {
+  static constexpr const char* DESC = "'yes' or 'no'";
+
+  static void read(bind_reader& r, token& t, bool& out, std::string_view key)
+  {
+    const auto kw = (t.type() == token::STR) ? t.kw() : keyword::NONE;
+
+    if      (kw == keyword::YES) out = true;
+    else if (kw == keyword::NO)  out = false;
+    else                 bind_detail::type_error<bool>(r, t, key);
+  }
+};
+
+
+template<>
+struct bind_value<std::string> {
+  static constexpr const char* DESC = "a string";
+
+  static void read(bind_reader& r, token& t, std::string& out, std::string_view key)
+  {
+    if (t.type() != token::STR && t.type() != token::QSTR) bind_detail::type_error<std::string>(r, t, key);
+    out.assign(t.text(), t.text_len());
+  }
+};
+
+
+template<>
+struct bind_value<fs::path> {
+  static constexpr const char* DESC = "a string";
+
+  static void read(bind_reader& r, token& t, fs::path& out, std::string_view key)
+  {
+    if (t.type() != token::STR && t.type() != token::QSTR) bind_detail::type_error<fs::path>(r, t, key);
+    out = std::string_view(t.text(), t.text_len());
+  }
+};
+
+
+template<>
+struct bind_value<date> {
+  static constexpr const char* DESC = "a date";
+
+  static void read(bind_reader& r, token& t, date& out, std::string_view key)
+  {
+    if (t.type() != token::DATE && t.type() != token::QDATE) bind_detail::type_error<date>(r, t, key);
+    out = date{ t.text() };
+  }
+};
+
+
+template<uint N>
+struct bind_value<fp_decimal<N>> {
+  static constexpr const char* DESC = "a number";
+
+  static void read(bind_reader& r, token& t, fp_decimal<N>& out, std::string_view key)
+  {
+    if      (t.type() == token::DECIMAL) out = fp_decimal<N>{ t.text() };
+    else if (t.type() == token::INTEGER) out = fp_decimal<N>{ atoi(t.text()) };
+    else                                 bind_detail::type_error<fp_decimal<N>>(r, t, key);
+  }
+};
+
+
+template<typename T>
+struct bind_value<located<T>> {
+  static constexpr const char* DESC = bind_value<T>::DESC;
+
+  static void read(bind_reader& r, token& t, located<T>& out, std::string_view key)
+  {
+    out.loc = t.loc();
+    bind_value<T>::read(r, t, out.value, key);
+  }
+};
+
+
+template<typename T>
+struct bind_value<std::vector<T>> {
+  static constexpr const char* DESC = "a list";
+
+  static void read(bind_reader& r, token& t, std::vector<T>& out, std::string_view key)
+  {
+    if (t.type() != token::OPEN) bind_detail::type_error<std::vector<T>>(r, t, key);
+
+    out.clear();
+
+    for (r.next(t); t.type() != token::CLOSE; r.next(t))
+      bind_detail::read_element(r, t, out, key);
+  }
+};
+
+
+template<typename T, size_t N>
+struct bind_value<std::array<T, N>> {
+  static constexpr const char* DESC = "a list";
+
+  static void read(bind_reader& r, token& t, std::array<T, N>& out, std::string_view key)
+  {
+    if (t.type() != token::OPEN) bind_detail::type_error<std::array<T, N>>(r, t, key);
+
+    const auto open_loc = t.loc();
+    size_t n = 0;
+
+    for (r.next(t); t.type() != token::CLOSE; r.next(t), ++n)
+    {
+      if (n == N) throw r.err(open_loc, "'{}' list has too many elements (requires exactly {})", key, N);
+      bind_value<T>::read(r, t, out[n], key);
+    }
+
+    if (n != N) throw r.err(open_loc, "'{}' list has too few elements (requires exactly {})", key, N);
+  }
+};
+
+
+template<typename T>
+struct bind_value<T, std::enable_if_t<is_bindable_struct<T>::value>> {
+  static constexpr const char* DESC = "a block";
+
+  static void read(bind_reader& r, token& t, T& out, std::string_view key)
+  {
+    if (t.type() != token::OPEN) bind_detail::type_error<T>(r, t, key);
+    bind_detail::bind_block(r, out, t.loc(), false);
+  }
+};
+
+
+namespace bind_detail {
+  template<typename M> struct is_vector                 : std::false_type {};
+  template<typename T> struct is_vector<std::vector<T>> : std::true_type {};
+
+  template<typename S, typename M>
+  constexpr bool valid_field(const bind_field<S, M>& f) noexcept
+  {
+    return !(f.flags & bind_flag::REPEATED) || is_vector<M>::value;
+  }
+
+  template<typename S, typename M>
+  void read_field(bind_reader& r, token& t, S& out, const bind_field<S, M>& f)
+  {
+    auto& m = out.*f.p_mem;
+
+    if constexpr (is_vector<M>::value)
+    {
+      if (f.flags & bind_flag::REPEATED)
+      {
+        read_element(r, t, m, f.key);
+        return;
+      }
+    }
+
+    bind_value<M>::read(r, t, m, f.key);
+  }
+
+  // match the key against the schema's fields (whose keyword IDs are in `kws`), returning the field's index or
+  // -1. keywords match by ID alone, and a keyword can't match a non-keyword, so only non-keywords compare
+  // strings.
+  template<typename Fields, size_t N, size_t... I>
+  int find_field(const Fields& fields, const std::array<uint16_t, N>& kws, std::string_view key, uint16_t kw,
+                 std::index_sequence<I...>) noexcept
+  {
+    int idx = -1;
+    auto match = [&](uint16_t field_kw, std::string_view field_key) {
+      return field_kw == kw && (kw != keyword::NONE || field_key == key);
+    };
+
+    (void)( (match(kws[I], std::get<I>(fields).key) ? (idx = I, true) : false) || ... );
+    return idx;
+  }
+
+  template<typename S, typename Fields, size_t... I>
+  void read_field_at(size_t idx, bind_reader& r, token& t, S& out, const Fields& fields,
+                     std::index_sequence<I...>)
+  {
+    (void)( ((idx == I) ? (read_field(r, t, out, std::get<I>(fields)), true) : false) || ... );
+  }
+
+  template<typename Fields, size_t... I>
+  void check_required(bind_reader& r, const Location& open_loc, const Fields& fields, uint64_t seen,
+                      std::index_sequence<I...>)
+  {
+    auto check = [&](const auto& f, uint64_t bit) {
+      if ((f.flags & bind_flag::REQUIRED) && !(seen & bit))
+        throw r.err(open_loc, "Required key '{}' not defined", f.key);
+    };
+
+    (check(std::get<I>(fields), uint64_t(1) << I), ...);
+  }
+
+  template<typename T>
+  void bind_block(bind_reader& r, T& out, const Location& open_loc, bool is_root)
+  {
+    constexpr auto& fields = bind_schema<T>::fields;
+    constexpr size_t N = std::tuple_size_v<std::decay_t<decltype(fields)>>;
+    static_assert(N <= 64, "too many fields in bind_schema");
+    static_assert(std::apply([](const auto& ...f) { return (valid_field(f) && ...); }, fields),
+                  "a REPEATED field's member must be a std::vector");
+
+    static constexpr auto kws = std::apply([](const auto& ...f) {
+      return std::array<uint16_t, N>{ keyword::lookup(f.key)... };
+    }, fields);
+
+    using seq = std::make_index_sequence<N>;
+    uint64_t seen = 0;
+    token t;
+
+    while (true)
+    {
+      r.next(t, is_root);
+
+      if (t.type() == token::END)
+        break;
+
+      if (t.type() == token::CLOSE)
+      {
+        if (is_root) throw r.err(t.loc(), "Unmatched closing brace");
+        break;
+      }
+
+      if (t.type() != token::STR && t.type() != token::DATE && t.type() != token::INTEGER)
+        r.unexpected_token(t);
+
+      // only string keys are bound. the key text is clobbered by the next token, so match it first.
+      const int idx = (t.type() == token::STR)
+                      ? find_field(fields, kws, std::string_view(t.text(), t.text_len()), t.kw(), seq{}) : -1;
+      r.next(t);
+
+      if (t.type() != token::OPERATOR)
+        throw r.err(t.loc(), "Expected {} token but got {}", token::TYPE_MAP[token::OPERATOR], t.type_name());
+
+      r.next(t);
+
+      if (idx < 0)
+        r.skip_value(t);
+      else
+      {
+        read_field_at(idx, r, t, out, fields, seq{});
+        seen |= uint64_t(1) << idx;
+      }
+    }
+
+    check_required(r, open_loc, fields, seen, seq{});
+  }
+}
+
+
+// bind a whole file (or input) into a bindable struct, returning it
+template<typename T>
+T bind(bind_reader& r)
+{
+  static_assert(is_bindable_struct<T>::value, "bind_schema<T> must be specialized to bind into T");
+  T out{};
+  bind_detail::bind_block(r, out, Location(), true);
+  return out;
+}
+
+template<typename T>
+T bind(const fs::path& path)
+{
+  bind_reader r(path);
+  return bind<T>(r);
+}
+
+template<typename T>
+T bind(lexer_input& input, const fs::path& path)
+{
+  bind_reader r(input, path);
+  return bind<T>(r);
+}
+
+
+NAMESPACE_CK2_END;
+#endif
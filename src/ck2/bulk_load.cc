@@ -0,0 +1,71 @@
+
+#include "bulk_load.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <exception>
+#include <unordered_set>
+
+
+NAMESPACE_CK2;
+
+
+bulk_load_result bulk_load(const VFS& vfs, const std::vector<std::string>& globs, uint n_threads)
+{
+  struct job {
+    VFS::file file;
+    uintmax_t size;
+    std::unique_ptr<parser> p_parser;
+    std::string err;
+  };
+
+  /* resolve the globs into a unique set of files (globs may overlap) */
+
+  std::vector<job> jobs;
+  std::unordered_set<std::string> seen;
+
+  for (const auto& g : globs)
+    for (auto& f : vfs.glob(g))
+      if (seen.insert(f.virt_path).second)
+      {
+        std::error_code ec;
+        const uintmax_t sz = (f.in_archive()) ? f.p_entry->size : fs::file_size(f.path, ec);
+        jobs.push_back(job{ std::move(f), (ec) ? 0 : sz, nullptr, std::string() });
+      }
+
+  /* largest first; parallel_for hands out indices in ascending order */
+
+  std::stable_sort(jobs.begin(), jobs.end(), [](const job& a, const job& b) { return a.size > b.size; });
+
+  parallel_for(jobs.size(), [&](size_t i)
+  {
+    auto& j = jobs[i];
+
+    try
+    {
+      j.p_parser = j.file.parse();
+    }
+    catch (const std::exception& e)
+    {
+      j.err = e.what();
+    }
+  }, n_threads);
+
+  bulk_load_result res;
+
+  for (auto& j : jobs)
+  {
+    if (j.p_parser)
+      res.files.emplace(j.file.virt_path, std::move(j.p_parser));
+    else
+      res.errors.push_back(load_error{ j.file.virt_path, j.file.path, std::move(j.err) });
+  }
+
+  std::sort(res.errors.begin(), res.errors.end(),
+            [](const auto& a, const auto& b) { return a.virt_path < b.virt_path; });
+
+  return res;
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,41 @@
+#ifndef LIBCK2_BULK_LOAD_H
+#define LIBCK2_BULK_LOAD_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "parser.h"
+#include "VFS.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+struct load_error {
+  std::string virt_path;
+  fs::path    path; // of the file (see VFS::file)
+  std::string what;
+};
+
+
+struct bulk_load_result {
+  std::map<std::string, std::unique_ptr<parser>> files;  // by virtual path (as spelled in the winning root)
+  std::vector<load_error>                        errors; // by virtual path
+
+  bool ok() const noexcept { return errors.empty(); }
+};
+
+
+// parse every file which matches any of the VFS glob patterns (e.g., "common/*/*.txt", "events/*.txt"; see
+// VFS::glob) concurrently upon n_threads threads (0 means one per hardware thread). each virtual path is parsed
+// once, from the root which overrides it, and the files are scheduled largest-first so that a big file picked
+// up late can't serialize the tail of the load. failures don't abort the rest of the load; they're returned
+// instead, and failed files are absent from the result's files.
+bulk_load_result bulk_load(const VFS&, const std::vector<std::string>& globs, uint n_threads = 0);
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,70 @@
+#include "bulk_write.h"
+
+#include "parallel.h"
+#include "parser.h"
+#include "writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+
+NAMESPACE_CK2;
+
+
+write_job rewrite_job(const fs::path& path, const parser& prs)
+{
+  return write_job(path, [&prs](std::FILE* f) { rewrite(prs, f); });
+}
+
+
+write_job print_job(const fs::path& path, const block& root)
+{
+  return write_job(path, [&root](std::FILE* f)
+  {
+    std::ostringstream os;
+    root.print(os);
+    auto s = os.str();
+
+    if (!s.empty() && std::fwrite(s.data(), s.size(), 1, f) < 1)
+      throw Error("Failed to write parse tree: {}", strerror(errno));
+  });
+}
+
+
+std::vector<write_error> bulk_write(const std::vector<write_job>& jobs, uint n_threads)
+{
+  std::vector<write_error> errors;
+  std::mutex errors_mutex;
+
+  parallel_for(jobs.size(), [&](size_t i)
+  {
+    std::string what;
+
+    try
+    {
+      write_file_atomic(jobs[i].path, jobs[i].write);
+      return;
+    }
+    catch (const std::exception& e)
+    {
+      what = e.what();
+    }
+    catch (...)
+    {
+      what = "Unknown error";
+    }
+
+    std::lock_guard<std::mutex> lock(errors_mutex);
+    errors.push_back( write_error{ i, jobs[i].path, std::move(what) } );
+  },
+  n_threads);
+
+  std::sort(errors.begin(), errors.end(), [](auto& a, auto& b) { return a.job_idx < b.job_idx; });
+  return errors;
+}
+
+
+NAMESPACE_CK2_END;
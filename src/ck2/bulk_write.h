@@ -0,0 +1,59 @@
+#ifndef LIBCK2_BULK_WRITE_H
+#define LIBCK2_BULK_WRITE_H
+
+#include "common.h"
+#include "filesystem.h"
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+class block;
+class parser;
+
+
+// one output file of a bulk write: its destination path and a function which serializes its content to a stream.
+// anything referenced by the function must outlive the bulk write.
+struct write_job {
+  fs::path                        path;
+  std::function<void(std::FILE*)> write;
+
+  write_job(const fs::path& path_, std::function<void(std::FILE*)> write_)
+    : path(path_), write(std::move(write_)) {}
+
+  // from anything with a `void write(std::FILE*) const` member (e.g., DefinitionsTable, AdjacenciesFile)
+  template<typename T, typename = decltype( std::declval<const T&>().write(std::declval<std::FILE*>()) )>
+  write_job(const fs::path& path_, const T& obj)
+    : path(path_), write([&obj](std::FILE* f) { obj.write(f); }) {}
+};
+
+
+// job which round-trips a parsed file (see writer.h) to `path`
+write_job rewrite_job(const fs::path& path, const parser&);
+
+// job which prints a parse tree (e.g., one composed programmatically) to `path` in block::print format
+write_job print_job(const fs::path& path, const block&);
+
+
+struct write_error {
+  size_t      job_idx; // index of the failed job in the batch
+  fs::path    path;
+  std::string what;
+};
+
+
+// serialize a batch of files concurrently upon n_threads threads (0 means one per hardware thread), each to a
+// temporary file which is then atomically renamed over its destination (see write_file_atomic), so every file
+// is left either fully old or fully new. failures don't abort the rest of the batch; they're returned instead
+// (in job order), so an empty result means that every file was written.
+std::vector<write_error> bulk_write(const std::vector<write_job>& jobs, uint n_threads = 0);
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,85 @@
+
+#include "color_lut.h"
+#include <new>
+
+
+NAMESPACE_CK2;
+
+
+#ifndef COMPACT_COLOR_LUT
+
+color_lut::color_lut()
+: _p_tbl(static_cast<uint16_t*>(std::calloc(size_t(1) << 24, sizeof(uint16_t))), &std::free)
+{
+  if (!_p_tbl)
+    throw std::bad_alloc();
+}
+
+
+void color_lut::set(uint32_t color, uint16_t value)
+{
+  assert( value != NONE );
+  _p_tbl[color & 0xFFFFFF] = value;
+}
+
+#else
+
+color_lut::color_lut()
+: _mask(0), _shift(0), _size(0)
+{
+  grow();
+}
+
+
+void color_lut::set(uint32_t color, uint16_t value)
+{
+  assert( value != NONE );
+  color &= 0xFFFFFF;
+
+  uint32_t i = slot(color);
+
+  for (; _p_keys[i] != EMPTY; i = (i + 1) & _mask)
+    if (_p_keys[i] == color)
+    {
+      _p_values[i] = value;
+      return;
+    }
+
+  _p_keys[i] = color;
+  _p_values[i] = value;
+
+  if (++_size > _mask / 2)
+    grow();
+}
+
+
+void color_lut::grow()
+{
+  const uint32_t old_cap = (_p_keys) ? _mask + 1 : 0;
+  auto p_old_keys = std::move(_p_keys);
+  auto p_old_values = std::move(_p_values);
+
+  const uint bits = (old_cap) ? 32 - _shift + 1 : 10;
+  const uint32_t cap = uint32_t(1) << bits;
+  _p_keys = std::make_unique<uint32_t[]>(cap);
+  _p_values = std::make_unique<uint16_t[]>(cap);
+  _mask = cap - 1;
+  _shift = 32 - bits;
+
+  for (uint32_t i = 0; i < cap; ++i)
+    _p_keys[i] = EMPTY;
+
+  for (uint32_t i = 0; i < old_cap; ++i)
+    if (p_old_keys[i] != EMPTY)
+    {
+      uint32_t j = slot(p_old_keys[i]);
+      while (_p_keys[j] != EMPTY) j = (j + 1) & _mask;
+      _p_keys[j] = p_old_keys[i];
+      _p_values[j] = p_old_values[i];
+    }
+}
+
+#endif
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,75 @@
+#ifndef LIBCK2_COLOR_LUT_H
+#define LIBCK2_COLOR_LUT_H
+
+#include "common.h"
+#include "Color.h"
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+
+NAMESPACE_CK2;
+
+
+/* COLOR_LUT -- maps 24-bit colors (0xRRGGBB) to nonzero 16-bit values, such as province IDs
+ *
+ * by default, this is a dense table indexed directly by color, so a lookup is a single load. it spans 32MB of
+ * address space, but it's allocated zero-filled by calloc, which leaves the OS to map pages upon first touch;
+ * as the colors in use are scattered, only a page or so per color is ever committed.
+ *
+ * building w/ COMPACT_COLOR_LUT defined instead uses a small open-addressed hash table (linear probing at a
+ * load factor of at most 1/2, w/ a multiplicative hash), for when address space is scarce.
+ */
+
+class color_lut {
+public:
+  static constexpr uint16_t NONE = 0; // the value of unmapped colors
+
+  static constexpr uint32_t key(RGB c) noexcept { return uint32_t(c.r) << 16 | uint32_t(c.g) << 8 | c.b; }
+
+  // the key of a pixel stored in BGR byte order, as in 24bpp bitmaps
+  static uint32_t key_bgr(const uint8_t* p) noexcept
+  {
+    return uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0];
+  }
+
+  color_lut();
+
+  void set(uint32_t color, uint16_t value); // value must not be NONE
+  void set(RGB c, uint16_t value) { set(key(c), value); }
+
+#ifndef COMPACT_COLOR_LUT
+  uint16_t operator[](uint32_t color) const noexcept { return _p_tbl[color & 0xFFFFFF]; }
+#else
+  uint16_t operator[](uint32_t color) const noexcept
+  {
+    for (uint32_t i = slot(color);; i = (i + 1) & _mask)
+    {
+      if (_p_keys[i] == color) return _p_values[i];
+      if (_p_keys[i] == EMPTY) return NONE;
+    }
+  }
+#endif
+
+  uint16_t operator[](RGB c) const noexcept { return (*this)[key(c)]; }
+
+private:
+#ifndef COMPACT_COLOR_LUT
+  std::unique_ptr<uint16_t[], decltype(&std::free)> _p_tbl;
+#else
+  static constexpr uint32_t EMPTY = 0xFFFFFFFF; // not a 24-bit color
+
+  uint32_t slot(uint32_t color) const noexcept { return (color * 0x9E3779B1u) >> _shift; }
+  void     grow();
+
+  std::unique_ptr<uint32_t[]> _p_keys;
+  std::unique_ptr<uint16_t[]> _p_values;
+  uint32_t _mask;
+  uint     _shift;
+  uint32_t _size;
+#endif
+};
+
+
+NAMESPACE_CK2_END;
+#endif
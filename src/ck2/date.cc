@@ -4,6 +4,10 @@
 #include <cstring>
 #include <cstdlib>
 
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
 
 NAMESPACE_CK2;
 
@@ -46,4 +50,127 @@ date::date(char* src) {
 }
 
 
+namespace {
+  // is x in [begin, end)? one unsigned comparison, as x - begin wraps around when x < begin.
+  inline bool in_range(int32_t x, int32_t begin, int32_t end) noexcept
+  {
+    return uint32_t(x) - uint32_t(begin) < uint32_t(end) - uint32_t(begin);
+  }
+
+  inline int32_t key(const date& d) noexcept { return d.sort_key(); }
+  inline int32_t key(int32_t x) noexcept     { return x; }
+
+#ifdef __SSE2__
+  static_assert(sizeof(date) == 4, "date must be packed for the SIMD range scans");
+
+  // the keys of four consecutive elements
+  inline __m128i load_keys(const int32_t* p) noexcept
+  {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+
+  inline __m128i load_keys(const date* p) noexcept
+  {
+    // a date's lane is year | month << 16 | day << 24, and its key is year << 16 | month << 8 | day
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i month = _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xFF00));
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(v, 16), month), _mm_srli_epi32(v, 24));
+  }
+
+  // the four-bit mask of the lanes in range. SSE2 lacks unsigned comparisons, so the unsigned comparison of
+  // in_range() is made signed by flipping the sign bits of both sides.
+  class range_test {
+    const __m128i _begin;
+    const __m128i _width; // (end - begin) ^ INT32_MIN
+
+  public:
+    range_test(int32_t begin, int32_t end) noexcept
+    : _begin(_mm_set1_epi32(begin))
+    , _width(_mm_set1_epi32(int32_t((uint32_t(end) - uint32_t(begin)) ^ 0x80000000u))) {}
+
+    int operator()(__m128i keys) const noexcept
+    {
+      const __m128i x = _mm_xor_si128(_mm_sub_epi32(keys, _begin), _mm_set1_epi32(INT32_MIN));
+      return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(x, _width)));
+    }
+  };
+
+  constexpr uint8_t POPCOUNT4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+
+  template<typename T>
+  size_t count_keys(const T* p, size_t n, int32_t begin, int32_t end) noexcept
+  {
+    if (end <= begin) return 0;
+    size_t count = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const range_test test(begin, end);
+    for (; i + 4 <= n; i += 4) count += POPCOUNT4[test(load_keys(p + i))];
+#endif
+
+    for (; i < n; ++i) count += in_range(key(p[i]), begin, end);
+    return count;
+  }
+
+  template<typename T>
+  size_t filter_keys(const T* p, size_t n, int32_t begin, int32_t end, uint32_t* out) noexcept
+  {
+    if (end <= begin) return 0;
+    size_t count = 0;
+    size_t i = 0;
+
+    // indices are written unconditionally & only kept (by advancing count) if in range
+
+#ifdef __SSE2__
+    const range_test test(begin, end);
+
+    for (; i + 4 <= n; i += 4)
+    {
+      const int mask = test(load_keys(p + i));
+
+      for (uint j = 0; j < 4; ++j)
+      {
+        out[count] = static_cast<uint32_t>(i + j);
+        count += (mask >> j) & 1;
+      }
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+      out[count] = static_cast<uint32_t>(i);
+      count += in_range(key(p[i]), begin, end);
+    }
+
+    return count;
+  }
+}
+
+
+size_t count_in_range(const date* p, size_t n, date begin, date end) noexcept
+{
+  return count_keys(p, n, begin.sort_key(), end.sort_key());
+}
+
+
+size_t count_in_range(const int32_t* p_ordinals, size_t n, int32_t begin, int32_t end) noexcept
+{
+  return count_keys(p_ordinals, n, begin, end);
+}
+
+
+size_t filter_in_range(const date* p, size_t n, date begin, date end, uint32_t* out) noexcept
+{
+  return filter_keys(p, n, begin.sort_key(), end.sort_key(), out);
+}
+
+
+size_t filter_in_range(const int32_t* p_ordinals, size_t n, int32_t begin, int32_t end, uint32_t* out) noexcept
+{
+  return filter_keys(p_ordinals, n, begin, end, out);
+}
+
+
 NAMESPACE_CK2_END;
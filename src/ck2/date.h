@@ -3,8 +3,11 @@
 
 #include "common.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
+#include <ostream>
 
 
 NAMESPACE_CK2;
@@ -16,9 +19,11 @@ NAMESPACE_CK2;
 
 struct date
 {
+  static constexpr int32_t DAYS_PER_YEAR = 365; // the game's calendar has no leap years
+
   date(char* src); // only for use on mutable strings known to be well-formed (typically due to being tokenized)
 
-  date(int year = 1, uint month = 1, uint day = 1)
+  constexpr date(int year = 1, uint month = 1, uint day = 1)
   : _y(year)
   , _m(month)
   , _d(day)
@@ -30,27 +35,56 @@ struct date
 #endif
   }
 
-  int  year()  const noexcept { return _y; }
-  uint month() const noexcept { return _m; }
-  uint day()   const noexcept { return _d; }
+  constexpr int  year()  const noexcept { return _y; }
+  constexpr uint month() const noexcept { return _m; }
+  constexpr uint day()   const noexcept { return _d; }
+
+  static constexpr uint days_in_month(uint month) noexcept
+  {
+    return DAYS_BEFORE_MONTH[clamp_month(month)] - DAYS_BEFORE_MONTH[clamp_month(month) - 1];
+  }
+
+  /* ORDINALS -- days since 1.1.1 (negative before it), which order dates & support arithmetic. as there's no
+   * year 0, -1.12.31 directly precedes 1.1.1. */
+
+  constexpr int32_t ordinal() const noexcept
+  {
+    return year_index(_y) * DAYS_PER_YEAR + DAYS_BEFORE_MONTH[clamp_month(_m) - 1] + int32_t(_d) - 1;
+  }
+
+  static constexpr date from_ordinal(int32_t n) noexcept
+  {
+    const int32_t yi = floor_div(n, DAYS_PER_YEAR);
+    const int32_t r = n - yi * DAYS_PER_YEAR; // day of the year, [0, 365)
+    uint m = 1;
+    while (DAYS_BEFORE_MONTH[m] <= r) ++m;
+    return date(index_year(yi), m, uint(r - DAYS_BEFORE_MONTH[m - 1]) + 1);
+  }
+
+  constexpr date add_days(int32_t n) const noexcept { return from_ordinal(ordinal() + n); }
 
-  bool operator<(const date& o) const noexcept
+  // the day is clamped to the resulting month's length (e.g., 1066.1.31 plus a month is 1066.2.28)
+  constexpr date add_months(int32_t n) const noexcept
   {
-    // FIXME: may require rethinking for inequal years BC
-    if (_y < o._y) return true;
-    if (o._y < _y) return false;
-    if (_m < o._m) return true;
-    if (o._m < _m) return false;
-    if (_d < o._d) return true;
-    if (o._d < _d) return false;
-    return false;
+    const int32_t months = year_index(_y) * 12 + int32_t(clamp_month(_m)) - 1 + n;
+    const int32_t yi = floor_div(months, 12);
+    const uint    m = uint(months - yi * 12) + 1;
+    return date(index_year(yi), m, (_d < days_in_month(m)) ? _d : days_in_month(m));
   }
 
-  bool operator==(const date& o) const noexcept { return _y == o._y && _m == o._m && _d == o._d; }
-  bool operator>=(const date& o) const noexcept { return !(*this < o); }
-  bool operator!=(const date& o) const noexcept { return !(*this == o); }
-  bool operator> (const date& o) const noexcept { return *this >= o && *this != o; }
-  bool operator<=(const date& o) const noexcept { return *this < o || *this == o; }
+  // the number of days from o to this date
+  constexpr int32_t operator-(const date& o) const noexcept { return ordinal() - o.ordinal(); }
+
+  // a key which orders dates as operator< does, with a single integer comparison. unlike the ordinal, it's
+  // well-defined for dates w/ out-of-range days (e.g., 1066.2.30), which are kept distinct.
+  constexpr int32_t sort_key() const noexcept { return int32_t(_y) * 65536 + int32_t(_m) * 256 + int32_t(_d); }
+
+  constexpr bool operator< (const date& o) const noexcept { return sort_key() < o.sort_key(); }
+  constexpr bool operator==(const date& o) const noexcept { return sort_key() == o.sort_key(); }
+  constexpr bool operator>=(const date& o) const noexcept { return !(*this < o); }
+  constexpr bool operator!=(const date& o) const noexcept { return !(*this == o); }
+  constexpr bool operator> (const date& o) const noexcept { return o < *this; }
+  constexpr bool operator<=(const date& o) const noexcept { return !(o < *this); }
 
   friend std::ostream& operator<<(std::ostream& os, date d)
   {
@@ -58,6 +92,21 @@ struct date
   }
 
 private:
+  static constexpr int32_t DAYS_BEFORE_MONTH[13] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365
+  };
+
+  static constexpr uint clamp_month(uint m) noexcept { return (m < 1) ? 1 : (m > 12) ? 12 : m; }
+
+  // years w/o a gap at 0: 1 is 0, -1 is -1 (the invalid year 0 maps to 0 along with 1)
+  static constexpr int32_t year_index(int32_t y) noexcept { return (y > 0) ? y - 1 : y; }
+  static constexpr int32_t index_year(int32_t i) noexcept { return (i >= 0) ? i + 1 : i; }
+
+  static constexpr int32_t floor_div(int32_t a, int32_t b) noexcept
+  {
+    return a / b - ((a % b != 0 && (a < 0) != (b < 0)) ? 1 : 0);
+  }
+
   int16_t _y;
   uint8_t _m;
   uint8_t _d;
@@ -73,5 +122,17 @@ private:
 #endif
 
 
+/* range scans over arrays of dates or of ordinals, for filtering the large date columns of history & savegame
+ * analyses. ranges are half-open, [begin, end). where SSE2 is available, four elements are tested at a time.
+ */
+
+size_t count_in_range(const date* p, size_t n, date begin, date end) noexcept;
+size_t count_in_range(const int32_t* p_ordinals, size_t n, int32_t begin, int32_t end) noexcept;
+
+// write the indices of the elements in range to out (which has room for n), returning how many there were
+size_t filter_in_range(const date* p, size_t n, date begin, date end, uint32_t* out) noexcept;
+size_t filter_in_range(const int32_t* p_ordinals, size_t n, int32_t begin, int32_t end, uint32_t* out) noexcept;
+
+
 NAMESPACE_CK2_END;
 #endif
@@ -0,0 +1,91 @@
+#include "filesystem.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+  #include <io.h>
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+
+NAMESPACE_CK2;
+
+
+static auto temp_path_for(const fs::path& path)
+{
+  // unique per process, thread, and call, so that concurrent writers (even of the same target) never collide
+  static std::atomic<uint> s_counter(0);
+
+#ifdef _WIN32
+  const auto pid = _getpid();
+#else
+  const auto pid = getpid();
+#endif
+
+  auto name = fmt::format(".{}.{}-{:x}-{}.tmp", path.filename().generic_string(), pid,
+                          std::hash<std::thread::id>{}(std::this_thread::get_id()) & 0xFFFFFF, s_counter++);
+
+  return path.parent_path() / name;
+}
+
+
+// flush the file's data to the device. returns false upon failure (w/ errno set).
+static bool sync_file(std::FILE* f)
+{
+#ifdef _WIN32
+  return _commit(_fileno(f)) == 0;
+#else
+  return fsync(fileno(f)) == 0;
+#endif
+}
+
+
+void write_file_atomic(const fs::path& path, const std::function<void(std::FILE*)>& write_fn)
+{
+  const auto tmp_path = temp_path_for(path);
+  const auto stmp_path = tmp_path.generic_string();
+
+  unique_file_ptr ufp( std::fopen(stmp_path.c_str(), "wb"), std::fclose );
+
+  if (ufp.get() == nullptr)
+    throw PathError(fmt::format("Failed to open file for writing: {}: {}", strerror(errno), stmp_path), path);
+
+  try
+  {
+    write_fn(ufp.get());
+
+    if (std::ferror(ufp.get()) || std::fflush(ufp.get()) != 0)
+      throw PathError(fmt::format("Failed to write file: {}: {}", strerror(errno), stmp_path), path);
+
+    // a failed flush must not replace a good file
+    if (!sync_file(ufp.get()))
+      throw PathError(fmt::format("Failed to sync file: {}: {}", strerror(errno), stmp_path), path);
+
+    if (std::fclose(ufp.release()) != 0)
+      throw PathError(fmt::format("Failed to close file: {}: {}", strerror(errno), stmp_path), path);
+
+    // carry over an existing target's permissions, which the temporary file would otherwise replace w/ the
+    // umask's defaults
+    std::error_code ec;
+
+    if (const auto st = fs::status(path, ec); !ec && fs::exists(st))
+      fs::permissions(tmp_path, st.permissions(), fs::perm_options::replace);
+
+    fs::rename(tmp_path, path); // atomic replacement of any existing file at `path`
+  }
+  catch (...)
+  {
+    ufp.reset();
+    std::error_code ec;
+    fs::remove(tmp_path, ec);
+    throw;
+  }
+}
+
+
+NAMESPACE_CK2_END;
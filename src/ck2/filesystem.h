@@ -2,6 +2,7 @@
 #define LIBCK2_FILESYSTEM_H
 
 #include <cstdio>
+#include <functional>
 #include <memory>
 #include <string>
 #include <filesystem>
@@ -45,5 +46,12 @@ struct PathTypeError : public PathError {
 };
 
 
+// write a file such that it's either left wholly as it was or wholly replaced: `write_fn` writes to a temporary
+// file in the same directory, which is flushed to disk and then atomically renamed over `path`. if anything
+// fails (incl. `write_fn` throwing), the temporary file is removed, the target is untouched, and we throw. an
+// existing target's permission bits are kept; its owner, ACLs, and extended attributes are not.
+void write_file_atomic(const fs::path& path, const std::function<void(std::FILE*)>& write_fn);
+
+
 NAMESPACE_CK2_END;
 #endif
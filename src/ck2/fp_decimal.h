@@ -84,6 +84,10 @@ public:
   fp_decimal(float f)  : _m( f * scale + 0.5f ) {}
   fp_decimal(int i)    : _m( i * scale ) {}
 
+  // access to the underlying fixed-point representation (e.g., for binary serialization)
+  static self_t from_raw(int32_t m) noexcept { self_t fp(0); fp._m = m; return fp; }
+  int32_t raw() const noexcept { return _m; }
+
   int32_t integral()   const noexcept { return _m / scale; }
   int32_t fractional() const noexcept { return _m % scale; }
 
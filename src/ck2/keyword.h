@@ -0,0 +1,172 @@
+#ifndef LIBCK2_KEYWORD_H
+#define LIBCK2_KEYWORD_H
+
+#include "common.h"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+
+NAMESPACE_CK2;
+
+
+/* KEYWORD -- a small, fixed vocabulary of frequent keys & all of the operators, which the lexer tags with an ID
+ *
+ * the IDs are looked up in a perfect hash table that's generated at compile time: a seed for the string hash is
+ * searched for under which no two keywords share a slot, so a lookup is one hash, one table load, and one
+ * string comparison (to reject non-keywords). tokens which aren't keywords get keyword::NONE, and consumers
+ * then fall back to their string handling.
+ *
+ * to add a keyword, add its ID before COUNT and its text at the same position in NAMES.
+ */
+
+namespace keyword {
+  enum : uint16_t {
+    NONE = 0,
+
+    /* operators (in binary_op order) */
+    OP_EQ,
+    OP_LT,
+    OP_GT,
+    OP_LTE,
+    OP_GTE,
+    OP_EQ2,
+
+    /* control flow & logic */
+    LIMIT,
+    TRIGGER,
+    EFFECT,
+    IF,
+    ELSE,
+    NOT,
+    OR,
+    AND,
+    NOR,
+    NAND,
+    YES,
+    NO,
+
+    /* history */
+    NAME,
+    CULTURE,
+    RELIGION,
+    DYNASTY,
+    HOLDER,
+    LIEGE,
+    DE_JURE_LIEGE,
+    BIRTH_DATE,
+    DEATH_DATE,
+    FATHER,
+    MOTHER,
+    EMPLOYER,
+    TRAIT,
+
+    /* default.map */
+    MAX_PROVINCES,
+    DEFINITIONS,
+    PROVINCES,
+    POSITIONS,
+    TERRAIN,
+    RIVERS,
+    TERRAIN_DEFINITION,
+    HEIGHTMAP,
+    TREE_DEFINITION,
+    CONTINENT,
+    ADJACENCIES,
+    CLIMATE,
+    GEOGRAPHICAL_REGION,
+    REGION,
+    STATIC,
+    SEASONS,
+    SEA_ZONES,
+    MAJOR_RIVERS,
+    OCEAN_REGION,
+    EXTERNALS,
+
+    COUNT
+  };
+
+  inline constexpr std::string_view NAMES[COUNT] = {
+    "",
+    "=", "<", ">", "<=", ">=", "==",
+    "limit", "trigger", "effect", "if", "else", "NOT", "OR", "AND", "NOR", "NAND", "yes", "no",
+    "name", "culture", "religion", "dynasty", "holder", "liege", "de_jure_liege", "birth_date", "death_date",
+    "father", "mother", "employer", "trait",
+    "max_provinces", "definitions", "provinces", "positions", "terrain", "rivers", "terrain_definition",
+    "heightmap", "tree_definition", "continent", "adjacencies", "climate", "geographical_region", "region",
+    "static", "seasons", "sea_zones", "major_rivers", "ocean_region", "externals",
+  };
+
+  static_assert(NAMES[COUNT - 1] == "externals", "keyword::NAMES must parallel the keyword IDs");
+  static_assert(COUNT <= 256, "keyword IDs must fit in the hash table's byte-sized slots");
+
+  namespace detail {
+    constexpr uint TABLE_SZ = 512; // sparse enough that a collision-free seed is quickly found
+    constexpr uint MAX_SEEDS = 1u << 16;
+
+    constexpr uint32_t hash(std::string_view s, uint32_t seed) noexcept
+    {
+      // FNV-1a w/ a seeded offset basis & a final mix so that the low bits (the slot) depend on every byte
+      uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+      for (char c : s) h = (h ^ uint8_t(c)) * 16777619u;
+      return h ^ (h >> 15);
+    }
+
+    struct table {
+      uint32_t seed;
+      uint     max_len;
+      std::array<uint8_t, TABLE_SZ> slots; // keyword ID by hash slot, or NONE
+    };
+
+    constexpr table build() noexcept
+    {
+      uint max_len = 0;
+      for (uint i = 1; i < COUNT; ++i) if (NAMES[i].size() > max_len) max_len = NAMES[i].size();
+
+      for (uint32_t seed = 0; seed < MAX_SEEDS; ++seed)
+      {
+        table t{ seed, max_len, {} };
+        bool ok = true;
+
+        for (uint i = 1; i < COUNT && ok; ++i)
+        {
+          auto& slot = t.slots[hash(NAMES[i], seed) % TABLE_SZ];
+          ok = (slot == NONE);
+          slot = i;
+        }
+
+        if (ok) return t;
+      }
+
+      return table{ 0, 0, {} };
+    }
+
+    inline constexpr table TABLE = build();
+    static_assert(TABLE.max_len > 0, "failed to find a perfect hash seed for the keywords; raise TABLE_SZ");
+  }
+
+  // the keyword's ID, or NONE if the string isn't a keyword
+  constexpr uint16_t lookup(std::string_view s) noexcept
+  {
+    if (s.empty() || s.size() > detail::TABLE.max_len) return NONE;
+    const uint16_t id = detail::TABLE.slots[detail::hash(s, detail::TABLE.seed) % detail::TABLE_SZ];
+    return (id != NONE && NAMES[id] == s) ? id : NONE;
+  }
+
+  constexpr std::string_view name(uint16_t id) noexcept { return (id < COUNT) ? NAMES[id] : ""; }
+
+  namespace detail {
+    constexpr bool all_found() noexcept
+    {
+      for (uint i = 1; i < COUNT; ++i) if (lookup(NAMES[i]) != i) return false;
+      return true;
+    }
+
+    static_assert(all_found(), "keyword table is inconsistent");
+    static_assert(lookup("not") == NONE && lookup("holders") == NONE && lookup("") == NONE);
+  }
+}
+
+
+NAMESPACE_CK2_END;
+#endif
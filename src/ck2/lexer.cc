@@ -1,6 +1,7 @@
 #include "lexer.h"
 
 #include "Location.h"
+#include "keyword.h"
 #include "strutil.h"
 #include "token.h"
 
@@ -14,9 +15,12 @@ bool lexer::read_token_into(token& t, size_t max_copy_sz)
 
   t.type( yylex() );
   t.loc( Loc{ static_cast<uint>(yylineno) } );
+  t.span( src_span{ static_cast<uint>(yyoffset - yyleng), static_cast<uint>(yyoffset) } );
 
   if (t.type() == token::END) {
     t.text(nullptr, 0);
+    t.kw(keyword::NONE); // (the token may be reused, so don't leave the previous one's keyword on it)
+    t.span( src_span{ static_cast<uint>(yyoffset), static_cast<uint>(yyoffset) } );
     ret = false;
     // reset the flex scanner and close the underlying file early (otherwise, it'd be at object destruction time)
     _f.reset();
@@ -41,6 +45,10 @@ bool lexer::read_token_into(token& t, size_t max_copy_sz)
   if (len > 0 && p_txt[ len-1 ] == '\n') p_txt[ len -= 1 ] = '\0';
   if (len > 0 && p_txt[ len-1 ] == '\r') p_txt[ len -= 1 ] = '\0';
 
+  // only barewords & operators can be keywords (quoting one makes it a mere string)
+  t.kw( (t.type() == token::STR || t.type() == token::OPERATOR) ? keyword::lookup(std::string_view(p_txt, len))
+                                                                 : keyword::NONE );
+
   if (max_copy_sz == 0)
     t.text(p_txt, len);
   else
@@ -59,6 +67,18 @@ lexer::lexer(const fs::path& path)
 
   yyin = _f.get();
   yylineno = 1;
+  yyoffset = 0;
+}
+
+lexer::lexer(lexer_input& input, const fs::path& path, uint first_line)
+: _f(nullptr, std::fclose),
+  _path(path)
+{
+  yyin = nullptr;
+  yyreader = [](char* buf, size_t max_sz, void* ctx) { return static_cast<lexer_input*>(ctx)->read(buf, max_sz); };
+  yyreader_ctx = &input;
+  yylineno = first_line;
+  yyoffset = 0;
 }
 
 
@@ -4,8 +4,11 @@
 #include "common.h"
 #include "scanner.h"
 #include "filesystem.h"
+#include <algorithm>
 #include <memory>
 #include <cstdio>
+#include <cstring>
+#include <string_view>
 
 
 NAMESPACE_CK2;
@@ -13,14 +16,45 @@ NAMESPACE_CK2;
 
 class token;
 
+
+// a pull-based source of input bytes for the lexer, as an alternative to it reading a file itself (e.g., to lex data
+// as it is decompressed)
+class lexer_input {
+public:
+  virtual ~lexer_input() = default;
+
+  // copy up to max_sz bytes into buf and return the count copied, or 0 at the end of the input. may throw.
+  virtual size_t read(char* buf, size_t max_sz) = 0;
+};
+
+
+// lexer input from an in-memory buffer (which must outlive the lexer)
+class buffer_input : public lexer_input {
+  std::string_view _buf;
+
+public:
+  buffer_input(std::string_view buf) : _buf(buf) {}
+
+  size_t read(char* buf, size_t max_sz) override
+  {
+    const auto n = std::min(max_sz, _buf.size());
+    std::memcpy(buf, _buf.data(), n);
+    _buf.remove_prefix(n);
+    return n;
+  }
+};
+
+
 class lexer {
   unique_file_ptr _f;
   fs::path        _path;
 
   void reset_scanner() {
     yyin = nullptr;
+    yyreader = nullptr;
+    yyreader_ctx = nullptr;
     yylineno = 0;
-    yyrestart(yyin);
+    yylex_destroy(); // the scanner's state is per-thread, so free its buffers rather than leave them to the thread
   }
 
 public:
@@ -28,6 +62,10 @@ public:
   ~lexer() noexcept { reset_scanner(); }
   lexer(const fs::path& path);
 
+  // lex the given input, which must outlive the lexer. `path` is only used to identify the input in diagnostics,
+  // and `first_line` is the line number at which the input begins (e.g., when it's an excerpt of a larger file).
+  lexer(lexer_input& input, const fs::path& path, uint first_line = 1);
+
   const auto& path() const noexcept { return _path; }
 
   // read a new token from the input into t. if max_copy_sz is nonzero, actually copy the token text buffer (capped by
@@ -0,0 +1,112 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+
+NAMESPACE_CK2;
+
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const fs::path& path)
+: _p(nullptr), _sz(0), _path(path), _h_map(nullptr)
+{
+  HANDLE h_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+
+  if (h_file == INVALID_HANDLE_VALUE)
+    throw MappedFileError(fmt::format("Failed to open file: Windows error {}", GetLastError()), path);
+
+  LARGE_INTEGER sz;
+
+  if (!GetFileSizeEx(h_file, &sz))
+  {
+    CloseHandle(h_file);
+    throw MappedFileError(fmt::format("Failed to stat file: Windows error {}", GetLastError()), path);
+  }
+
+  if ((_sz = static_cast<size_t>(sz.QuadPart)) == 0)
+  {
+    CloseHandle(h_file);
+    return;
+  }
+
+  _h_map = CreateFileMappingW(h_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(h_file); // the mapping keeps its own reference
+
+  if (_h_map == nullptr)
+    throw MappedFileError(fmt::format("Failed to map file: Windows error {}", GetLastError()), path);
+
+  if ((_p = static_cast<const uint8_t*>( MapViewOfFile(_h_map, FILE_MAP_READ, 0, 0, 0) )) == nullptr)
+  {
+    CloseHandle(_h_map);
+    throw MappedFileError(fmt::format("Failed to map file: Windows error {}", GetLastError()), path);
+  }
+}
+
+
+mapped_file::~mapped_file() noexcept
+{
+  if (_p) UnmapViewOfFile(_p);
+  if (_h_map) CloseHandle(_h_map);
+}
+
+#else
+
+mapped_file::mapped_file(const fs::path& path)
+: _p(nullptr), _sz(0), _path(path)
+{
+  const auto spath = path.generic_string();
+  const int fd = open(spath.c_str(), O_RDONLY);
+
+  if (fd < 0)
+    throw MappedFileError(fmt::format("Failed to open file: {}", strerror(errno)), path);
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0)
+  {
+    const int e = errno;
+    close(fd);
+    throw MappedFileError(fmt::format("Failed to stat file: {}", strerror(e)), path);
+  }
+
+  if ((_sz = static_cast<size_t>(st.st_size)) == 0)
+  {
+    close(fd);
+    return;
+  }
+
+  void* p = mmap(nullptr, _sz, PROT_READ, MAP_PRIVATE, fd, 0);
+  const int e = errno;
+  close(fd); // the mapping keeps its own reference
+
+  if (p == MAP_FAILED)
+    throw MappedFileError(fmt::format("Failed to map file: {}", strerror(e)), path);
+
+  _p = static_cast<const uint8_t*>(p);
+}
+
+
+mapped_file::~mapped_file() noexcept
+{
+  if (_p) munmap(const_cast<uint8_t*>(_p), _sz);
+}
+
+#endif
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,68 @@
+#ifndef LIBCK2_MAPPED_FILE_H
+#define LIBCK2_MAPPED_FILE_H
+
+#include "common.h"
+#include "filesystem.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+NAMESPACE_CK2;
+
+
+// a failure to open or map a file. what() ends with the path, as Error messages do, whereas reason() omits it for
+// callers which locate errors themselves (e.g., via FLError).
+struct MappedFileError : public PathError {
+  MappedFileError(const std::string& reason_, const fs::path& path_)
+    : PathError(fmt::format("{}: {}", reason_, path_.generic_string()), path_), _reason(reason_) {}
+
+  const auto& reason() const noexcept { return _reason; }
+
+private:
+  std::string _reason;
+};
+
+
+// read-only memory mapping of an entire file (unmapped upon destruction). an empty file maps to a null data() of
+// size() 0.
+class mapped_file {
+public:
+  mapped_file(const fs::path&);
+  ~mapped_file() noexcept;
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  mapped_file(mapped_file&& other) noexcept
+    : _p(other._p), _sz(other._sz), _path(std::move(other._path))
+#ifdef _WIN32
+    , _h_map(other._h_map)
+#endif
+  {
+    other._p = nullptr;
+    other._sz = 0;
+#ifdef _WIN32
+    other._h_map = nullptr;
+#endif
+  }
+
+  auto data()  const noexcept { return _p; }
+  auto size()  const noexcept { return _sz; }
+  auto empty() const noexcept { return _sz == 0; }
+  auto chars() const noexcept { return std::string_view(reinterpret_cast<const char*>(_p), _sz); }
+
+  const auto& path() const noexcept { return _path; }
+
+private:
+  const uint8_t* _p;
+  size_t         _sz;
+  fs::path       _path;
+#ifdef _WIN32
+  void*          _h_map;
+#endif
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,94 @@
+#ifndef LIBCK2_PARALLEL_H
+#define LIBCK2_PARALLEL_H
+
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+// number of worker threads to use when the user asks for 0 (i.e., "however many make sense")
+inline uint default_thread_count() noexcept
+{
+  auto n = std::thread::hardware_concurrency();
+  return (n > 0) ? n : 1;
+}
+
+
+// run fn(i) for every i in [0, n) upon a pool of up to n_threads threads (0 means default_thread_count()), of which
+// the calling thread is one. indices are handed out dynamically in ascending order, so callers can schedule their
+// work (e.g., largest-first) simply by sorting it beforehand, and uneven work items still balance out.
+//
+// should fn throw, no further indices are handed out, and the first exception is rethrown once all threads have
+// joined. callers which want per-item error reporting should catch within fn. should a thread fail to start, the
+// work is simply shared among those which did (at worst, only the calling thread).
+template<typename F>
+void parallel_for(size_t n, F&& fn, uint n_threads = 0)
+{
+  if (n == 0)
+    return;
+
+  if (n_threads == 0)
+    n_threads = default_thread_count();
+
+  n_threads = static_cast<uint>( std::min<size_t>(n_threads, n) );
+
+  std::atomic<size_t> next_idx(0);
+  std::atomic<bool>   failed(false);
+  std::exception_ptr  p_exc;
+  std::mutex          exc_mutex;
+
+  auto work = [&]()
+  {
+    for (size_t i; !failed.load(std::memory_order_relaxed) && (i = next_idx.fetch_add(1)) < n; )
+    {
+      try
+      {
+        fn(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(exc_mutex);
+
+        if (!p_exc)
+          p_exc = std::current_exception();
+
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+
+  for (uint t = 1; t < n_threads; ++t)
+  {
+    try
+    {
+      threads.emplace_back(work);
+    }
+    catch (const std::system_error&)
+    {
+      break;
+    }
+  }
+
+  work();
+
+  for (auto& t : threads)
+    t.join();
+
+  if (p_exc)
+    std::rethrow_exception(p_exc);
+}
+
+
+NAMESPACE_CK2_END;
+#endif
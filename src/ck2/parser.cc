@@ -1,8 +1,10 @@
 
 #include "parser.h"
 #include "token.h"
+#include "keyword.h"
 
 #include <iomanip>
+#include <type_traits>
 #include <ctype.h>
 
 
@@ -13,18 +15,29 @@ struct binary_op_text
 {
   const char* text;
   binary_op op;
+  uint16_t  kw; // keyword ID, as tagged onto OPERATOR tokens by the lexer
 };
 
 const binary_op_text BINOP_TBL[] = {
-  { "=",  binary_op::EQ },
-  { "<",  binary_op::LT },
-  { ">",  binary_op::GT },
-  { "<=", binary_op::LTE },
-  { ">=", binary_op::GTE },
-  { "==", binary_op::EQ2 },
+  { "=",  binary_op::EQ,  keyword::OP_EQ },
+  { "<",  binary_op::LT,  keyword::OP_LT },
+  { ">",  binary_op::GT,  keyword::OP_GT },
+  { "<=", binary_op::LTE, keyword::OP_LTE },
+  { ">=", binary_op::GTE, keyword::OP_GTE },
+  { "==", binary_op::EQ2, keyword::OP_EQ2 },
 };
 
 
+const char* to_string(binary_op op) noexcept
+{
+  for (auto const& bop : BINOP_TBL)
+    if (bop.op == op)
+      return bop.text;
+
+  return "=";
+}
+
+
 block::block(parser& prs, bool is_root, bool is_save)
 {
   token t;
@@ -35,12 +48,18 @@ block::block(parser& prs, bool is_root, bool is_save)
     prs.next_expected(&t, token::STR);
   }
 
+  // our body begins just past our opening brace (or the start of the file / savegame header)
+  _span.begin = _tail = prs._last_end;
+
   while (true)
   {
     prs.next(&t, is_root);
 
     if (t.type() == token::END)
+    {
+      _span.end = t.span().begin;
       return;
+    }
 
     if (t.type() == token::CLOSE)
     {
@@ -48,9 +67,12 @@ block::block(parser& prs, bool is_root, bool is_save)
         throw prs.err("Unmatched closing brace");
 
       // otherwise, they mean it's time return to the previous block
+      _span.end = t.span().begin;
       return;
     }
 
+    const auto key_begin = t.span().begin;
+
     object key;
 
     if (t.type() == token::STR)
@@ -69,7 +91,7 @@ block::block(parser& prs, bool is_root, bool is_save)
 
     for (auto const& bop : BINOP_TBL)
     {
-      if (strcmp(t.text(), bop.text) == 0)
+      if (t.kw() == bop.kw)
       {
         op = object{ bop.op, t.loc() };
         break;
@@ -90,8 +112,12 @@ block::block(parser& prs, bool is_root, bool is_save)
         // FIXME: optimize: empty blocks are a waste of memory and cycles and ambiguous with empty lists, so add
         // a static object type (i.e., one of the possible dynamic types for ck2::object) that codifies an empty
         // block OR list (vector syntax nodes, essentially)
+        const auto body_begin = t.span().end;
         prs.next(&t); // suspicions confirmed, consume token
-        val = object{ std::make_shared<block>(), t.loc() };
+        auto p_blk = std::make_shared<block>();
+        p_blk->_span = src_span{ body_begin, t.span().begin };
+        p_blk->_tail = body_begin;
+        val = object{ std::move(p_blk), t.loc() };
       }
       // all but an operator in this position implies this will be a list
       else if (pt2 && pt2->type() != token::OPERATOR)
@@ -110,15 +136,60 @@ block::block(parser& prs, bool is_root, bool is_save)
     else
       prs.unexpected_token(t);
 
-    _v.emplace_back(key, op, val);
+    auto& stmt = _v.emplace_back(std::move(key), std::move(op), std::move(val));
+    stmt._lead = _tail;
+    stmt._span = src_span{ key_begin, prs._last_end };
+    _tail = prs._last_end;
 
-    if (key.is_string())
-      _map[key.as_string()] = _v.size() - 1;
+    if (stmt.key().is_string())
+      _map[stmt.key().as_string()] = _v.size() - 1;
   }
 }
 
 
+static_assert(std::is_nothrow_move_constructible_v<statement>,
+              "statement must be nothrow-movable, else block's hash-map keys dangle when its vector reallocates");
+
+
+void block::reindex()
+{
+  for (vec::difference_type i = 0; i < static_cast<vec::difference_type>(_v.size()); ++i)
+    if (_v[i].key().is_string())
+      _map[_v[i].key().as_string()] = i;
+}
+
+
+void block::push_back(const statement& s)
+{
+  _v.push_back(s);
+
+  if (_v.back().key().is_string())
+    _map[_v.back().key().as_string()] = _v.size() - 1;
+}
+
+
+void block::push_back(statement&& s)
+{
+  _v.push_back(std::move(s));
+
+  if (_v.back().key().is_string())
+    _map[_v.back().key().as_string()] = _v.size() - 1;
+}
+
+
+block::vec::iterator block::erase(vec::const_iterator pos)
+{
+  // the erased key might still occur earlier in the block, and every statement past it shifts down by one, so
+  // the simplest correct thing is to rebuild the hash-map (erasing statements is rare relative to lookups).
+  auto it = _v.erase(pos);
+  _map.clear();
+  reindex();
+  return it;
+}
+
+
 list::list(parser& prs)
+: _dirty(false)
 {
   token t;
 
@@ -165,7 +236,7 @@ bool parser::next(token* p_tok, bool eof_ok)
     if (_tq_done) return false;
 
     // nothing in queue and not done, so read directly from scanner buffer into p_tok (avoids token text copy)
-    _tq_done = !( _lex.read_token_into(*p_tok) );
+    _tq_done = !( _lex->read_token_into(*p_tok) );
   }
   else
   {
@@ -183,6 +254,8 @@ bool parser::next(token* p_tok, bool eof_ok)
     --_tq_n;
   }
 
+  _last_end = p_tok->span().end;
+
   if (p_tok->type() == token::END && !eof_ok)
     throw err(p_tok->loc(), "Unexpected EOF");
 
@@ -275,7 +348,7 @@ object& object::operator=(const object& other)
 }
 
 
-object& object::operator=(object&& other) {
+object& object::operator=(object&& other) noexcept {
   if (this == &other) return *this; // no self-assignment
 
   /* destroy our current resources, then move resources from other, and return new self */
@@ -320,7 +393,7 @@ void statement::print(std::ostream& os, uint indent) const
 {
   os << std::setfill(' ') << std::setw(indent) << "";
   _k.print(os, indent);
-  os << " = "; // FIXME: need the string representation of the actual operator type since we now have many
+  os << ' ' << ((_op.is_binary_op()) ? to_string(_op.as_binary_op()) : "=") << ' ';
   _v.print(os, indent);
   os << std::endl;
 }
@@ -12,6 +12,7 @@
 #include <ostream>
 #include <memory>
 #include <algorithm>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -39,6 +40,8 @@ enum class binary_op
   EQ2, // ==
 };
 
+const char* to_string(binary_op) noexcept;
+
 
 /* OBJECT -- generic "any"-type syntax tree node */
 
@@ -145,10 +148,12 @@ public:
   object(const object& other);
 
   /* move-assignment operator */
-  object& operator=(object&& other);
+  object& operator=(object&& other) noexcept;
 
-  /* move-constructor (implemented via move-assignment) */
-  object(object&& other) : object() { *this = std::move(other); }
+  /* move-constructor (implemented via move-assignment). it's important that this is noexcept, as otherwise STL
+   * containers (e.g., block's statement vector) will copy rather than move us upon reallocation, and that would
+   * invalidate the string keys to which block's hash-map points. */
+  object(object&& other) noexcept : object() { *this = std::move(other); }
 
   /* destructor */
   ~object() { destroy(); }
@@ -214,32 +219,39 @@ class list {
   using VecT = std::vector<ElemT>;
   VecT _v;
 
+  /* we don't track the source spans of individual list elements, so any mutable access to the list's elements
+   * conservatively marks the whole list as dirty (i.e., it will be reserialized by a round-trip writer rather than
+   * copied verbatim from its source). iterate via a const list to avoid that. */
+  bool _dirty;
+
 public:
-  list() {}
+  list() : _dirty(false) {}
   list(parser&);
 
   auto size()   const noexcept { return _v.size(); }
   auto empty()  const noexcept { return _v.size() == 0; }
   auto begin()  const noexcept { return _v.cbegin(); }
   auto end()    const noexcept { return _v.cend(); }
-  auto begin()        noexcept { return _v.begin(); }
-  auto end()          noexcept { return _v.end(); }
+  auto begin()        noexcept { _dirty = true; return _v.begin(); }
+  auto end()          noexcept { _dirty = true; return _v.end(); }
   auto rbegin() const noexcept { return _v.crbegin(); }
   auto rend()   const noexcept { return _v.crend(); }
-  auto rbegin()       noexcept { return _v.rbegin(); }
-  auto rend()         noexcept { return _v.rend(); }
+  auto rbegin()       noexcept { _dirty = true; return _v.rbegin(); }
+  auto rend()         noexcept { _dirty = true; return _v.rend(); }
 
   /* do we even need to say auto& (by ref) here when that could be inferred directly from the return-expr? */
   auto& operator[](size_t i) const noexcept { return _v[i]; }
-  auto& operator[](size_t i)       noexcept { return _v[i]; }
+  auto& operator[](size_t i)       noexcept { _dirty = true; return _v[i]; }
 
-  void push_back(const ElemT& e) { _v.push_back(e); }
-  void push_back(ElemT&& e) { _v.push_back(std::move(e)); }
-  void pop_back() noexcept { _v.pop_back(); }
-  void clear() noexcept { _v.clear(); }
+  void push_back(const ElemT& e) { _dirty = true; _v.push_back(e); }
+  void push_back(ElemT&& e) { _dirty = true; _v.push_back(std::move(e)); }
+  void pop_back() noexcept { _dirty = true; _v.pop_back(); }
+  void clear() noexcept { _dirty = true; _v.clear(); }
 
-  template<typename It> auto erase(It pos) { return _v.erase(pos); }
-  template<typename It> auto erase(It first, It last) { return _v.erase(first, last); }
+  template<typename It> auto erase(It pos) { _dirty = true; return _v.erase(pos); }
+  template<typename It> auto erase(It first, It last) { _dirty = true; return _v.erase(first, last); }
+
+  bool dirty() const noexcept { return _dirty; }
 
   void print(std::ostream&, uint indent = 0) const;
 };
@@ -249,9 +261,13 @@ public:
 
 class statement {
 public:
-  statement() : _op(binary_op::EQ) {}
-  statement(const object& k, const object& op, const object& v) : _k(k), _op(op), _v(v) {}
+  statement() : _op(binary_op::EQ), _lead(src_span::NONE), _dirty(false) {}
+  statement(const object& k, const object& op, const object& v)
+  : _k(k), _op(op), _v(v), _lead(src_span::NONE), _dirty(false) {}
   statement(const object& k, const object& v) : statement(k, binary_op::EQ, v) {}
+  statement(object&& k, object&& op, object&& v) noexcept
+  : _k(std::move(k)), _op(std::move(op)), _v(std::move(v)), _lead(src_span::NONE), _dirty(false) {}
+  statement(object&& k, object&& v) noexcept : statement(std::move(k), object{ binary_op::EQ }, std::move(v)) {}
 
   // TODO: move-assign, move-ctor (with correct noexcept specifications so that STL will use them)
 
@@ -265,19 +281,34 @@ public:
   auto& op()    const noexcept { return _op; }
   auto& value() const noexcept { return _v; }
 
+  /* setters mark the statement as dirty, i.e. no longer faithfully represented by its source span. (the key setter
+   * isn't public, because it would invalidate the hash-map of the block which contains us.) */
+  void op(const object& o)        { _op = o; _dirty = true; }
+  void value(const object& o)     { _v = o; _dirty = true; }
+  void op(object&& o)    noexcept { _op = std::move(o); _dirty = true; }
+  void value(object&& o) noexcept { _v = std::move(o); _dirty = true; }
+
+  /* source extent: span() covers the statement itself (from key to the end of its value, incl. any closing brace),
+   * while lead() is the offset at which the comments & whitespace which precede it begin. both are null/NONE for
+   * statements which weren't parsed. */
+  auto& span()  const noexcept { return _span; }
+  auto  lead()  const noexcept { return _lead; }
+  bool  dirty() const noexcept { return _dirty; }
+
   void print(std::ostream&, uint indent = 0) const;
 
 protected:
-  object _k;
-  object _op;
-  object _v;
-
-  void key(const object& o)       { _k = o; }
-  void op(const object& o)        { _op = o; }
-  void value(const object& o)     { _v = o; }
-  void key(object&& o)   noexcept { _k = std::move(o); }
-  void op(object&& o)    noexcept { _op = std::move(o); }
-  void value(object&& o) noexcept { _v = std::move(o); }
+  friend class block;
+
+  object   _k;
+  object   _op;
+  object   _v;
+  uint     _lead;
+  src_span _span;
+  bool     _dirty;
+
+  void key(const object& o)       { _k = o; _dirty = true; }
+  void key(object&& o)   noexcept { _k = std::move(o); _dirty = true; }
 };
 
 
@@ -313,8 +344,16 @@ protected:
   // hash-map of LHS keys to their corresponding statement's index in _vec
   std::unordered_map<cstr, vec::difference_type> _map;
 
+  // source extent of the block's body (i.e., just past its opening brace to just before its closing brace, or the
+  // whole file for a root block) and the offset at which the comments & whitespace trailing its final statement
+  // begin. null/NONE if the block wasn't parsed.
+  src_span _span;
+  uint     _tail;
+
+  void reindex();
+
 public:
-  block() { }
+  block() : _tail(src_span::NONE) { }
   block(parser&, bool is_root = false, bool is_save = false);
 
   void print(std::ostream&, uint indent = 0) const;
@@ -344,6 +383,14 @@ public:
     auto i = _map.find(key);
     return (i != _map.end()) ? std::next(begin(), i->second) : end();
   }
+
+  /* mutators (the key hash-map is kept consistent) */
+  void push_back(const statement&);
+  void push_back(statement&&);
+  vec::iterator erase(vec::const_iterator pos);
+
+  auto& span() const noexcept { return _span; }
+  auto  tail() const noexcept { return _tail; }
 };
 
 
@@ -356,25 +403,46 @@ public:
   parser(const fs::path& path,    bool is_save = false) : parser(path.generic_string().c_str(), is_save) {}
 
   parser(const char* path, bool is_save = false)
-  : _lex(path)
+  : _path(path)
+  , _lex(std::in_place, path)
+  , _last_end(0)
   , _tq_done(false)
   , _tq_head_idx(0)
   , _tq_n(0)
   {
-    // hook our preallocated token text buffers into the lookahead queue
-    for (uint i = 0; i < TQ_SZ; ++i)
-    {
-      _tq_text[i][0] = '\0';
-      _tq[i].text(_tq_text[i], 0);
-    }
+    parse(is_save);
+  }
 
-    _p_root = std::make_shared<block>(*this, true, is_save);
+  // parse from a pull-based input source rather than a file (`path` then only identifies the input in diagnostics).
+  // the input is only used during construction. `first_line` is the line number at which the input begins.
+  parser(lexer_input& input, const fs::path& path, bool is_save = false, uint first_line = 1)
+  : _path(path)
+  , _lex(std::in_place, input, path, first_line)
+  , _last_end(0)
+  , _tq_done(false)
+  , _tq_head_idx(0)
+  , _tq_n(0)
+  {
+    parse(is_save);
   }
 
-  auto& root_block()       noexcept { return _p_root; }
-  auto& root_block() const noexcept { return _p_root; }
+  // share the tree of another parser whose input was identical to this file's (e.g., the same file copied into
+  // several mods) rather than parse it again. only the path differs, so that diagnostics name this file. as the
+  // tree is then reachable through both parsers, share it only among const parsers (whose root_block() is const).
+  parser(const parser& other, const fs::path& path)
+  : _p_root(other._p_root)
+  , _path(path)
+  , _last_end(0)
+  , _tq_done(true)
+  , _tq_head_idx(0)
+  , _tq_n(0)
+  {
+  }
 
-  const auto& path() const noexcept { return _lex.path(); }
+  auto& root_block() noexcept { return _p_root; }
+  std::shared_ptr<const block> root_block() const noexcept { return _p_root; }
+
+  const auto& path() const noexcept { return _path; }
 
   auto floc(const Location& loc) const noexcept { return FLoc(path(), loc); }
   auto floc(const object& obj)   const noexcept { return FLoc(path(), obj.loc()); }
@@ -402,8 +470,26 @@ protected:
   friend class block;
   friend class list;
 
+  void parse(bool is_save)
+  {
+    // hook our preallocated token text buffers into the lookahead queue
+    for (uint i = 0; i < TQ_SZ; ++i)
+    {
+      _tq_text[i][0] = '\0';
+      _tq[i].text(_tq_text[i], 0);
+    }
+
+    _p_root = std::make_shared<block>(*this, true, is_save);
+
+    // the scanner's state is per-thread, so release the lexer on the parsing thread rather than whichever thread
+    // happens to drop the parser
+    _lex.reset();
+  }
+
   std::shared_ptr<block> _p_root;
-  lexer _lex;
+  fs::path _path;
+  std::optional<lexer> _lex; // only while parsing
+  uint  _last_end; // source offset just past the token most recently returned by next()
 
   static const uint NUM_LOOKAHEAD_TOKENS = 1;
   // actual token queue size is +1 for the "freebie" lookahead token (the next/current token) and +1 for a "spare"
@@ -423,7 +509,7 @@ protected:
   void enqueue_token()
   {
     uint slot = (_tq_head_idx + _tq_n++) % TQ_SZ;
-    _tq_done = !( _lex.read_token_into(_tq[slot], TEXT_MAX_SZ) );
+    _tq_done = !( _lex->read_token_into(_tq[slot], TEXT_MAX_SZ) );
   }
 
   // fill the token queue such that its effective size is at least `sz`. returns false if that couldn't be satisfied.
@@ -0,0 +1,157 @@
+
+#include "prov_bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+  #include <emmintrin.h>
+#endif
+
+#include "BMPHeader.h"
+#include "Color.h"
+#include "DefaultMap.h"
+#include "DefinitionsTable.h"
+#include "FileLocation.h"
+#include "ProvMap.h"
+#include "VFS.h"
+
+
+NAMESPACE_CK2;
+
+
+namespace {
+  mapped_file map_bitmap(const fs::path& path)
+  {
+    try
+    {
+      return mapped_file(path);
+    }
+    catch (const MappedFileError& e) // (as "<path>: Failed to open file: <reason>", not naming the path twice)
+    {
+      throw FLError(FLoc(path), "{}", e.reason());
+    }
+  }
+}
+
+
+prov_bitmap::prov_bitmap(const VFS& vfs, const DefaultMap& dm, const DefinitionsTable& def_tbl)
+: _mf(map_bitmap(vfs["map" / dm.province_map_path()])),
+  _p_bitmap(nullptr),
+  _row_sz(0),
+  _cols(0),
+  _rows(0)
+{
+  /* map provinces.bmp color to province ID. should definition.csv repeat a color, the first province w/ it
+   * keeps it. white & black are reserved, overriding any definitions. */
+  for (const auto& row : def_tbl)
+    if (_color2id[row.color] == color_lut::NONE)
+      _color2id.set(row.color, row.id);
+
+  _color2id.set(RGB(0xFF, 0xFF, 0xFF), ProvMap::PM_OCEAN);
+  _color2id.set(RGB(0x00, 0x00, 0x00), ProvMap::PM_IMPASSABLE);
+
+  const auto& mf = _mf;
+  const auto ferr = FLErrorStaticFactory(FLoc(path()));
+
+  if (mf.size() < sizeof(BMPHeader))
+    throw ferr("Unexpected EOF while reading bitmap file header (file corruption)");
+
+  /* the header is validated in place (it's packed, so it may be read at any alignment) */
+  const auto& bf_hdr = *reinterpret_cast<const BMPHeader*>(mf.data());
+
+  if (bf_hdr.magic != BMPHeader::MAGIC)
+    throw ferr("Unsupported bitmap file type (magic=0x{:04X} but want magic=0x{:04X})",
+           bf_hdr.magic, BMPHeader::MAGIC);
+
+  if (bf_hdr.n_header_size < 40)
+    throw ferr("Format unsupported: DIB header size is {} bytes but need at least 40", bf_hdr.n_header_size);
+
+  if (bf_hdr.n_width <= 0)
+    throw ferr("Format unsupported: Expected positive image width, found {}", bf_hdr.n_width);
+
+  if (bf_hdr.n_height <= 0)
+    throw ferr("Format unsupported: Expected positive image height, found {}", bf_hdr.n_height);
+
+  if (bf_hdr.n_planes != 1)
+    throw ferr("Format unsupported: Should only be 1 image plane, found {}", bf_hdr.n_planes);
+
+  if (bf_hdr.n_bpp != 24)
+    throw ferr("Format unsupported: Need 24bpp color but found {}", bf_hdr.n_bpp);
+
+  if (bf_hdr.compression_type != 0)
+    throw ferr("Format unsupported: Found unsupported compression type #{}", bf_hdr.compression_type);
+
+  if (bf_hdr.n_colors != 0)
+    throw ferr("Format unsupported: Image shouldn't be paletted, but {} colors were specified",
+           bf_hdr.n_colors);
+
+  assert( bf_hdr.n_important_colors == 0 );
+
+  _cols = bf_hdr.n_width;
+  _rows = bf_hdr.n_height;
+
+  /* calculate row size with 32-bit alignment padding */
+  const size_t row_sz = 4 * ((size_t(bf_hdr.n_bpp) * _cols + 31) / 32);
+  const size_t bitmap_sz = row_sz * _rows;
+
+  if (bf_hdr.n_bitmap_size != 0 && bf_hdr.n_bitmap_size != bitmap_sz)
+    throw ferr("File corruption: Raw bitmap data section should be {} bytes but {} were specified",
+           bitmap_sz, bf_hdr.n_bitmap_size);
+
+  if (bf_hdr.n_bitmap_offset > mf.size() || mf.size() - bf_hdr.n_bitmap_offset < bitmap_sz)
+    throw ferr("Unexpected EOF while reading bitmap data");
+
+  _p_bitmap = mf.data() + bf_hdr.n_bitmap_offset;
+  _row_sz = row_sz;
+}
+
+
+uint prov_bitmap::run_length(const uint8_t* p_row, uint x, uint cols) noexcept
+{
+  const uint8_t* const p = &p_row[3*x];
+  uint end = x + 1;
+
+#ifdef __SSE2__
+  /* compare 16 pixels (48 bytes) at a time against the run's color repeated 16 times. as 48 is a multiple of
+   * 3, the repeated color lines up with the pixels at every step. */
+  if (x + 17 <= cols)
+  {
+    alignas(16) uint8_t pat[48];
+    std::memcpy(pat, p, 3);
+    for (uint n = 3; n < 48; n *= 2) std::memcpy(pat + n, pat, std::min(n, 48 - n));
+
+    const __m128i pat0 = _mm_load_si128(reinterpret_cast<const __m128i*>(pat));
+    const __m128i pat1 = _mm_load_si128(reinterpret_cast<const __m128i*>(pat + 16));
+    const __m128i pat2 = _mm_load_si128(reinterpret_cast<const __m128i*>(pat + 32));
+
+    for (; end + 16 <= cols; end += 16)
+    {
+      auto q = reinterpret_cast<const __m128i*>(&p_row[3*end]);
+      const __m128i eq = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(q), pat0),
+                                                     _mm_cmpeq_epi8(_mm_loadu_si128(q + 1), pat1)),
+                                       _mm_cmpeq_epi8(_mm_loadu_si128(q + 2), pat2));
+
+      if (_mm_movemask_epi8(eq) != 0xFFFF)
+        break; // the run ends within these 16 pixels, which are left to the scalar loop
+    }
+  }
+#endif
+
+  for (; end < cols && p_row[3*end] == p[0] && p_row[3*end + 1] == p[1] && p_row[3*end + 2] == p[2]; ++end)
+    ;
+
+  return end - x;
+}
+
+
+void prov_bitmap::throw_bad_pixel(const bad_pixel& bp) const
+{
+  const uint8_t* const p = _p_bitmap + size_t(_rows - 1 - bp.y) * _row_sz + 3 * bp.x;
+
+  throw FLError(FLoc(path()), "Unexpected color RGB({}, {}, {}) in provinces bitmap at pixel ({}, {})",
+                p[2], p[1], p[0], bp.x, bp.y);
+}
+
+
+NAMESPACE_CK2_END;
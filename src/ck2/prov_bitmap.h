@@ -0,0 +1,101 @@
+#ifndef LIBCK2_PROV_BITMAP_H
+#define LIBCK2_PROV_BITMAP_H
+
+#include "common.h"
+#include "color_lut.h"
+#include "filesystem.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+class DefaultMap;
+class DefinitionsTable;
+class VFS;
+
+
+/* PROV_BITMAP -- provinces.bmp, memory-mapped & validated, from which the province map representations
+ * (ProvMap, ProvMapRLE) are built
+ *
+ * scan(...) resolves the bitmap's pixels to province IDs a run of same-colored pixels at a time: scanlines are
+ * converted in parallel bands of BAND_ROWS rows, runs are found w/ SIMD comparisons, and each run costs a
+ * single color lookup. should a color be undefined, the error reported is for its first pixel in file order,
+ * just as with a serial scan.
+ */
+
+class prov_bitmap {
+public:
+  static constexpr uint BAND_ROWS = 32;
+
+  prov_bitmap(const VFS&, const DefaultMap&, const DefinitionsTable&);
+
+  const auto& path()   const noexcept { return _mf.path(); }
+  auto        width()  const noexcept { return _cols; }
+  auto        height() const noexcept { return _rows; }
+
+  // call on_run(y, x, n, id) for each run of n pixels w/ the province ID id starting at (x, y), where y counts
+  // from the top. within a row, runs are visited in order, but rows in different bands are visited
+  // concurrently. n_threads = 0 means one per hardware thread.
+  template<typename F>
+  void scan(F&& on_run, uint n_threads = 0) const
+  {
+    const uint n_bands = (_rows + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<bad_pixel> bad_pixels(n_bands);
+
+    parallel_for(n_bands, [&](size_t band)
+    {
+      const uint row_end = std::min<uint>(_rows, (band + 1) * BAND_ROWS);
+
+      for (uint row = band * BAND_ROWS; row < row_end; ++row)
+      {
+        const uint8_t* const p_row = _p_bitmap + row * _row_sz;
+        const uint y = _rows - 1 - row; // scanlines are stored in bottom-to-top order
+
+        for (uint x = 0; x < _cols; )
+        {
+          const prov_id_t id = _color2id[color_lut::key_bgr(&p_row[3*x])];
+
+          if (id == color_lut::NONE)
+          {
+            bad_pixels[band] = { true, x, y };
+            return;
+          }
+
+          const uint n = run_length(p_row, x, _cols);
+          on_run(y, x, n, id);
+          x += n;
+        }
+      }
+    }, n_threads);
+
+    for (const auto& bp : bad_pixels)
+      if (bp.found)
+        throw_bad_pixel(bp);
+  }
+
+private:
+  struct bad_pixel {
+    bool found = false;
+    uint x = 0;
+    uint y = 0;
+  };
+
+  // the length of the run of pixels of the same color starting at column x of a 24bpp scanline of cols pixels
+  static uint run_length(const uint8_t* p_row, uint x, uint cols) noexcept;
+
+  [[noreturn]] void throw_bad_pixel(const bad_pixel&) const;
+
+  mapped_file    _mf;
+  color_lut      _color2id;
+  const uint8_t* _p_bitmap;
+  size_t         _row_sz;
+  uint           _cols;
+  uint           _rows;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -0,0 +1,512 @@
+
+#include "query.h"
+#include "parallel.h"
+#include "strutil.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+
+NAMESPACE_CK2;
+
+
+/* COMPILED FORM */
+
+struct query::step {
+  struct literal {
+    enum { DATE, NUMBER, STRING } type = STRING;
+    date        d;
+    fp3         f = fp3(0);
+    std::string s;
+  };
+
+  struct pred {
+    enum { VALUE, KEY, CHILD } subject;
+    enum { EQ, NE, LT, LTE, GT, GTE, RANGE, EXISTS } op;
+    std::string child_key; // for CHILD
+    literal     lo;        // the operand (or the range's low end)
+    literal     hi;        // the range's high end
+  };
+
+  enum { DESCENDANT, ANY, EXACT, GLOB } kind;
+  std::string       key;
+  bool              key_may_be_scalar; // EXACT key which may name an integer/date key (unindexed by find_key)
+  std::vector<pred> preds;
+};
+
+
+query::~query() noexcept = default;
+query::query(query&&) noexcept = default;
+query& query::operator=(query&&) noexcept = default;
+
+
+/* COMPILATION */
+
+namespace {
+
+std::string_view trim(std::string_view s) noexcept
+{
+  while (!s.empty() && isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+  while (!s.empty() && isspace(static_cast<unsigned char>(s.back())))  s.remove_suffix(1);
+  return s;
+}
+
+
+bool all_digits(std::string_view s) noexcept
+{
+  return !s.empty() && std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+
+// a number or date key as it'd be written in script, for matching against key patterns
+std::string key_text(const object& k)
+{
+  if (k.is_string())  return k.as_string();
+  if (k.is_integer()) return std::to_string(k.as_integer());
+  if (k.is_date())
+    return fmt::format("{}.{}.{}", k.as_date().year(), k.as_date().month(), k.as_date().day());
+
+  std::ostringstream os;
+  k.print(os);
+  return os.str();
+}
+
+}
+
+
+class query::compiler {
+  using literal = step::literal;
+  using pred = step::pred;
+
+  std::string_view _expr;
+
+  template<typename... Args>
+  [[noreturn]] void fail(const char* format, Args&& ...args) const
+  {
+    throw Error("Malformed query '{}': {}", _expr, fmt::format(format, std::forward<Args>(args)...));
+  }
+
+  literal parse_literal(std::string_view s) const
+  {
+    s = trim(s);
+
+    if (s.empty())
+      fail("missing literal");
+
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"')
+      return literal{ literal::STRING, date(), fp3(0), std::string(s.substr(1, s.size() - 2)) };
+
+    const std::string_view digits = (s.front() == '-') ? s.substr(1) : s;
+    const size_t dot1 = digits.find('.');
+
+    if (dot1 == std::string_view::npos)
+    {
+      if (all_digits(digits))
+        return literal{ literal::NUMBER, date(), fp3(atoi(std::string(s).c_str())), std::string() };
+    }
+    else if (const size_t dot2 = digits.find('.', dot1 + 1); dot2 == std::string_view::npos)
+    {
+      const auto frac = digits.substr(dot1 + 1);
+
+      if (all_digits(digits.substr(0, dot1)) && (frac.empty() || all_digits(frac)))
+      {
+        std::string buf(s);
+        return literal{ literal::NUMBER, date(), fp3(buf.data()), std::string() };
+      }
+    }
+    else if (all_digits(digits.substr(0, dot1)) && all_digits(digits.substr(dot1 + 1, dot2 - dot1 - 1)) &&
+             all_digits(digits.substr(dot2 + 1)))
+    {
+      std::string buf(s);
+      return literal{ literal::DATE, date(buf.data()), fp3(0), std::string() };
+    }
+
+    return literal{ literal::STRING, date(), fp3(0), std::string(s) };
+  }
+
+  // parse "<op> <literal>" or "<literal>..<literal>" into p
+  void parse_condition(pred& p, std::string_view s) const
+  {
+    s = trim(s);
+
+    static const std::pair<const char*, decltype(pred::op)> s_ops[] = {
+      { "!=", pred::NE }, { "<=", pred::LTE }, { ">=", pred::GTE }, { "==", pred::EQ },
+      { "=", pred::EQ },  { "<", pred::LT },   { ">", pred::GT },
+    };
+
+    for (const auto& [tok, op] : s_ops)
+      if (s.compare(0, strlen(tok), tok) == 0)
+      {
+        p.op = op;
+        p.lo = parse_literal(s.substr(strlen(tok)));
+        return;
+      }
+
+    const size_t dots = s.find("..");
+
+    if (dots == std::string_view::npos)
+      fail("expected a comparison or a range in '{}'", s);
+
+    p.op = pred::RANGE;
+    p.lo = parse_literal(s.substr(0, dots));
+    p.hi = parse_literal(s.substr(dots + 2));
+
+    if (p.lo.type != p.hi.type || p.lo.type == literal::STRING)
+      fail("range '{}' must be between two numbers or two dates", s);
+  }
+
+  pred parse_pred(std::string_view s) const
+  {
+    pred p{ pred::VALUE, pred::EXISTS, std::string(), literal{}, literal{} };
+    s = trim(s);
+
+    if (s.empty())
+      fail("empty predicate");
+
+    if (s.front() == '@')
+    {
+      p.subject = pred::KEY;
+      parse_condition(p, s.substr(1));
+      return p;
+    }
+
+    if (strchr("=!<>", s.front()))
+    {
+      parse_condition(p, s);
+      return p;
+    }
+
+    // either a bare range on the value, or a child key optionally followed by a condition
+    size_t n = 0;
+    while (n < s.size() && !isspace(static_cast<unsigned char>(s[n])) && !strchr("=!<>", s[n])) ++n;
+
+    const auto head = s.substr(0, n);
+    const auto rest = trim(s.substr(n));
+
+    if (rest.empty() && head.find("..") != std::string_view::npos)
+    {
+      parse_condition(p, head);
+      return p;
+    }
+
+    p.subject = pred::CHILD;
+    p.child_key = std::string(head);
+
+    if (!rest.empty())
+      parse_condition(p, rest);
+
+    return p;
+  }
+
+  step parse_step(std::string_view s) const
+  {
+    step st{ step::EXACT, std::string(), false, {} };
+    s = trim(s);
+
+    if (s.empty())
+      fail("empty step");
+
+    if (s == "**")
+    {
+      st.kind = step::DESCENDANT;
+      return st;
+    }
+
+    // the key pattern, which may be quoted
+    size_t n;
+
+    if (s.front() == '"')
+    {
+      n = s.find('"', 1);
+      if (n == std::string_view::npos) fail("unterminated quote in '{}'", s);
+      st.key = std::string(s.substr(1, n - 1));
+      ++n;
+    }
+    else
+    {
+      n = std::min(s.find('['), s.size());
+      st.key = std::string(trim(s.substr(0, n)));
+
+      if (st.key.empty())
+        fail("missing key in step '{}'", s);
+
+      if (st.key == "*")
+        st.kind = step::ANY;
+      else if (st.key.find_first_of("*?") != std::string::npos)
+        st.kind = step::GLOB;
+    }
+
+    if (st.kind == step::EXACT)
+      st.key_may_be_scalar = (st.key.front() == '-' || isdigit(static_cast<unsigned char>(st.key.front())));
+
+    // predicates
+    for (s = trim(s.substr(n)); !s.empty(); s = trim(s))
+    {
+      if (s.front() != '[')
+        fail("unexpected '{}' after key", s);
+
+      size_t end = 1;
+      for (bool quoted = false; end < s.size() && (quoted || s[end] != ']'); ++end)
+        if (s[end] == '"') quoted = !quoted;
+
+      if (end == s.size())
+        fail("unterminated predicate in '{}'", s);
+
+      st.preds.push_back(parse_pred(s.substr(1, end - 1)));
+      s.remove_prefix(end + 1);
+    }
+
+    return st;
+  }
+
+public:
+  compiler(std::string_view expr) : _expr(expr) {}
+
+  std::vector<step> compile() const
+  {
+    std::vector<step> steps;
+    size_t start = 0;
+    int depth = 0;
+    bool quoted = false;
+
+    for (size_t i = 0; i <= _expr.size(); ++i)
+    {
+      const char c = (i < _expr.size()) ? _expr[i] : '/';
+
+      if (c == '"') quoted = !quoted;
+      else if (!quoted && c == '[') ++depth;
+      else if (!quoted && c == ']') --depth;
+      else if (!quoted && depth == 0 && c == '/')
+      {
+        auto st = parse_step(_expr.substr(start, i - start));
+
+        // consecutive "**" steps are redundant (& would produce duplicate matches)
+        if (st.kind != step::DESCENDANT || steps.empty() || steps.back().kind != step::DESCENDANT)
+          steps.push_back(std::move(st));
+
+        start = i + 1;
+      }
+    }
+
+    if (quoted || depth != 0)
+      fail("unbalanced quotes or brackets");
+
+    // a trailing "**" means every statement at any depth below
+    if (steps.back().kind == step::DESCENDANT)
+      steps.push_back(step{ step::ANY, "*", false, {} });
+
+    return steps;
+  }
+};
+
+
+query::query(std::string_view expr)
+: _text(expr)
+, _steps(compiler(expr).compile())
+{
+}
+
+
+/* MATCHING */
+
+class query::matcher {
+  using literal = step::literal;
+  using pred = step::pred;
+
+  const std::vector<step>& _steps;
+  const std::function<void(const statement&)>& _emit;
+
+  // three-way comparison of an object with a literal. returns false if they aren't comparable.
+  static bool compare(const object& o, const literal& l, int* p_cmp) noexcept
+  {
+    switch (l.type)
+    {
+      case literal::DATE:
+        if (!o.is_date()) return false;
+        *p_cmp = (o.as_date() < l.d) ? -1 : (l.d < o.as_date()) ? 1 : 0;
+        return true;
+
+      case literal::NUMBER:
+        if (!o.is_number()) return false;
+        *p_cmp = (o.as_decimal() < l.f) ? -1 : (l.f < o.as_decimal()) ? 1 : 0;
+        return true;
+
+      case literal::STRING:
+        if (!o.is_string()) return false;
+        *p_cmp = strcmp(o.as_string(), l.s.c_str());
+        return true;
+    }
+
+    return false;
+  }
+
+  static bool equals(const object& o, const literal& l) noexcept
+  {
+    if (l.type == literal::STRING)
+      return o.is_string() && strutil::glob_match(l.s, o.as_string_view());
+
+    int c;
+    return compare(o, l, &c) && c == 0;
+  }
+
+  static bool test(const object& o, const pred& p) noexcept
+  {
+    int c, c2;
+
+    switch (p.op)
+    {
+      case pred::EQ:     return equals(o, p.lo);
+      case pred::NE:     return !equals(o, p.lo);
+      case pred::LT:     return compare(o, p.lo, &c) && c < 0;
+      case pred::LTE:    return compare(o, p.lo, &c) && c <= 0;
+      case pred::GT:     return compare(o, p.lo, &c) && c > 0;
+      case pred::GTE:    return compare(o, p.lo, &c) && c >= 0;
+      case pred::RANGE:  return compare(o, p.lo, &c) && c >= 0 && compare(o, p.hi, &c2) && c2 <= 0;
+      case pred::EXISTS: return true;
+    }
+
+    return false;
+  }
+
+  // call fn for each statement in the block w/ the given string key, using the block's key index to skip the
+  // block (or the part of it after the key's final occurrence)
+  template<typename F>
+  static void for_each_keyed(const block& b, const std::string& key, F&& fn)
+  {
+    const auto last = b.find_key(key.c_str());
+
+    if (last == b.end())
+      return;
+
+    for (auto i = b.begin(); i <= last; ++i)
+      if (i->key().is_string() && key == i->key().as_string_view())
+        fn(*i);
+  }
+
+  static bool test(const statement& s, const pred& p)
+  {
+    switch (p.subject)
+    {
+      case pred::VALUE: return test(s.value(), p);
+      case pred::KEY:   return test(s.key(), p);
+      case pred::CHILD: break;
+    }
+
+    if (!s.value().is_block())
+      return false;
+
+    bool found = false;
+
+    for_each_keyed(*s.value().as_block(), p.child_key, [&](const statement& c)
+    {
+      found = found || test(c.value(), p);
+    });
+
+    return found;
+  }
+
+  static bool key_matches(const step& st, const object& k)
+  {
+    switch (st.kind)
+    {
+      case step::ANY:   return true;
+      case step::EXACT: return (k.is_string()) ? st.key == k.as_string_view() : key_text(k) == st.key;
+      case step::GLOB:  return strutil::glob_match(st.key, (k.is_string()) ? k.as_string_view() : key_text(k));
+      default:          return false;
+    }
+  }
+
+  // the statement's key has matched steps[i]
+  void accept(const statement& s, size_t i)
+  {
+    for (const auto& p : _steps[i].preds)
+      if (!test(s, p))
+        return;
+
+    if (i + 1 == _steps.size())
+      _emit(s);
+    else if (s.value().is_block())
+      walk(*s.value().as_block(), i + 1);
+  }
+
+public:
+  matcher(const std::vector<step>& steps, const std::function<void(const statement&)>& emit)
+  : _steps(steps), _emit(emit) {}
+
+  // match steps[i] (& the rest) against the statements of a block
+  void walk(const block& b, size_t i)
+  {
+    const auto& st = _steps[i];
+
+    if (st.kind == step::DESCENDANT) // the next step may match here, or at any depth within
+    {
+      for (const auto& s : b)
+      {
+        if (key_matches(_steps[i + 1], s.key()))
+          accept(s, i + 1);
+
+        if (s.value().is_block())
+          walk(*s.value().as_block(), i);
+      }
+    }
+    else if (st.kind == step::EXACT && !st.key_may_be_scalar)
+      for_each_keyed(b, st.key, [&](const statement& s) { accept(s, i); });
+    else
+    {
+      for (const auto& s : b)
+        if (key_matches(st, s.key()))
+          accept(s, i);
+    }
+  }
+};
+
+
+void query::run(const block& root, const std::function<void(const statement&)>& fn) const
+{
+  matcher(_steps, fn).walk(root, 0);
+}
+
+
+std::vector<const statement*> query::select(const block& root) const
+{
+  std::vector<const statement*> v;
+  run(root, [&](const statement& s) { v.push_back(&s); });
+  return v;
+}
+
+
+void query::run(const std::vector<std::shared_ptr<const parser>>& trees,
+                const std::function<void(const statement&, const parser&)>& fn, uint n_threads) const
+{
+  // largest first (by the extent of the source text), so that a big tree picked up late can't serialize the
+  // tail
+  std::vector<const parser*> order;
+  order.reserve(trees.size());
+
+  for (const auto& p : trees)
+    if (p) order.push_back(p.get());
+
+  std::stable_sort(order.begin(), order.end(), [](const parser* a, const parser* b)
+  {
+    return a->root_block()->span().size() > b->root_block()->span().size();
+  });
+
+  std::mutex emit_mtx;
+
+  parallel_for(order.size(), [&](size_t k)
+  {
+    const parser& prs = *order[k];
+
+    run(*prs.root_block(), [&](const statement& s)
+    {
+      std::lock_guard<std::mutex> lk(emit_mtx);
+      fn(s, prs);
+    });
+  }, n_threads);
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,78 @@
+#ifndef LIBCK2_QUERY_H
+#define LIBCK2_QUERY_H
+
+#include "common.h"
+#include "parser.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+// QUERY -- path queries over parse trees, compiled once & then run over any number of trees
+//
+// a query is a '/'-separated path of steps, each of which selects statements by key from the blocks selected by
+// the previous step (starting from the root block). the statements selected by the final step are the matches.
+//
+//   k_france              statements keyed "k_france"
+//   e_*, ?_france, *      keys matching a glob ('*' alone matches every statement, even non-string keys)
+//   **                    any number (incl. zero) of levels of nested blocks in between
+//
+// a step may be followed by any number of predicates in brackets, all of which must hold:
+//
+//   [= catholic], [!= no]   the statement's value compared to a literal (strings compare by glob)
+//   [> 3], [<= 1066.9.15]   ... numbers & dates compare by value
+//   [1066.1.1..1100.1.1]    ... within an inclusive range
+//   [@ 1066.1.1..1100.1.1]  '@' compares the statement's key instead (e.g., the dated blocks of history)
+//   [religion = catholic]   a statement w/ that key in the statement's block value satisfies the test
+//   [de_jure_liege]         the statement's block value contains that key
+//
+// literals may be dates (y.m.d), integers, decimals, or strings (bare or double-quoted). for example:
+//
+//   **/k_*/de_jure_liege                   the de jure lieges of every kingdom, anywhere in the tree
+//   *[@ 1066.1.1..1100.1.1]/holder         the holders set within a date range (in a title history file)
+//   *[religion = catholic][dynasty]        catholic characters w/ a dynasty (in a character history file)
+//
+// exact-key steps use block::find_key to skip blocks which lack the key in O(1), and otherwise only scan a
+// block up to the key's final occurrence. a statement reachable along several paths (only possible w/ multiple
+// "**" steps) is matched once per path.
+
+class query {
+public:
+  // throws Error if the expression is malformed
+  query(std::string_view expr);
+  ~query() noexcept;
+
+  query(query&&) noexcept;
+  query& operator=(query&&) noexcept;
+
+  const auto& text() const noexcept { return _text; }
+
+  // every match within a tree, in document order
+  void run(const block& root, const std::function<void(const statement&)>& fn) const;
+
+  std::vector<const statement*> select(const block& root) const;
+
+  // every match within many trees, which are searched in parallel (largest first) upon n_threads threads (0
+  // means one per hardware thread). matches are streamed to fn as they're found, in document order within each
+  // tree but interleaved among trees; calls to fn are serialized. the parser is the one whose tree contains the
+  // statement, for its floc().
+  void run(const std::vector<std::shared_ptr<const parser>>& trees,
+           const std::function<void(const statement&, const parser&)>& fn, uint n_threads = 0) const;
+
+private:
+  struct step;
+  class compiler;
+  class matcher;
+
+  std::string _text;
+  std::vector<step> _steps;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
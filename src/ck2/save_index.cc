@@ -0,0 +1,406 @@
+
+#include "save_index.h"
+#include "zip.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+
+
+NAMESPACE_CK2;
+
+
+struct save_index::sidecar_header {
+  static constexpr char     MAGIC[8] = { 'C', 'K', '2', 'S', 'I', 'D', 'X', '\0' };
+  static constexpr uint32_t VERSION  = 1;
+  static constexpr uint32_t BOM      = 0x01020304; // detects endianness mismatch
+
+  char     magic[8];
+  uint32_t version;
+  uint32_t bom;
+  uint64_t save_size;
+  uint64_t save_hash;
+  uint32_t n_sections;
+  uint32_t n_entities;
+  // then section[n_sections], then entry[n_entities]
+};
+
+
+namespace {
+  // hash of a save's contents, for validating its sidecar. four independent 64-bit lanes keep it from being
+  // latency-bound, so that it runs at about the speed of memory.
+  uint64_t hash_contents(const uint8_t* p, size_t n) noexcept
+  {
+    constexpr uint64_t K1 = 0x9E3779B97F4A7C15ull;
+    constexpr uint64_t K2 = 0xC2B2AE3D27D4EB4Full;
+    uint64_t lanes[4] = { K1, K2, K1 ^ K2, K1 + K2 };
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32)
+    {
+      for (uint l = 0; l < 4; ++l)
+      {
+        uint64_t w;
+        std::memcpy(&w, p + i + 8 * l, sizeof(w));
+        const uint64_t x = lanes[l] ^ (w * K2);
+        lanes[l] = ((x << 31) | (x >> 33)) * K1;
+      }
+    }
+
+    uint64_t h = n;
+    for (auto lane : lanes) h = (h ^ lane) * K1;
+    for (; i < n; ++i)      h = (h ^ p[i]) * 0x100000001B3ull;
+    return h ^ (h >> 29);
+  }
+
+  // bytes which end a bareword (or are tokens unto themselves)
+  constexpr auto DELIMS = []() {
+    std::array<bool, 256> t{};
+    for (unsigned char c : std::string_view(" \t\r\n{}=<>\"#")) t[c] = true;
+    return t;
+  }();
+}
+
+
+uint64_t save_index::hash_key(std::string_view s) noexcept
+{
+  // FNV-1a-64
+  uint64_t h = 0xCBF29CE484222325ull;
+  for (unsigned char c : s) h = (h ^ c) * 0x100000001B3ull;
+  return h;
+}
+
+
+/* SCANNER -- the indexing pass: tracks brace depth & the statement being read at depth 0 (sections) and, within
+ * the entity sections, at depth 1 (entities). */
+
+class save_index::scanner {
+  const char* const     _base;
+  const char*           _p;
+  const char* const     _end;
+  uint32_t              _line;
+  std::vector<section>& _sections;
+  std::vector<entry>&   _entities;
+
+  // a statement in progress at a tracked depth
+  struct partial {
+    enum { NONE, KEY, OP, BLOCK } state = NONE;
+    const char* begin = nullptr;
+    uint32_t    key_len = 0;
+    uint32_t    line = 0;
+  };
+
+  partial  _st[2];
+  bool     _in_entity_section = false; // is the section at depth 0 an entity section (whose block we're in)?
+  uint32_t _first_entity = 0;
+
+  bool tracked(uint depth) const noexcept { return depth == 0 || (depth == 1 && _in_entity_section); }
+
+  entry complete(partial& s) noexcept
+  {
+    const auto key = std::string_view(s.begin, s.key_len);
+    s.state = partial::NONE;
+    return entry{ hash_key(key), uint64_t(s.begin - _base), uint64_t(_p - _base), s.line, s.key_len };
+  }
+
+  void complete_at(uint depth)
+  {
+    if (depth == 1)
+    {
+      _entities.push_back(complete(_st[1]));
+      return;
+    }
+
+    const uint32_t first = (_in_entity_section) ? _first_entity : static_cast<uint32_t>(_entities.size());
+    _sections.push_back(section{ complete(_st[0]), first, static_cast<uint32_t>(_entities.size()) - first });
+    _in_entity_section = false;
+  }
+
+  static bool is_entity_section(std::string_view key) noexcept
+  {
+    return std::find(std::begin(ENTITY_SECTIONS), std::end(ENTITY_SECTIONS), key) != std::end(ENTITY_SECTIONS);
+  }
+
+public:
+  scanner(std::string_view data, std::vector<section>& sections, std::vector<entry>& entities)
+  : _base(data.data()), _p(data.data()), _end(data.data() + data.size()), _line(1), _sections(sections),
+    _entities(entities) {}
+
+  void run()
+  {
+    uint depth = 0;
+
+    while (_p < _end)
+    {
+      const char* const tok = _p;
+
+      switch (*_p)
+      {
+      case '\n':
+        ++_line;
+        [[fallthrough]];
+      case ' ':
+      case '\t':
+      case '\r':
+        ++_p;
+        break;
+
+      case '#':
+        if (auto p_nl = static_cast<const char*>(std::memchr(_p, '\n', _end - _p))) _p = p_nl;
+        else                                                                        _p = _end;
+        break;
+
+      case '"':
+        for (++_p; _p < _end && *_p != '"'; ++_p)
+          if (*_p == '\n') ++_line;
+
+        if (_p < _end) ++_p;
+
+        if (tracked(depth))
+        {
+          if (_st[depth].state == partial::OP) complete_at(depth);
+          else                                 _st[depth].state = partial::NONE; // (no quoted keys in saves)
+        }
+        break;
+
+      case '{':
+        if (tracked(depth))
+        {
+          auto& s = _st[depth];
+
+          if (s.state == partial::OP)
+          {
+            s.state = partial::BLOCK;
+
+            if (depth == 0 && is_entity_section(std::string_view(s.begin, s.key_len)))
+            {
+              _in_entity_section = true;
+              _first_entity = static_cast<uint32_t>(_entities.size());
+            }
+          }
+          else
+            s.state = partial::NONE;
+        }
+
+        ++depth;
+        ++_p;
+        break;
+
+      case '}':
+        ++_p;
+
+        if (depth == 0) // a save's final closing brace (or a stray one)
+          break;
+
+        if (tracked(--depth))
+        {
+          if (_st[depth].state == partial::BLOCK) complete_at(depth);
+          else                                    _st[depth].state = partial::NONE;
+        }
+        break;
+
+      case '=':
+      case '<':
+      case '>':
+        while (_p < _end && (*_p == '=' || *_p == '<' || *_p == '>')) ++_p;
+
+        if (tracked(depth))
+        {
+          auto& s = _st[depth];
+          s.state = (s.state == partial::KEY) ? partial::OP : partial::NONE;
+        }
+        break;
+
+      default:
+        while (_p < _end && !DELIMS[static_cast<unsigned char>(*_p)]) ++_p;
+
+        if (tracked(depth))
+        {
+          auto& s = _st[depth];
+
+          if (s.state == partial::OP)
+            complete_at(depth);
+          else
+            s = partial{ partial::KEY, tok, static_cast<uint32_t>(_p - tok), _line };
+        }
+        break;
+      }
+    }
+  }
+};
+
+
+save_index::save_index(const fs::path& save_path)
+: save_index(save_path, fs::path(save_path) += ".idx")
+{
+}
+
+
+save_index::save_index(const fs::path& save_path, const fs::path& sidecar_path)
+: _mf(save_path)
+, _from_sidecar(false)
+{
+  if (is_zip_file(save_path))
+    throw PathError("Compressed savegames can't be indexed", save_path);
+
+  const uint64_t save_hash = (sidecar_path.empty()) ? 0 : hash_contents(_mf.data(), _mf.size());
+
+  std::error_code ec;
+
+  if (!sidecar_path.empty() && fs::exists(sidecar_path, ec))
+  {
+    if (load_sidecar(sidecar_path, save_hash))
+    {
+      _from_sidecar = true;
+      return;
+    }
+
+    _sections.clear();
+    _entities.clear();
+  }
+
+  scanner(_mf.chars(), _sections, _entities).run();
+
+  // sort each section's entities by key hash, so that they can be binary-searched. the sort is stable, so the
+  // last of any entities with the same key remains the last.
+  for (const auto& s : _sections)
+  {
+    auto first = _entities.begin() + s.first_entity;
+    std::stable_sort(first, first + s.n_entities, [](const entry& a, const entry& b) {
+      return a.key_hash < b.key_hash;
+    });
+  }
+
+  if (!sidecar_path.empty())
+  {
+    try
+    {
+      write_sidecar(sidecar_path, save_hash);
+    }
+    catch (const std::exception& e) // the index is still good; it just won't be reused
+    {
+      _sidecar_error = e.what();
+    }
+  }
+}
+
+
+bool save_index::load_sidecar(const fs::path& sidecar_path, uint64_t save_hash)
+{
+  // a sidecar which is stale, foreign, corrupt, or unreadable is simply rebuilt (and rewriting it may then fail in
+  // turn, as writing it may), so this only reports whether it was usable
+  std::unique_ptr<mapped_file> p_mf;
+
+  try
+  {
+    p_mf = std::make_unique<mapped_file>(sidecar_path);
+  }
+  catch (const std::exception&) // e.g., no read permission, or a directory
+  {
+    return false;
+  }
+
+  const auto& mf = *p_mf;
+  auto p_hdr = reinterpret_cast<const sidecar_header*>(mf.data());
+
+  if (mf.size() < sizeof(sidecar_header) ||
+      std::memcmp(p_hdr->magic, sidecar_header::MAGIC, sizeof(sidecar_header::MAGIC)) != 0 ||
+      p_hdr->version != sidecar_header::VERSION || p_hdr->bom != sidecar_header::BOM ||
+      p_hdr->save_size != _mf.size() || p_hdr->save_hash != save_hash)
+    return false;
+
+  const size_t sz = sizeof(sidecar_header) + size_t(p_hdr->n_sections) * sizeof(section) +
+                    size_t(p_hdr->n_entities) * sizeof(entry);
+
+  if (mf.size() != sz)
+    return false;
+
+  auto p_sections = reinterpret_cast<const section*>(p_hdr + 1);
+  auto p_entities = reinterpret_cast<const entry*>(p_sections + p_hdr->n_sections);
+  _sections.assign(p_sections, p_sections + p_hdr->n_sections);
+  _entities.assign(p_entities, p_entities + p_hdr->n_entities);
+
+  auto bad_entry = [&](const entry& e) { return e.begin + e.key_len > e.end || e.end > _mf.size(); };
+
+  for (const auto& s : _sections)
+    if (bad_entry(s.stmt) || uint64_t(s.first_entity) + s.n_entities > _entities.size())
+      return false;
+
+  return std::none_of(_entities.begin(), _entities.end(), bad_entry);
+}
+
+
+void save_index::write_sidecar(const fs::path& sidecar_path, uint64_t save_hash) const
+{
+  sidecar_header hdr;
+  std::memcpy(hdr.magic, sidecar_header::MAGIC, sizeof(hdr.magic));
+  hdr.version    = sidecar_header::VERSION;
+  hdr.bom        = sidecar_header::BOM;
+  hdr.save_size  = _mf.size();
+  hdr.save_hash  = save_hash;
+  hdr.n_sections = static_cast<uint32_t>(_sections.size());
+  hdr.n_entities = static_cast<uint32_t>(_entities.size());
+
+  write_file_atomic(sidecar_path, [&](std::FILE* f) {
+    if (std::fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        std::fwrite(_sections.data(), sizeof(section), _sections.size(), f) != _sections.size() ||
+        std::fwrite(_entities.data(), sizeof(entry), _entities.size(), f) != _entities.size())
+      throw PathError("Failed to write savegame index", sidecar_path);
+  });
+}
+
+
+const save_index::section* save_index::find_section(std::string_view k) const noexcept
+{
+  const uint64_t h = hash_key(k);
+
+  for (auto it = _sections.rbegin(); it != _sections.rend(); ++it)
+    if (it->stmt.key_hash == h && key(it->stmt) == k)
+      return &*it;
+
+  return nullptr;
+}
+
+
+const save_index::entry* save_index::find(std::string_view section_key, std::string_view k) const noexcept
+{
+  const auto p_sec = find_section(section_key);
+
+  if (p_sec == nullptr)
+    return nullptr;
+
+  const uint64_t h = hash_key(k);
+  const auto first = _entities.begin() + p_sec->first_entity;
+  const auto last  = first + p_sec->n_entities;
+  auto [lo, hi] = std::equal_range(first, last, entry{ h, 0, 0, 0, 0 }, [](const entry& a, const entry& b) {
+    return a.key_hash < b.key_hash;
+  });
+
+  for (auto it = hi; it != lo; --it) // the last occurrence wins
+    if (key(*(it - 1)) == k)
+      return &*(it - 1);
+
+  return nullptr;
+}
+
+
+std::unique_ptr<parser> save_index::parse(const entry& e) const
+{
+  buffer_input in(text(e));
+  return std::make_unique<parser>(in, path(), false, e.line);
+}
+
+
+std::unique_ptr<parser> save_index::parse(std::string_view section_key, std::string_view k) const
+{
+  const auto p_entry = find(section_key, k);
+
+  if (p_entry == nullptr)
+    throw PathError(fmt::format("Savegame has no '{}' entity '{}'", section_key, k), path());
+
+  return parse(*p_entry);
+}
+
+
+NAMESPACE_CK2_END;
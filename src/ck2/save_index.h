@@ -0,0 +1,106 @@
+#ifndef LIBCK2_SAVE_INDEX_H
+#define LIBCK2_SAVE_INDEX_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "mapped_file.h"
+#include "parser.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+/* SAVE_INDEX -- random access into a (text) savegame by section & entity, so that inspecting e.g. one character
+ * doesn't require parsing the whole save
+ *
+ * indexing is a single brace-matching pass over the memory-mapped save, which records the byte range & first
+ * line of every top-level statement (section) and of every statement within the sections that hold the bulk of
+ * a save's entities (ENTITY_SECTIONS: characters, dynasties, titles, and provinces). nothing is tokenized
+ * beyond telling keys, operators, strings, and braces apart, so this runs at a small fraction of the cost of a
+ * full parse.
+ *
+ * the index is persisted to a sidecar file next to the save, which is stamped with the save's size & a hash of
+ * its contents and is only reused while they match (the save is still hashed upon every load, but hashing is
+ * much cheaper than scanning). afterward, looking up an entity is a binary search, and parse() runs the parser
+ * over only that entity's text. zipped saves can't be indexed, since their entries can't be seeked into.
+ */
+
+class save_index {
+public:
+  // an indexed statement: its extent in the save (key through value), the line on which it begins, and its key
+  struct entry {
+    uint64_t key_hash;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t line;
+    uint32_t key_len; // the key is at the beginning of the statement
+  };
+
+  struct section {
+    entry    stmt;
+    uint32_t first_entity; // range of the section's entities in entities(), sorted by key hash
+    uint32_t n_entities;
+  };
+
+  static constexpr std::string_view ENTITY_SECTIONS[] = { "character", "dynasties", "title", "provinces" };
+
+  // index the save via the sidecar at the given path (by default, the save's path plus ".idx"), which is
+  // (re)written if it's missing or out of date. an empty sidecar path skips the sidecar altogether. failing to
+  // write the sidecar (e.g., in a read-only directory) doesn't fail the index; see sidecar_error().
+  save_index(const fs::path& save_path);
+  save_index(const fs::path& save_path, const fs::path& sidecar_path);
+
+  const auto& path()          const noexcept { return _mf.path(); }
+  const auto& sections()      const noexcept { return _sections; }
+  const auto& entities()      const noexcept { return _entities; }
+  bool        from_sidecar()  const noexcept { return _from_sidecar; }
+
+  // why the sidecar couldn't be written, if it couldn't (in which case the next load scans the save again)
+  bool        sidecar_failed() const noexcept { return !_sidecar_error.empty(); }
+  const auto& sidecar_error()  const noexcept { return _sidecar_error; }
+
+  std::string_view text(const entry& e) const noexcept
+  {
+    return _mf.chars().substr(e.begin, e.end - e.begin);
+  }
+
+  std::string_view key(const entry& e) const noexcept { return _mf.chars().substr(e.begin, e.key_len); }
+
+  // the final top-level statement with the given key (as with block::find_key), or nullptr
+  const section* find_section(std::string_view key) const noexcept;
+
+  // the final entity with the given key in the final such section, or nullptr
+  const entry* find(std::string_view section_key, std::string_view key) const noexcept;
+
+  const entry* find_character(char_id_t id) const noexcept { return find("character", std::to_string(id)); }
+
+  // parse only the statement's text. the statement is the root block's sole statement, and its line numbers are
+  // those in the save, but its source spans are relative to the statement's beginning.
+  std::unique_ptr<parser> parse(const entry&) const;
+
+  // find & parse an entity, throwing if it doesn't exist
+  std::unique_ptr<parser> parse(std::string_view section_key, std::string_view key) const;
+
+private:
+  struct sidecar_header;
+  class scanner;
+
+  static uint64_t hash_key(std::string_view) noexcept;
+
+  bool load_sidecar(const fs::path&, uint64_t save_hash);
+  void write_sidecar(const fs::path&, uint64_t save_hash) const;
+
+  mapped_file          _mf;
+  std::vector<section> _sections; // in order of appearance
+  std::vector<entry>   _entities;
+  bool                 _from_sidecar;
+  std::string          _sidecar_error;
+};
+
+
+NAMESPACE_CK2_END;
+#endif
@@ -1,7 +1,16 @@
 #line 1 "scanner.cc"
     #include "token.h"
+    #include <cstddef>
 
-#line 4 "scanner.cc"
+    /* byte offset into the input just past the most recently matched text (incl. skipped comments/whitespace) */
+    extern thread_local std::size_t yyoffset;
+
+    /* when set, the scanner pulls its input through this callback rather than reading from yyin. it must copy up to
+     * max_sz bytes into buf and return the count copied, or 0 at the end of the input. */
+    extern thread_local std::size_t (*yyreader)(char* buf, std::size_t max_sz, void* ctx);
+    extern thread_local void* yyreader_ctx;
+
+#line 13 "scanner.cc"
 
 #define  YY_INT_ALIGNED short int
 
@@ -156,9 +165,9 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 typedef size_t yy_size_t;
 #endif
 
-extern int yyleng;
+extern thread_local int yyleng;
 
-extern FILE *yyin, *yyout;
+extern thread_local FILE *yyin, *yyout;
 
 #define EOB_ACT_CONTINUE_SCAN 0
 #define EOB_ACT_END_OF_FILE 1
@@ -267,9 +276,9 @@ struct yy_buffer_state
 #endif /* !YY_STRUCT_YY_BUFFER_STATE */
 
 /* Stack of input buffers. */
-static size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
-static size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
-static YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
+static thread_local size_t yy_buffer_stack_top = 0; /**< index of top of stack. */
+static thread_local size_t yy_buffer_stack_max = 0; /**< capacity of stack. */
+static thread_local YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
 
 /* We provide macros for accessing buffer states in case in the
  * future we want to put the buffer states in a more general
@@ -286,19 +295,19 @@ static YY_BUFFER_STATE * yy_buffer_stack = NULL; /**< Stack as an array. */
 #define YY_CURRENT_BUFFER_LVALUE (yy_buffer_stack)[(yy_buffer_stack_top)]
 
 /* yy_hold_char holds the character lost when yytext is formed. */
-static char yy_hold_char;
-static int yy_n_chars;		/* number of characters read into yy_ch_buf */
-int yyleng;
+static thread_local char yy_hold_char;
+static thread_local int yy_n_chars;		/* number of characters read into yy_ch_buf */
+thread_local int yyleng;
 
 /* Points to current character in buffer. */
-static char *yy_c_buf_p = NULL;
-static int yy_init = 0;		/* whether we need to initialize */
-static int yy_start = 0;	/* start state number */
+static thread_local char *yy_c_buf_p = NULL;
+static thread_local int yy_init = 0;		/* whether we need to initialize */
+static thread_local int yy_start = 0;	/* start state number */
 
 /* Flag which is used to allow yywrap()'s to do buffer switches
  * instead of setting up a fresh yyin.  A bit of a hack ...
  */
-static int yy_did_buffer_switch_on_eof;
+static thread_local int yy_did_buffer_switch_on_eof;
 
 void yyrestart ( FILE *input_file  );
 void yy_switch_to_buffer ( YY_BUFFER_STATE new_buffer  );
@@ -348,14 +357,14 @@ void yyfree ( void *  );
 #define YY_SKIP_YYWRAP
 typedef flex_uint8_t YY_CHAR;
 
-FILE *yyin = NULL, *yyout = NULL;
+thread_local FILE *yyin = NULL, *yyout = NULL;
 
 typedef int yy_state_type;
 
-extern int yylineno;
-int yylineno = 1;
+extern thread_local int yylineno;
+thread_local int yylineno = 1;
 
-extern char *yytext;
+extern thread_local char *yytext;
 #ifdef yytext_ptr
 #undef yytext_ptr
 #endif
@@ -483,11 +492,11 @@ static const flex_int32_t yy_rule_can_match_eol[14] =
     {   0,
 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,     };
 
-static yy_state_type yy_last_accepting_state;
-static char *yy_last_accepting_cpos;
+static thread_local yy_state_type yy_last_accepting_state;
+static thread_local char *yy_last_accepting_cpos;
 
-extern int yy_flex_debug;
-int yy_flex_debug = 0;
+extern thread_local int yy_flex_debug;
+thread_local int yy_flex_debug = 0;
 
 /* The intent behind this definition is that it'll catch
  * any uses of REJECT which flex missed.
@@ -496,11 +505,21 @@ int yy_flex_debug = 0;
 #define yymore() yymore_used_but_not_detected
 #define YY_MORE_ADJ 0
 #define YY_RESTORE_YY_MORE_OFFSET
-char *yytext;
+thread_local char *yytext;
 #line 1 "scanner.ll"
 #define YY_NO_UNISTD_H 1
-
-#line 503 "scanner.cc"
+#line 29 "scanner.ll"
+    thread_local std::size_t yyoffset = 0;
+    thread_local std::size_t (*yyreader)(char*, std::size_t, void*) = nullptr;
+    thread_local void* yyreader_ctx = nullptr;
+    #define YY_USER_ACTION yyoffset += yyleng;
+    #define YY_INPUT(buf, result, max_size) \
+        if (yyreader) \
+            result = yyreader(buf, max_size, yyreader_ctx); \
+        else if ((result = fread(buf, 1, max_size, yyin)) == 0 && ferror(yyin)) \
+            YY_FATAL_ERROR("input in flex scanner failed");
+
+#line 522 "scanner.cc"
 
 #define INITIAL 0
 
@@ -717,10 +736,10 @@ YY_DECL
 		}
 
 	{
-#line 18 "scanner.ll"
+#line 39 "scanner.ll"
 
 
-#line 723 "scanner.cc"
+#line 742 "scanner.cc"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -785,71 +804,71 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 20 "scanner.ll"
+#line 41 "scanner.ll"
 { return ck2::token::DATE; }
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 21 "scanner.ll"
+#line 42 "scanner.ll"
 { return ck2::token::QDATE; }
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 22 "scanner.ll"
+#line 43 "scanner.ll"
 { return ck2::token::DECIMAL; }
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 23 "scanner.ll"
+#line 44 "scanner.ll"
 { return ck2::token::INTEGER; }
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 24 "scanner.ll"
+#line 45 "scanner.ll"
 { return ck2::token::OPERATOR; }
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 25 "scanner.ll"
+#line 46 "scanner.ll"
 { return ck2::token::OPEN; }
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 26 "scanner.ll"
+#line 47 "scanner.ll"
 { return ck2::token::CLOSE; }
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 27 "scanner.ll"
+#line 48 "scanner.ll"
 { return ck2::token::STR; }
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 28 "scanner.ll"
+#line 49 "scanner.ll"
 { return ck2::token::QSTR; }
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 29 "scanner.ll"
+#line 50 "scanner.ll"
 /* skip */
 	YY_BREAK
 case 11:
 /* rule 11 can match eol */
 YY_RULE_SETUP
-#line 30 "scanner.ll"
+#line 51 "scanner.ll"
 /* skip */
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 31 "scanner.ll"
+#line 52 "scanner.ll"
 { return ck2::token::FAIL; }
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 33 "scanner.ll"
+#line 54 "scanner.ll"
 YY_FATAL_ERROR( "flex scanner jammed" );
 	YY_BREAK
-#line 852 "scanner.cc"
+#line 871 "scanner.cc"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -1867,6 +1886,6 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 33 "scanner.ll"
+#line 54 "scanner.ll"
 
 
@@ -4,8 +4,17 @@
 
 #line 5 "scanner.h"
     #include "token.h"
+    #include <cstddef>
 
-#line 8 "scanner.h"
+    /* byte offset into the input just past the most recently matched text (incl. skipped comments/whitespace) */
+    extern thread_local std::size_t yyoffset;
+
+    /* when set, the scanner pulls its input through this callback rather than reading from yyin. it must copy up to
+     * max_sz bytes into buf and return the count copied, or 0 at the end of the input. */
+    extern thread_local std::size_t (*yyreader)(char* buf, std::size_t max_sz, void* ctx);
+    extern thread_local void* yyreader_ctx;
+
+#line 17 "scanner.h"
 
 #define  YY_INT_ALIGNED short int
 
@@ -131,9 +140,9 @@ typedef struct yy_buffer_state *YY_BUFFER_STATE;
 typedef size_t yy_size_t;
 #endif
 
-extern int yyleng;
+extern thread_local int yyleng;
 
-extern FILE *yyin, *yyout;
+extern thread_local FILE *yyin, *yyout;
 
 #ifndef YY_STRUCT_YY_BUFFER_STATE
 #define YY_STRUCT_YY_BUFFER_STATE
@@ -207,9 +216,9 @@ void yyfree ( void *  );
 #define yywrap() (/*CONSTCOND*/1)
 #define YY_SKIP_YYWRAP
 
-extern int yylineno;
+extern thread_local int yylineno;
 
-extern char *yytext;
+extern thread_local char *yytext;
 #ifdef yytext_ptr
 #undef yytext_ptr
 #endif
@@ -470,9 +479,9 @@ extern int yylex (void);
 #undef yyTABLES_NAME
 #endif
 
-#line 33 "scanner.ll"
+#line 54 "scanner.ll"
 
 
-#line 476 "scanner.h"
+#line 485 "scanner.h"
 #undef yyIN_HEADER
 #endif /* yyHEADER_H */
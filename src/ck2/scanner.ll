@@ -8,6 +8,15 @@
 
 %top{
     #include "token.h"
+    #include <cstddef>
+
+    /* byte offset into the input just past the most recently matched text (incl. skipped comments/whitespace) */
+    extern thread_local std::size_t yyoffset;
+
+    /* when set, the scanner pulls its input through this callback rather than reading from yyin. it must copy up to
+     * max_sz bytes into buf and return the count copied, or 0 at the end of the input. */
+    extern thread_local std::size_t (*yyreader)(char* buf, std::size_t max_sz, void* ctx);
+    extern thread_local void* yyreader_ctx;
 }
 
 D       [0-9]
@@ -15,6 +24,18 @@ STR     [a-zA-Z\xC0-\xFF0-9_:@'\[\]\-\.\x83\x8A\x8C\x8E\x91-\x92\x9A\x9C\x9E\x9F
 WS      [ \t\r\n\xA0]+
 QSTR    \"[^"\n]*\"
 DATE    -?[0-9]{1,4}\.[0-9]{1,2}\.[0-9]{1,2}
+
+%{
+    thread_local std::size_t yyoffset = 0;
+    thread_local std::size_t (*yyreader)(char*, std::size_t, void*) = nullptr;
+    thread_local void* yyreader_ctx = nullptr;
+    #define YY_USER_ACTION yyoffset += yyleng;
+    #define YY_INPUT(buf, result, max_size) \
+        if (yyreader) \
+            result = yyreader(buf, max_size, yyreader_ctx); \
+        else if ((result = fread(buf, 1, max_size, yyin)) == 0 && ferror(yyin)) \
+            YY_FATAL_ERROR("input in flex scanner failed");
+%}
 %%
 
 {DATE}                     { return ck2::token::DATE; }
@@ -0,0 +1,294 @@
+
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+uint32_t snapshot::hash(std::string_view s) noexcept
+{
+  // FNV-1a (over unsigned bytes, so that it's independent of char's signedness)
+  uint32_t h = 2166136261u;
+
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+
+int64_t snapshot::find_str(const uint8_t* base, std::string_view s) noexcept
+{
+  auto p_hdr = hdr(base);
+  auto table = reinterpret_cast<const uint32_t*>(base + p_hdr->str_hash_off);
+  const uint32_t mask = p_hdr->str_hash_sz - 1;
+
+  for (uint32_t i = hash(s) & mask;; i = (i + 1) & mask) {
+    if (table[i] == 0)
+      return -1;
+
+    if (str(base, table[i] - 1) == s)
+      return table[i] - 1;
+  }
+}
+
+
+/* SNAPSHOT_BUILDER -- serializes a parse tree into a snapshot image in memory */
+
+class snapshot_builder {
+  using value_rec = snapshot::value_rec;
+  using stmt_rec  = snapshot::stmt_rec;
+  using key_rec   = snapshot::key_rec;
+  using block_rec = snapshot::block_rec;
+  using list_rec  = snapshot::list_rec;
+  using header    = snapshot::header;
+
+  std::vector<uint8_t> _buf;
+  std::vector<std::string_view> _strs;
+  std::unordered_map<std::string_view, uint32_t> _str_ids;
+  std::string _src_path; // owned here, since _strs only holds views
+
+public:
+  snapshot_builder(const fs::path& src_path) : _src_path(src_path.generic_string()) {}
+
+  template<typename T>
+  T* at(uint32_t off) noexcept { return reinterpret_cast<T*>(&_buf[off]); }
+
+  // append `n` zeroed bytes at the next 4-byte boundary, returning their offset. invalidates pointers into _buf.
+  uint32_t alloc(size_t n)
+  {
+    const size_t off = (_buf.size() + 3) & ~size_t(3);
+
+    if (off + n > std::numeric_limits<uint32_t>::max())
+      throw Error("Snapshot exceeds the 4GiB size limit of its format");
+
+    _buf.resize(off + n, 0);
+    return static_cast<uint32_t>(off);
+  }
+
+  uint32_t intern(std::string_view s)
+  {
+    auto [it, inserted] = _str_ids.emplace(s, static_cast<uint32_t>(_strs.size()));
+    if (inserted) _strs.emplace_back(s);
+    return it->second;
+  }
+
+  static uint32_t pack_date(date d) noexcept
+  {
+    return uint32_t(uint16_t(d.year())) | (uint32_t(d.month()) << 16) | (uint32_t(d.day()) << 24);
+  }
+
+  void put_value(uint32_t off, const object& obj)
+  {
+    uint8_t  type = static_cast<uint8_t>(obj._type);
+    uint32_t data = 0;
+
+    // nested records are allocated before taking a pointer to our own, which the allocation could invalidate
+    switch (obj._type) {
+      case object::NIL:       break;
+      case object::INTEGER:   data = static_cast<uint32_t>(obj.as_integer()); break;
+      case object::DATE:      data = pack_date(obj.as_date()); break;
+      case object::DECIMAL:   data = static_cast<uint32_t>(obj.as_decimal().raw()); break;
+      case object::BINARY_OP: data = static_cast<uint32_t>(obj.as_binary_op()); break;
+      case object::STRING:    data = intern(obj.as_string_view()); break;
+      case object::BLOCK:     data = put_block(*obj.as_block()); break;
+      case object::LIST:      data = put_list(*obj.as_list()); break;
+    }
+
+    auto r = at<value_rec>(off);
+    r->type = type;
+    r->line = obj.loc().line();
+    r->data = data;
+  }
+
+  uint32_t put_list(const list& l)
+  {
+    const uint32_t off = alloc(sizeof(list_rec) + l.size() * sizeof(value_rec));
+    at<list_rec>(off)->n = static_cast<uint32_t>(l.size());
+
+    uint32_t elem_off = off + sizeof(list_rec);
+
+    for (const auto& o : l) {
+      put_value(elem_off, o);
+      elem_off += sizeof(value_rec);
+    }
+
+    return off;
+  }
+
+  uint32_t put_block(const block& b)
+  {
+    // index string-type keys first, as their count determines the record's size. a repeated key resolves to its
+    // final occurrence, as with block::find_key.
+    std::vector<key_rec> keys;
+    {
+      std::unordered_map<uint32_t, uint32_t> key_idx; // string ID => index in `keys`
+      uint32_t i = 0;
+
+      for (const auto& s : b) {
+        if (s.key().is_string()) {
+          auto id = intern(s.key().as_string_view());
+          auto [it, inserted] = key_idx.emplace(id, static_cast<uint32_t>(keys.size()));
+          if (inserted) keys.push_back({ id, i });
+          else          keys[it->second].stmt_idx = i;
+        }
+
+        ++i;
+      }
+
+      std::sort(keys.begin(), keys.end(), [](const key_rec& a, const key_rec& b) { return a.str_id < b.str_id; });
+    }
+
+    const uint32_t off = alloc(sizeof(block_rec) + b.size() * sizeof(stmt_rec) + keys.size() * sizeof(key_rec));
+    at<block_rec>(off)->n_stmts = static_cast<uint32_t>(b.size());
+    at<block_rec>(off)->n_keys  = static_cast<uint32_t>(keys.size());
+
+    uint32_t stmt_off = off + sizeof(block_rec);
+
+    for (const auto& s : b) {
+      put_value(stmt_off + offsetof(stmt_rec, key),   s.key());
+      put_value(stmt_off + offsetof(stmt_rec, op),    s.op());
+      put_value(stmt_off + offsetof(stmt_rec, value), s.value());
+      stmt_off += sizeof(stmt_rec);
+    }
+
+    std::memcpy(at<key_rec>(stmt_off), keys.data(), keys.size() * sizeof(key_rec));
+    return off;
+  }
+
+  std::vector<uint8_t> build(const block& root)
+  {
+    alloc(sizeof(header));
+    const uint32_t src_path_str = intern(_src_path);
+    const uint32_t root_off = put_block(root);
+
+    /* string data */
+
+    std::vector<uint32_t> str_offs;
+    str_offs.reserve(_strs.size());
+
+    for (auto s : _strs) {
+      const uint32_t off = alloc(sizeof(uint32_t) + s.size() + 1);
+      *at<uint32_t>(off) = static_cast<uint32_t>(s.size());
+      std::memcpy(at<char>(off + sizeof(uint32_t)), s.data(), s.size());
+      str_offs.push_back(off);
+    }
+
+    const uint32_t str_offs_off = alloc(str_offs.size() * sizeof(uint32_t));
+    std::memcpy(at<uint32_t>(str_offs_off), str_offs.data(), str_offs.size() * sizeof(uint32_t));
+
+    /* string hash table (load factor <= 0.5) */
+
+    uint32_t hash_sz = 1;
+    while (hash_sz < 2 * _strs.size()) hash_sz <<= 1;
+
+    const uint32_t hash_off = alloc(hash_sz * sizeof(uint32_t));
+    auto table = at<uint32_t>(hash_off);
+
+    for (uint32_t id = 0; id < _strs.size(); ++id) {
+      uint32_t i = snapshot::hash(_strs[id]) & (hash_sz - 1);
+      while (table[i] != 0) i = (i + 1) & (hash_sz - 1);
+      table[i] = id + 1;
+    }
+
+    alloc(0); // pad total size to alignment
+
+    auto h = at<header>(0);
+    std::memcpy(h->magic, header::MAGIC, sizeof(h->magic));
+    h->version      = header::VERSION;
+    h->bom          = header::BOM;
+    h->size         = static_cast<uint32_t>(_buf.size());
+    h->root_off     = root_off;
+    h->n_strings    = static_cast<uint32_t>(_strs.size());
+    h->str_offs_off = str_offs_off;
+    h->str_hash_off = hash_off;
+    h->str_hash_sz  = hash_sz;
+    h->src_path_str = src_path_str;
+
+    return std::move(_buf);
+  }
+};
+
+
+void write_snapshot(const block& root, const fs::path& out_path, const fs::path& src_path)
+{
+  auto buf = snapshot_builder(src_path).build(root);
+
+  write_file_atomic(out_path, [&](std::FILE* f) {
+    if (std::fwrite(buf.data(), 1, buf.size(), f) != buf.size())
+      throw PathError("Failed to write snapshot", out_path);
+  });
+}
+
+
+snapshot::snapshot(const fs::path& p)
+  : _mf(p)
+  , _hdr(reinterpret_cast<const header*>(_mf.data()))
+{
+  if (_mf.size() < sizeof(header) || std::memcmp(_hdr->magic, header::MAGIC, sizeof(header::MAGIC)) != 0)
+    throw PathError("Not a snapshot file", p);
+
+  if (_hdr->bom != header::BOM)
+    throw PathError("Snapshot was written on a machine of different endianness", p);
+
+  if (_hdr->version != header::VERSION)
+    throw PathError(fmt::format("Unsupported snapshot version {} (expected {})", _hdr->version, header::VERSION), p);
+
+  if (_hdr->size != _mf.size())
+    throw PathError(fmt::format("Snapshot is truncated or corrupt ({} bytes, expected {})", _mf.size(), _hdr->size), p);
+
+  const uint64_t hash_end = uint64_t(_hdr->str_hash_off) + uint64_t(_hdr->str_hash_sz) * sizeof(uint32_t);
+  const uint64_t offs_end = uint64_t(_hdr->str_offs_off) + uint64_t(_hdr->n_strings) * sizeof(uint32_t);
+
+  if (_hdr->root_off >= _hdr->size || offs_end > _hdr->size || hash_end > _hdr->size ||
+      _hdr->str_hash_sz == 0 || (_hdr->str_hash_sz & (_hdr->str_hash_sz - 1)) != 0 ||
+      _hdr->src_path_str >= _hdr->n_strings)
+    throw PathError("Snapshot header is corrupt", p);
+}
+
+
+const char* snapshot::object::type_string() const noexcept
+{
+  switch (_r->type)
+  {
+    case NIL:       return "null";
+    case INTEGER:   return "integer";
+    case DATE:      return "date";
+    case DECIMAL:   return "decimal";
+    case BINARY_OP: return "operator";
+    case STRING:    return "string";
+    case BLOCK:     return "block";
+    case LIST:      return "list";
+  }
+
+  return "invalid";
+}
+
+
+snapshot::block::iterator snapshot::block::find_key(std::string_view key) const noexcept
+{
+  const auto id = find_str(_base, key);
+
+  if (id < 0)
+    return end();
+
+  auto keys_begin = _r->keys();
+  auto keys_end   = keys_begin + _r->n_keys;
+  auto k = std::lower_bound(keys_begin, keys_end, static_cast<uint32_t>(id),
+                            [](const key_rec& k, uint32_t id) { return k.str_id < id; });
+
+  if (k == keys_end || k->str_id != id)
+    return end();
+
+  return begin() + k->stmt_idx;
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,316 @@
+#ifndef LIBCK2_SNAPSHOT_H
+#define LIBCK2_SNAPSHOT_H
+
+#include "common.h"
+#include "FileLocation.h"
+#include "date.h"
+#include "filesystem.h"
+#include "mapped_file.h"
+#include "parser.h"
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+
+NAMESPACE_CK2;
+
+
+/* SNAPSHOT -- compact, position-independent binary encoding of a parse tree, read in place via a memory mapping
+ *
+ * re-lexing a stable game install at every startup is wasted work, so a parse tree may instead be written once
+ * with write_snapshot(...) and then loaded via the snapshot class, which merely maps the file & validates its
+ * header. the nested snapshot::block, ::list, ::statement, and ::object types are lightweight views directly into
+ * the mapping, and they mirror the read-only interface of their namesakes in parser.h (iteration, find_key, type &
+ * data accessors, Locs), so generic code can be written against either.
+ *
+ * layout (native-endian; all offsets are relative to the start of the file & 4-byte aligned):
+ *   header
+ *   nodes:   block_rec { n_stmts, n_keys } stmt_rec[n_stmts] key_rec[n_keys]  (key_recs sorted by string ID)
+ *            list_rec  { n } value_rec[n]
+ *   strings: { u32 length, chars, NUL }, then u32 offsets[n_strings], then an open-addressed hash table of
+ *            (string ID + 1) by FNV-1a for looking up a key's string ID
+ *
+ * a value_rec is a typed scalar (dates packed as 16-bit year, 8-bit month, 8-bit day from the LSB up), a string
+ * ID, or the offset of a child block/list record, plus its line number. snapshots are trusted input (we write
+ * them), so beyond the header, data isn't bounds-checked when read.
+ */
+
+void write_snapshot(const block& root, const fs::path& out_path, const fs::path& src_path = fs::path());
+
+
+class snapshot {
+  struct value_rec {
+    uint8_t  type;
+    uint8_t  reserved[3];
+    uint32_t line;
+    uint32_t data;
+  };
+
+  struct stmt_rec {
+    value_rec key;
+    value_rec op;
+    value_rec value;
+  };
+
+  struct key_rec {
+    uint32_t str_id;
+    uint32_t stmt_idx;
+  };
+
+  struct block_rec {
+    uint32_t n_stmts;
+    uint32_t n_keys;
+
+    auto stmts() const noexcept { return reinterpret_cast<const stmt_rec*>(this + 1); }
+    auto keys()  const noexcept { return reinterpret_cast<const key_rec*>(stmts() + n_stmts); }
+  };
+
+  struct list_rec {
+    uint32_t n;
+
+    auto elems() const noexcept { return reinterpret_cast<const value_rec*>(this + 1); }
+  };
+
+  struct header {
+    static constexpr char     MAGIC[8] = { 'C', 'K', '2', 'S', 'N', 'A', 'P', '\0' };
+    static constexpr uint32_t VERSION  = 1;
+    static constexpr uint32_t BOM      = 0x01020304; // detects endianness mismatch
+
+    char     magic[8];
+    uint32_t version;
+    uint32_t bom;
+    uint32_t size;
+    uint32_t root_off;
+    uint32_t n_strings;
+    uint32_t str_offs_off;
+    uint32_t str_hash_off;
+    uint32_t str_hash_sz; // power of 2
+    uint32_t src_path_str;
+  };
+
+  // value_rec::type (same order as ck2::object's dynamic types)
+  enum : uint8_t { NIL, INTEGER, DATE, DECIMAL, BINARY_OP, STRING, BLOCK, LIST };
+
+  static uint32_t hash(std::string_view) noexcept;
+  friend class snapshot_builder;
+
+  static auto hdr(const uint8_t* base) noexcept { return reinterpret_cast<const header*>(base); }
+
+  static auto str(const uint8_t* base, uint32_t id) noexcept
+  {
+    auto offs = reinterpret_cast<const uint32_t*>(base + hdr(base)->str_offs_off);
+    auto p = base + offs[id];
+    return std::string_view(reinterpret_cast<const char*>(p + 4), *reinterpret_cast<const uint32_t*>(p));
+  }
+
+  // string ID of `s`, or -1 if it doesn't occur in the snapshot
+  static int64_t find_str(const uint8_t* base, std::string_view s) noexcept;
+
+  // random-access iterator over an array of records, yielding views by value
+  template<typename View, typename Rec>
+  class rec_iterator {
+    const uint8_t* _base;
+    const Rec*     _p;
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type        = View;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = void;
+    using reference         = View;
+
+    rec_iterator(const uint8_t* base, const Rec* p) : _base(base), _p(p) {}
+
+    View operator*() const noexcept { return View(_base, _p); }
+    View operator[](difference_type n) const noexcept { return View(_base, _p + n); }
+
+    auto& operator++() noexcept { ++_p; return *this; }
+    auto& operator--() noexcept { --_p; return *this; }
+    auto  operator++(int) noexcept { auto i = *this; ++_p; return i; }
+    auto  operator--(int) noexcept { auto i = *this; --_p; return i; }
+    auto& operator+=(difference_type n) noexcept { _p += n; return *this; }
+    auto& operator-=(difference_type n) noexcept { _p -= n; return *this; }
+    auto  operator+(difference_type n) const noexcept { return rec_iterator(_base, _p + n); }
+    auto  operator-(difference_type n) const noexcept { return rec_iterator(_base, _p - n); }
+    auto  operator-(const rec_iterator& o) const noexcept { return _p - o._p; }
+
+    bool operator==(const rec_iterator& o) const noexcept { return _p == o._p; }
+    bool operator!=(const rec_iterator& o) const noexcept { return _p != o._p; }
+    bool operator< (const rec_iterator& o) const noexcept { return _p < o._p; }
+  };
+
+public:
+  class block;
+  class list;
+  class statement;
+
+  /* OBJECT -- view of a generic "any"-type syntax tree node */
+
+  class object {
+    const uint8_t*   _base;
+    const value_rec* _r;
+
+  public:
+    object(const uint8_t* base, const value_rec* r) : _base(base), _r(r) {}
+
+    const char* type_string() const noexcept;
+    Loc loc() const noexcept { return Loc(_r->line); }
+
+    bool is_null()      const noexcept { return _r->type == NIL; }
+    bool is_integer()   const noexcept { return _r->type == INTEGER; }
+    bool is_date()      const noexcept { return _r->type == DATE; }
+    bool is_decimal()   const noexcept { return _r->type == DECIMAL; }
+    bool is_binary_op() const noexcept { return _r->type == BINARY_OP; }
+    bool is_string()    const noexcept { return _r->type == STRING; }
+    bool is_block()     const noexcept { return _r->type == BLOCK; }
+    bool is_list()      const noexcept { return _r->type == LIST; }
+    bool is_number()    const noexcept { return is_integer() || is_decimal(); }
+
+    /* data accessors (unchecked type) */
+    int  as_integer() const noexcept { return static_cast<int32_t>(_r->data); }
+    date as_date()    const noexcept
+    {
+      return date(static_cast<int16_t>(_r->data & 0xFFFF), (_r->data >> 16) & 0xFF, _r->data >> 24);
+    }
+    fp3  as_decimal() const noexcept
+    {
+      return (is_integer()) ? fp3(as_integer()) : fp3::from_raw(static_cast<int32_t>(_r->data));
+    }
+    auto as_binary_op()   const noexcept { return static_cast<binary_op>(_r->data); }
+    auto as_string_view() const noexcept { return str(_base, _r->data); }
+    auto as_string()      const noexcept { return as_string_view().data(); }
+    block as_block() const noexcept;
+    list  as_list()  const noexcept;
+
+    struct TypeError : public Error
+    {
+      TypeError(const object* o, const char* requested_type)
+      : Error("Bad access of {}-type snapshot object as a {}", o->type_string(), requested_type) {}
+    };
+
+    /* data accessors (checked type, throws object::TypeError if type requested doesn't match type of object) */
+    auto get_integer()     const { if (!is_integer()) throw TypeError(this, "integer");    return as_integer(); }
+    auto get_date()        const { if (!is_date()) throw TypeError(this, "date");          return as_date(); }
+    auto get_decimal()     const { if (!is_number()) throw TypeError(this, "decimal");     return as_decimal(); }
+    auto get_binary_op()   const { if (!is_binary_op()) throw TypeError(this, "operator"); return as_binary_op(); }
+    auto get_string()      const { if (!is_string()) throw TypeError(this, "string");      return as_string(); }
+    auto get_string_view() const { if (!is_string()) throw TypeError(this, "string_view"); return as_string_view(); }
+    block get_block() const;
+    list  get_list()  const;
+
+    /* convenience equality operator overloads */
+    bool operator==(int i)   const noexcept { return is_integer() && as_integer() == i; }
+    bool operator==(date d)  const noexcept { return is_date() && as_date() == d; }
+    bool operator==(fp3 f)   const noexcept { return is_number() && as_decimal() == f; }
+    bool operator==(binary_op o) const noexcept { return is_binary_op() && as_binary_op() == o; }
+    bool operator==(std::string_view sv)  const noexcept { return is_string() && as_string_view() == sv; }
+    bool operator==(const char* s)        const noexcept { return *this == std::string_view(s); }
+    bool operator==(const std::string& s) const noexcept { return *this == std::string_view(s); }
+
+    template<typename T>
+    bool operator!=(const T& other) const noexcept { return !(*this == other); }
+  };
+
+  /* LIST -- view of a list of N objects */
+
+  class list {
+    const uint8_t*  _base;
+    const list_rec* _r;
+
+  public:
+    list(const uint8_t* base, const list_rec* r) : _base(base), _r(r) {}
+
+    using iterator = rec_iterator<object, value_rec>;
+
+    size_t size()  const noexcept { return _r->n; }
+    bool   empty() const noexcept { return _r->n == 0; }
+    auto   begin() const noexcept { return iterator(_base, _r->elems()); }
+    auto   end()   const noexcept { return iterator(_base, _r->elems() + _r->n); }
+    auto   operator[](size_t i) const noexcept { return object(_base, _r->elems() + i); }
+  };
+
+  /* STATEMENT -- view of a key, operator, value triple */
+
+  class statement {
+    const uint8_t*  _base;
+    const stmt_rec* _r;
+
+  public:
+    statement(const uint8_t* base, const stmt_rec* r) : _base(base), _r(r) {}
+
+    auto key()   const noexcept { return object(_base, &_r->key); }
+    auto op()    const noexcept { return object(_base, &_r->op); }
+    auto value() const noexcept { return object(_base, &_r->value); }
+  };
+
+  /* BLOCK -- view of a block of N statements */
+
+  class block {
+    const uint8_t*   _base;
+    const block_rec* _r;
+
+  public:
+    block(const uint8_t* base, const block_rec* r) : _base(base), _r(r) {}
+
+    using iterator = rec_iterator<statement, stmt_rec>;
+
+    size_t size()  const noexcept { return _r->n_stmts; }
+    bool   empty() const noexcept { return _r->n_stmts == 0; }
+    auto   begin() const noexcept { return iterator(_base, _r->stmts()); }
+    auto   end()   const noexcept { return iterator(_base, _r->stmts() + _r->n_stmts); }
+    auto   operator[](size_t i) const noexcept { return statement(_base, _r->stmts() + i); }
+
+    /* statement with the given string-type key (its final occurrence if repeated), or end() if not found. the key
+     * is resolved to a string ID via the snapshot's string hash table, and then that ID is binary-searched among
+     * the block's sorted key records. */
+    iterator find_key(std::string_view key) const noexcept;
+    iterator find_key(const char* key) const noexcept { return find_key(std::string_view(key)); }
+  };
+
+  snapshot(const fs::path&);
+
+  auto root() const noexcept
+  {
+    return block(_mf.data(), reinterpret_cast<const block_rec*>(_mf.data() + _hdr->root_off));
+  }
+
+  // path of the file from which the snapshot's parse tree was originally parsed (if it was specified)
+  auto source_path() const { return fs::path( str(_mf.data(), _hdr->src_path_str) ); }
+
+  const auto& path() const noexcept { return _mf.path(); }
+
+  auto floc(const Loc& loc)    const { return FLoc(source_path(), loc); }
+  auto floc(const object& obj) const { return FLoc(source_path(), obj.loc()); }
+
+private:
+  mapped_file   _mf;
+  const header* _hdr;
+};
+
+
+inline snapshot::block snapshot::object::as_block() const noexcept
+{
+  return block(_base, reinterpret_cast<const block_rec*>(_base + _r->data));
+}
+
+inline snapshot::list snapshot::object::as_list() const noexcept
+{
+  return list(_base, reinterpret_cast<const list_rec*>(_base + _r->data));
+}
+
+inline snapshot::block snapshot::object::get_block() const
+{
+  if (!is_block()) throw TypeError(this, "block");
+  return as_block();
+}
+
+inline snapshot::list snapshot::object::get_list() const
+{
+  if (!is_list()) throw TypeError(this, "list");
+  return as_list();
+}
+
+
+NAMESPACE_CK2_END;
+#endif
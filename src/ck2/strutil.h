@@ -2,6 +2,7 @@
 #define LIBCK2_STRUTIL_H
 
 #include <cstring>
+#include <string>
 #include <string_view>
 
 #include "common.h"
@@ -43,6 +44,51 @@ static inline constexpr auto is_blank(std::string_view s)
   return true;
 }
 
+// ASCII-only lowercase copy of a string (e.g., for case-insensitive keys). bytes outside of A-Z, incl. those of the
+// Windows-1252 upper half, are copied as-is.
+static inline std::string ascii_lower(std::string_view s)
+{
+  std::string r(s);
+
+  for (auto& c : r)
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+
+  return r;
+}
+
+// does the string match the glob pattern? '*' matches any run of characters and '?' any one character, but
+// neither matches `sep` (if given; e.g., '/' for paths).
+static inline bool glob_match(std::string_view pat, std::string_view s, char sep = '\0') noexcept
+{
+  size_t p = 0, i = 0;
+  size_t star_p = std::string_view::npos, star_i = 0; // backtrack point: past the last '*' & its match's end
+
+  while (i < s.size())
+  {
+    if (p < pat.size() && pat[p] == '*')
+    {
+      star_p = ++p;
+      star_i = i;
+    }
+    else if (p < pat.size() && (pat[p] == s[i] || (pat[p] == '?' && s[i] != sep)))
+    {
+      ++p;
+      ++i;
+    }
+    else if (star_p != std::string_view::npos && s[star_i] != sep) // the last '*' absorbs one more character
+    {
+      p = star_p;
+      i = ++star_i;
+    }
+    else
+      return false;
+  }
+
+  while (p < pat.size() && pat[p] == '*') ++p;
+  return p == pat.size();
+}
+
 //// mdh_strncpy
 
 // copy not more than `length` characters from the string `src` (including any NULL terminator) to the string
@@ -27,14 +27,16 @@ public:
 protected:
   uint  _type;
   uint  _text_len;
-  char* _text;
-  Loc   _loc;
+  char*    _text;
+  Loc      _loc;
+  uint16_t _kw;   // keyword ID (see keyword.h) of a STR or OPERATOR token, else keyword::NONE
+  src_span _span; // raw extent of the token in the input (i.e., including any quotes)
 
 public:
   static const char* TYPE_MAP[];
   const char* type_name() const noexcept { return TYPE_MAP[_type]; }
 
-  token(uint type_ = END) : _type(type_), _text_len(0), _text(nullptr) {}
+  token(uint type_ = END) : _type(type_), _text_len(0), _text(nullptr), _kw(0) {}
 
   uint type()       const noexcept { return _type; }
   void type(uint t)       noexcept { _type = t; }
@@ -45,6 +47,12 @@ public:
   const auto& loc()             const noexcept { return _loc; }
   void        loc(const Loc& l)       noexcept { _loc = l; }
 
+  uint16_t kw()            const noexcept { return _kw; }
+  void     kw(uint16_t id)       noexcept { _kw = id; }
+
+  const auto& span()                  const noexcept { return _span; }
+  void        span(const src_span& s)       noexcept { _span = s; }
+
   const char* text()                const noexcept { return _text; }
   char*       text()                      noexcept { return _text; }
   void        text(char* p, uint n)       noexcept { _text = p; _text_len = n; }
@@ -0,0 +1,291 @@
+
+#include "writer.h"
+#include "parser.h"
+#include "fmt/ostream.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+
+NAMESPACE_CK2;
+
+
+namespace {
+
+struct emitter
+{
+  std::string_view src;
+  std::string&     out;
+  uint             pend_begin = src_span::NONE; // pending (not yet flushed) verbatim source range
+  uint             pend_end   = src_span::NONE;
+
+  emitter(std::string_view src_, std::string& out_) : src(src_), out(out_) {}
+
+  /* copy source bytes [begin, end) verbatim, coalescing with the previous copy if it's contiguous */
+  void copy(uint begin, uint end)
+  {
+    if (begin >= end)
+      return;
+
+    if (pend_begin != src_span::NONE && pend_end == begin)
+    {
+      pend_end = end;
+      return;
+    }
+
+    flush();
+    pend_begin = begin;
+    pend_end = end;
+  }
+
+  void flush()
+  {
+    if (pend_begin == src_span::NONE)
+      return;
+
+    out.append(src.data() + pend_begin, pend_end - pend_begin);
+    pend_begin = pend_end = src_span::NONE;
+  }
+
+  void put(std::string_view s)
+  {
+    flush();
+    out.append(s);
+  }
+
+  /* the newline & indentation which precedes the parsed statements in block `b`, if any */
+  std::optional<std::string> infer_nl(const block& b) const
+  {
+    for (const auto& s : b)
+    {
+      if (s.span().null())
+        continue;
+
+      auto lead = src.substr(s.lead(), s.span().begin - s.lead());
+
+      if (auto i = lead.rfind('\n'); i != std::string_view::npos)
+        return std::string( lead.substr((i > 0 && lead[i-1] == '\r') ? i-1 : i) );
+    }
+
+    return std::nullopt;
+  }
+
+  /* ... or else indent one level deeper than the parent block's statements */
+  std::string child_nl(const block& b, std::string_view parent_nl) const
+  {
+    if (auto nl = infer_nl(b))
+      return *nl;
+
+    return std::string(parent_nl) + ((parent_nl.find('\t') != std::string_view::npos) ? "\t" : "    ");
+  }
+
+  /* is the block exactly as parsed, incl. its order of statements and all of its descendants? */
+  static bool pristine(const block& b)
+  {
+    if (b.span().null())
+      return false;
+
+    auto prev_end = b.span().begin;
+
+    for (const auto& s : b)
+    {
+      if (s.dirty() || s.lead() != prev_end || !pristine(s.value()))
+        return false;
+
+      prev_end = s.span().end;
+    }
+
+    return b.tail() == prev_end;
+  }
+
+  static bool pristine(const object& o)
+  {
+    if (o.is_block())
+      return pristine(*o.as_block());
+
+    if (o.is_list())
+    {
+      const auto& l = *o.as_list();
+
+      if (l.dirty())
+        return false;
+
+      for (const auto& e : l)
+        if (!pristine(e))
+          return false;
+    }
+
+    return true;
+  }
+
+  void write_scalar(const object& o)
+  {
+    if (o.is_string())
+    {
+      auto s = o.as_string_view();
+
+      if (s.empty() || s.find_first_of(" \t\r\n\xA0{}=<>#") != std::string_view::npos)
+        put(fmt::format("\"{}\"", s));
+      else
+        put(s);
+    }
+    else if (o.is_integer())
+      put(fmt::format("{}", o.as_integer()));
+    else if (o.is_date())
+      put(fmt::format("{}", o.as_date()));
+    else if (o.is_decimal())
+      put(fmt::format("{}", o.as_decimal()));
+    else if (o.is_binary_op())
+      put(to_string(o.as_binary_op()));
+    else
+      assert(false && "Unhandled object type");
+  }
+
+  void write_object(const object& o, std::string_view nl)
+  {
+    if (o.is_block())
+    {
+      const auto& b = *o.as_block();
+
+      if (b.span().null() && b.empty())
+        put("{ }");
+      else
+      {
+        put("{");
+        write_body(b, child_nl(b, nl));
+
+        if (b.span().null())
+          put(nl); // parsed blocks carry the whitespace before their closing brace in their tail
+
+        put("}");
+      }
+    }
+    else if (o.is_list())
+    {
+      put("{ ");
+
+      const list& l = *o.as_list(); // const, so that we don't dirty it
+
+      for (const auto& e : l)
+      {
+        write_object(e, nl);
+        put(" ");
+      }
+
+      put("}");
+    }
+    else
+      write_scalar(o);
+  }
+
+  void write_statement(const statement& s, std::string_view nl)
+  {
+    const auto& v = s.value();
+
+    if (!s.span().null() && !s.dirty())
+    {
+      if (v.is_block() && !v.as_block()->span().null())
+      {
+        // statement itself is clean, but its block may not be, so recurse between its braces
+        const auto& b = *v.as_block();
+        copy(s.span().begin, b.span().begin);
+        write_body(b, child_nl(b, nl));
+        copy(b.span().end, s.span().end);
+        return;
+      }
+
+      if (pristine(v))
+      {
+        copy(s.span().begin, s.span().end);
+        return;
+      }
+    }
+
+    write_scalar(s.key());
+    put(" ");
+    put((s.op().is_binary_op()) ? to_string(s.op().as_binary_op()) : "=");
+    put(" ");
+    write_object(v, nl);
+  }
+
+  void write_body(const block& b, std::string_view nl)
+  {
+    for (const auto& s : b)
+    {
+      if (s.span().null())
+        put(nl);
+      else
+        copy(s.lead(), s.span().begin);
+
+      write_statement(s, nl);
+    }
+
+    if (!b.span().null())
+      copy(b.tail(), b.span().end);
+  }
+};
+
+} // end anonymous namespace
+
+
+void writer::write(std::string& out, const block& root) const
+{
+  emitter e(_src, out);
+
+  if (root.span().null())
+  {
+    // wholly synthetic tree, so there's nothing to preserve
+    for (const auto& s : root)
+    {
+      e.write_statement(s, "\n");
+      e.put("\n");
+    }
+  }
+  else
+  {
+    if (root.span().end > _src.size())
+      throw Error("Source text ({} bytes) is shorter than the extent of the parse tree ({} bytes)",
+                  _src.size(), root.span().end);
+
+    e.copy(0, root.span().begin); // e.g., savegame header
+    e.write_body(root, e.infer_nl(root).value_or("\n"));
+    e.copy(root.span().end, _src.size());
+  }
+
+  e.flush();
+}
+
+
+void rewrite(const parser& prs, const fs::path& out_path)
+{
+  write_file_atomic(out_path, [&prs](std::FILE* f) { rewrite(prs, f); });
+}
+
+
+void rewrite(const parser& prs, std::FILE* f)
+{
+  std::string src, out;
+
+  {
+    auto spath = prs.path().generic_string();
+    unique_file_ptr ufp( std::fopen(spath.c_str(), "rb"), std::fclose );
+
+    if (ufp.get() == nullptr)
+      throw Error("Failed to open file: {}: {}", strerror(errno), spath);
+
+    src.resize(fs::file_size(prs.path()));
+
+    if (!src.empty() && std::fread(src.data(), src.size(), 1, ufp.get()) < 1)
+      throw Error("Failed to read file: {}: {}", strerror(errno), spath);
+  }
+
+  writer(src).write(out, *prs.root_block());
+
+  if (!out.empty() && std::fwrite(out.data(), out.size(), 1, f) < 1)
+    throw Error("Failed to write round-tripped {}: {}", prs.path().generic_string(), strerror(errno));
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,56 @@
+#ifndef LIBCK2_WRITER_H
+#define LIBCK2_WRITER_H
+
+#include "common.h"
+#include "filesystem.h"
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+
+NAMESPACE_CK2;
+
+
+class block;
+class parser;
+
+
+/* WRITER -- round-trip serialization of a parse tree against the source text from which it was parsed
+ *
+ * every parsed statement & block remembers its byte span in the source, along with where the comments and
+ * whitespace leading up to it begin. when writing, the spans of nodes which haven't been modified are copied
+ * straight from the original bytes (adjacent spans are coalesced, so an untouched file costs about one memcpy),
+ * and only dirty nodes are reserialized. comments & formatting thus survive, and diffs stay minimal.
+ *
+ * the source text must be byte-identical to the text from which the tree was parsed. nodes which weren't parsed at
+ * all (i.e., were composed programmatically) are formatted like block::print, except that their indentation is
+ * inferred from any parsed siblings.
+ */
+
+class writer {
+public:
+  writer(std::string_view src) : _src(src) {}
+
+  // append the serialization of a root block to `out`
+  void write(std::string& out, const block& root) const;
+
+  auto to_string(const block& root) const
+  {
+    std::string s;
+    write(s, root);
+    return s;
+  }
+
+private:
+  std::string_view _src;
+};
+
+
+// rewrite a parsed file: reload its source text from prs.path() and write the round-tripped parse tree to the given
+// output path (which may be the same as the source, as it's replaced atomically) or to an already-open stream.
+void rewrite(const parser& prs, const fs::path& out_path);
+void rewrite(const parser& prs, std::FILE*);
+
+
+NAMESPACE_CK2_END;
+#endif
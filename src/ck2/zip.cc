@@ -0,0 +1,378 @@
+
+#include "zip.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+
+
+NAMESPACE_CK2;
+
+
+static const uint32_t ZIP_LOCAL_SIG   = 0x04034b50;
+static const uint32_t ZIP_CENTRAL_SIG = 0x02014b50;
+static const uint32_t ZIP_EOCD_SIG    = 0x06054b50;
+static const size_t   ZIP_EOCD_SZ     = 22;
+static const size_t   ZIP_LOCAL_SZ    = 30;
+static const size_t   ZIP_CENTRAL_SZ  = 46;
+
+static const uint16_t ZIP_STORED   = 0;
+static const uint16_t ZIP_DEFLATED = 8;
+
+
+static uint16_t le16(const uint8_t* p) noexcept { return uint16_t(p[0] | (p[1] << 8)); }
+static uint32_t le32(const uint8_t* p) noexcept
+{
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+
+/* ZIP_ARCHIVE */
+
+zip_archive::zip_archive(const fs::path& path)
+: _mf(path)
+{
+  const uint8_t* const base = _mf.data();
+  const size_t sz = _mf.size();
+
+  /* find the end-of-central-directory record, which may be followed by a comment of up to 64KiB */
+
+  if (sz < ZIP_EOCD_SZ)
+    throw PathError("Not a zip archive (too small)", path);
+
+  const uint8_t* p_eocd = nullptr;
+  const size_t scan_min = (sz > ZIP_EOCD_SZ + 0xFFFF) ? sz - ZIP_EOCD_SZ - 0xFFFF : 0;
+
+  for (size_t off = sz - ZIP_EOCD_SZ + 1; off-- > scan_min;)
+  {
+    if (le32(base + off) == ZIP_EOCD_SIG && off + ZIP_EOCD_SZ + le16(base + off + 20) <= sz)
+    {
+      p_eocd = base + off;
+      break;
+    }
+  }
+
+  if (p_eocd == nullptr)
+    throw PathError("Not a zip archive (no end of central directory record)", path);
+
+  const uint16_t n_entries = le16(p_eocd + 10);
+  const uint32_t cd_sz     = le32(p_eocd + 12);
+  const uint32_t cd_off    = le32(p_eocd + 16);
+
+  if (n_entries == 0xFFFF || cd_sz == 0xFFFFFFFF || cd_off == 0xFFFFFFFF)
+    throw PathError("ZIP64 archives are unsupported", path);
+
+  if (uint64_t(cd_off) + cd_sz > sz)
+    throw PathError("Corrupt zip archive (central directory out of bounds)", path);
+
+  /* read the central directory */
+
+  _entries.reserve(n_entries);
+  const uint8_t* p = base + cd_off;
+  const uint8_t* const p_end = p + cd_sz;
+
+  for (uint i = 0; i < n_entries; ++i)
+  {
+    if (static_cast<size_t>(p_end - p) < ZIP_CENTRAL_SZ || le32(p) != ZIP_CENTRAL_SIG)
+      throw PathError(fmt::format("Corrupt zip archive (bad central directory record #{})", i), path);
+
+    const uint16_t name_len = le16(p + 28);
+    const size_t rec_sz = ZIP_CENTRAL_SZ + name_len + le16(p + 30) + le16(p + 32);
+
+    if (static_cast<size_t>(p_end - p) < rec_sz)
+      throw PathError(fmt::format("Corrupt zip archive (truncated central directory record #{})", i), path);
+
+    _entries.push_back(entry{
+      std::string(reinterpret_cast<const char*>(p + ZIP_CENTRAL_SZ), name_len),
+      le16(p + 8),
+      le16(p + 10),
+      le32(p + 16),
+      le32(p + 20),
+      le32(p + 24),
+      le32(p + 42),
+    });
+
+    p += rec_sz;
+  }
+
+  _index.reserve(_entries.size());
+
+  for (size_t i = 0; i < _entries.size(); ++i)
+    _index[_entries[i].name] = i; // if a name occurs more than once, the final occurrence wins
+}
+
+
+std::string_view zip_archive::raw_data(const entry& e) const
+{
+  const uint8_t* const base = _mf.data();
+  const size_t sz = _mf.size();
+  const size_t off = e.local_header_off;
+
+  if (off + ZIP_LOCAL_SZ > sz || le32(base + off) != ZIP_LOCAL_SIG)
+    throw PathError(fmt::format("Corrupt zip archive (bad local header for '{}')", e.name), path());
+
+  const size_t data_off = off + ZIP_LOCAL_SZ + le16(base + off + 26) + le16(base + off + 28);
+
+  if (data_off + e.comp_size > sz)
+    throw PathError(fmt::format("Corrupt zip archive (data for '{}' out of bounds)", e.name), path());
+
+  return std::string_view(reinterpret_cast<const char*>(base + data_off), e.comp_size);
+}
+
+
+/* ZIP_INFLATER -- incremental decompression of a single entry from its raw data in the mapping */
+
+class zip_inflater {
+  const zip_archive&        _za;
+  const zip_archive::entry& _e;
+  std::string_view _src;
+  size_t   _src_pos;
+  size_t   _n_out;
+  uint32_t _crc;
+  z_stream _zs;
+  bool     _z_init;
+  bool     _z_end;
+
+  auto err(std::string_view what) const
+  {
+    return PathError(fmt::format("Failed to decompress '{}' from zip archive: {}", _e.name, what), _za.path());
+  }
+
+public:
+  zip_inflater(const zip_archive& za, const zip_archive::entry& e)
+  : _za(za), _e(e), _src(za.raw_data(e)), _src_pos(0), _n_out(0), _crc(crc32(0, Z_NULL, 0)), _z_init(false),
+    _z_end(false)
+  {
+    if (e.flags & 0x1)
+      throw err("encrypted entries are unsupported");
+
+    if (e.method == ZIP_DEFLATED)
+    {
+      std::memset(&_zs, 0, sizeof(_zs));
+      _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_src.data()));
+      _zs.avail_in = static_cast<uInt>(_src.size());
+
+      if (inflateInit2(&_zs, -MAX_WBITS) != Z_OK) // raw deflate stream (no zlib header)
+        throw err("failed to initialize zlib");
+
+      _z_init = true;
+    }
+    else if (e.method != ZIP_STORED)
+      throw err(fmt::format("unsupported compression method {}", e.method));
+  }
+
+  ~zip_inflater() noexcept { if (_z_init) inflateEnd(&_zs); }
+
+  // decompress up to sz bytes into buf, returning the count. returns 0 only at the end of the entry, upon which the
+  // entry's size & CRC are verified.
+  size_t fill(char* buf, size_t sz)
+  {
+    size_t n;
+
+    if (_e.method == ZIP_STORED)
+    {
+      n = std::min(sz, _src.size() - _src_pos);
+      std::memcpy(buf, _src.data() + _src_pos, n);
+      _src_pos += n;
+    }
+    else
+    {
+      _zs.next_out = reinterpret_cast<Bytef*>(buf);
+      _zs.avail_out = static_cast<uInt>(sz);
+
+      while (_zs.avail_out > 0 && !_z_end)
+      {
+        const int ret = inflate(&_zs, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END)
+          _z_end = true;
+        else if (ret == Z_BUF_ERROR) // we supplied all input up front, so no progress means it's truncated
+          throw err("unexpected end of compressed data");
+        else if (ret != Z_OK)
+          throw err((_zs.msg) ? _zs.msg : "invalid compressed data");
+      }
+
+      n = sz - _zs.avail_out;
+    }
+
+    if (n == 0)
+    {
+      if (_n_out != _e.size)
+        throw err(fmt::format("size mismatch (expected {} bytes but got {})", _e.size, _n_out));
+      if (_crc != _e.crc32)
+        throw err("CRC mismatch");
+      return 0;
+    }
+
+    _n_out += n;
+    _crc = crc32(_crc, reinterpret_cast<const Bytef*>(buf), static_cast<uInt>(n));
+    return n;
+  }
+};
+
+
+std::string zip_archive::read(const entry& e) const
+{
+  zip_inflater inf(*this, e);
+  std::string buf(e.size, '\0');
+
+  size_t n = 0;
+
+  // the final fill() call is made with no space left, only to verify that we've reached the end & check the CRC
+  while (size_t n_filled = inf.fill(buf.data() + n, buf.size() - n))
+    n += n_filled;
+
+  return buf;
+}
+
+
+/* ZIP_ENTRY_STREAM */
+
+zip_entry_stream::zip_entry_stream(const zip_archive& za, const zip_archive::entry& e)
+: _p_inf(std::make_unique<zip_inflater>(za, e))
+, _n_filled(0)
+, _prod_idx(0)
+, _cons_idx(0)
+, _cons_pos(0)
+, _done(false)
+, _stop(false)
+{
+  for (auto& c : _chunks)
+  {
+    c.data = std::make_unique<char[]>(CHUNK_SZ);
+    c.size = 0;
+  }
+
+  _thread = std::thread([this]() { produce(); });
+}
+
+
+zip_entry_stream::~zip_entry_stream() noexcept
+{
+  {
+    std::lock_guard<std::mutex> lk(_mtx);
+    _stop = true;
+  }
+
+  _cv.notify_all();
+  _thread.join();
+}
+
+
+void zip_entry_stream::produce() noexcept
+{
+  try
+  {
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lk(_mtx);
+        _cv.wait(lk, [this]() { return _n_filled < N_CHUNKS || _stop; });
+        if (_stop) break;
+      }
+
+      // the reader never touches unfilled chunks, so we can fill this one outside of the lock
+      auto& c = _chunks[_prod_idx];
+      c.size = _p_inf->fill(c.data.get(), CHUNK_SZ);
+
+      if (c.size == 0)
+        break;
+
+      {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _prod_idx = (_prod_idx + 1) % N_CHUNKS;
+        ++_n_filled;
+      }
+
+      _cv.notify_all();
+    }
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lk(_mtx);
+    _p_err = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(_mtx);
+    _done = true;
+  }
+
+  _cv.notify_all();
+}
+
+
+size_t zip_entry_stream::read(char* buf, size_t max_sz)
+{
+  std::unique_lock<std::mutex> lk(_mtx);
+  _cv.wait(lk, [this]() { return _n_filled > 0 || _done; });
+
+  if (_n_filled == 0)
+  {
+    if (_p_err) std::rethrow_exception(_p_err);
+    return 0;
+  }
+
+  lk.unlock();
+
+  // the producer never touches filled chunks, so we can consume this one outside of the lock
+  const auto& c = _chunks[_cons_idx];
+  const size_t n = std::min(max_sz, c.size - _cons_pos);
+  std::memcpy(buf, c.data.get() + _cons_pos, n);
+  _cons_pos += n;
+
+  if (_cons_pos == c.size)
+  {
+    lk.lock();
+    _cons_idx = (_cons_idx + 1) % N_CHUNKS;
+    _cons_pos = 0;
+    --_n_filled;
+    lk.unlock();
+    _cv.notify_all();
+  }
+
+  return n;
+}
+
+
+/* convenience */
+
+std::unique_ptr<parser> parse_zipped_save(const fs::path& path)
+{
+  zip_archive za(path);
+  const zip_archive::entry* p_save = nullptr;
+
+  for (const auto& e : za.entries())
+  {
+    const auto& n = e.name;
+
+    if (!e.is_dir() && n.size() >= 4 && n.compare(n.size() - 4, 4, ".ck2") == 0)
+    {
+      p_save = &e;
+      break;
+    }
+  }
+
+  if (p_save == nullptr && za.entries().size() == 1 && !za.entries().front().is_dir())
+    p_save = &za.entries().front();
+
+  if (p_save == nullptr)
+    throw PathError("Zip archive contains no savegame entry (*.ck2)", path);
+
+  zip_entry_stream zs(za, *p_save);
+  return std::make_unique<parser>(zs, path / p_save->name, true);
+}
+
+
+bool is_zip_file(const fs::path& path)
+{
+  unique_file_ptr ufp( std::fopen(path.generic_string().c_str(), "rb"), std::fclose );
+  uint8_t sig[4];
+
+  return ufp && std::fread(sig, 1, sizeof(sig), ufp.get()) == sizeof(sig) && le32(sig) == ZIP_LOCAL_SIG;
+}
+
+
+NAMESPACE_CK2_END;
@@ -0,0 +1,127 @@
+#ifndef LIBCK2_ZIP_H
+#define LIBCK2_ZIP_H
+
+#include "common.h"
+#include "filesystem.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+NAMESPACE_CK2;
+
+
+class parser;
+class zip_inflater;
+
+
+/* ZIP_ARCHIVE -- read-only access to the entries of a zip archive
+ *
+ * the archive is memory-mapped, and its central directory is read once upon construction into an entry table with
+ * a hash index by name. only stored & deflated entries can be read; ZIP64 archives and encrypted entries aren't
+ * supported (nor used by CK2).
+ */
+
+class zip_archive {
+public:
+  struct entry {
+    std::string name; // as stored, i.e. relative w/ '/' separators (directories end with one)
+    uint16_t    flags;
+    uint16_t    method; // 0 = stored, 8 = deflated
+    uint32_t    crc32;
+    uint32_t    comp_size;
+    uint32_t    size;
+    uint32_t    local_header_off;
+
+    bool is_dir() const noexcept { return !name.empty() && name.back() == '/'; }
+  };
+
+  zip_archive(const fs::path&);
+
+  zip_archive(const zip_archive&) = delete;
+  zip_archive& operator=(const zip_archive&) = delete;
+
+  const auto& path()    const noexcept { return _mf.path(); }
+  const auto& entries() const noexcept { return _entries; }
+
+  // entry with the given name (exact match), or nullptr
+  const entry* find(std::string_view name) const noexcept
+  {
+    auto i = _index.find(name);
+    return (i != _index.end()) ? &_entries[i->second] : nullptr;
+  }
+
+  // the entry's (possibly compressed) data, as located via its local header
+  std::string_view raw_data(const entry&) const;
+
+  // decompress the entire entry into a buffer (and verify its CRC)
+  std::string read(const entry&) const;
+
+private:
+  mapped_file _mf;
+  std::vector<entry> _entries;
+  std::unordered_map<std::string_view, size_t> _index; // keys point into _entries' names, which are fixed after ctor
+};
+
+
+/* ZIP_ENTRY_STREAM -- lexer input which decompresses a zip entry in bounded chunks on a background thread
+ *
+ * the inflater runs up to N_CHUNKS chunks ahead of the reader, so decompression overlaps with lexing & parsing while
+ * the amount of decompressed data held in memory stays bounded. inflate errors (incl. CRC mismatches) are rethrown
+ * from read() once the data preceding them has been consumed.
+ */
+
+class zip_entry_stream : public lexer_input {
+public:
+  zip_entry_stream(const zip_archive&, const zip_archive::entry&);
+  ~zip_entry_stream() noexcept;
+
+  zip_entry_stream(const zip_entry_stream&) = delete;
+  zip_entry_stream& operator=(const zip_entry_stream&) = delete;
+
+  size_t read(char* buf, size_t max_sz) override;
+
+private:
+  static const size_t N_CHUNKS = 4;
+  static const size_t CHUNK_SZ = 256 * 1024;
+
+  struct chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  void produce() noexcept;
+
+  std::unique_ptr<zip_inflater> _p_inf;
+  chunk  _chunks[N_CHUNKS];
+  size_t _n_filled;   // number of chunks filled & not yet fully consumed
+  size_t _prod_idx;   // next chunk to fill
+  size_t _cons_idx;   // chunk being consumed
+  size_t _cons_pos;   // consumption offset into the chunk being consumed
+  bool   _done;       // producer has finished (due to the end of the data, an error, or being stopped)
+  bool   _stop;
+  std::exception_ptr      _p_err;
+  std::mutex              _mtx;
+  std::condition_variable _cv;
+  std::thread             _thread;
+};
+
+
+// parse a zip-compressed savegame, inflating its save entry (the one whose name ends with ".ck2", or the archive's
+// sole entry) straight into the parser
+std::unique_ptr<parser> parse_zipped_save(const fs::path&);
+
+// does the file begin with a zip local file header signature?
+bool is_zip_file(const fs::path&);
+
+
+NAMESPACE_CK2_END;
+#endif
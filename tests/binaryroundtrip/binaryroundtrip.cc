@@ -0,0 +1,235 @@
+
+#include <ck2.h>
+
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+
+
+using namespace ck2;
+
+
+// keys w/ a token code in the test's token table; others are encoded as strings
+static const char* const TOKEN_KEYS[] = { "name", "culture", "religion", "holder", "liege", "trait", "flag" };
+static const char* const STRING_KEYS[] = { "nickname", "dynasty_name", "custom_field", "quoted_field" };
+
+// keys whose values are dates (binary_options::date_fields)
+static const char* const DATE_KEYS[] = { "birth_date", "death_date" };
+
+
+// generate a random script file exercising every kind of statement the binary format supports: token & string
+// keys, integer & date keys, integer, decimal, date, token & quoted string values, blocks, and lists
+class script_gen {
+  std::mt19937 _rng;
+  std::string  _out;
+
+  uint pick(uint n) { return _rng() % n; }
+
+  void indent(uint depth) { _out.append(2 * depth, ' '); }
+
+  void date_text()
+  {
+    _out += fmt::format("{}.{}.{}", 500 + pick(1000), 1 + pick(12), 1 + pick(28));
+  }
+
+  void scalar()
+  {
+    switch (pick(5)) {
+      case 0: _out += std::to_string(int(pick(200000)) - 100000); break;
+      case 1: _out += fmt::format("{}.{:03}", int(pick(2000)) - 1000, pick(1000)); break;
+      case 2: _out += TOKEN_KEYS[pick(std::size(TOKEN_KEYS))]; break;
+      case 3: _out += fmt::format("\"quoted string {}\"", pick(1000)); break;
+      default: _out += fmt::format("word_{}", pick(1000)); break;
+    }
+  }
+
+  void value(uint depth)
+  {
+    const uint kind = (depth < 4) ? pick(8) : pick(5);
+
+    if (kind < 5)
+      scalar();
+    else if (kind == 5) // list of scalars
+    {
+      _out += "{";
+      for (uint n = 1 + pick(6); n > 0; --n) { _out += ' '; scalar(); }
+      _out += " }";
+    }
+    else if (kind == 6) // list of blocks
+    {
+      _out += "{\n";
+      for (uint n = 1 + pick(3); n > 0; --n)
+      {
+        indent(depth + 1);
+        _out += "{\n";
+        body(depth + 2, 1 + pick(3));
+        indent(depth + 1);
+        _out += "}\n";
+      }
+      indent(depth);
+      _out += "}";
+    }
+    else
+    {
+      const uint n = pick(5);
+      _out += "{\n";
+      body(depth + 1, n);
+      indent(depth);
+      _out += "}";
+    }
+  }
+
+  void body(uint depth, uint n_stmts)
+  {
+    for (uint i = 0; i < n_stmts; ++i)
+    {
+      indent(depth);
+
+      switch (pick(6)) {
+        case 0: // a history-style date block
+          date_text();
+          _out += " = ";
+          value(depth);
+          break;
+        case 1: // an ID-keyed entry
+          _out += std::to_string(pick(3000000));
+          _out += " = ";
+          value(depth);
+          break;
+        case 2:
+          _out += DATE_KEYS[pick(std::size(DATE_KEYS))];
+          _out += " = ";
+          date_text();
+          break;
+        case 3:
+          _out += STRING_KEYS[pick(std::size(STRING_KEYS))];
+          _out += " = ";
+          value(depth);
+          break;
+        default:
+          _out += TOKEN_KEYS[pick(std::size(TOKEN_KEYS))];
+          _out += " = ";
+          value(depth);
+          break;
+      }
+
+      _out += '\n';
+    }
+  }
+
+public:
+  script_gen(uint seed) : _rng(seed) {}
+
+  std::string generate(uint n_stmts)
+  {
+    _out.clear();
+    body(0, n_stmts);
+    return _out;
+  }
+};
+
+
+// describe the first difference between two trees (or return an empty string if they're the same)
+static std::string diff(const object& a, const object& b, const std::string& where);
+
+static std::string diff(const block& a, const block& b, const std::string& where)
+{
+  if (a.size() != b.size())
+    return fmt::format("{}: block sizes differ ({} vs. {})", where, a.size(), b.size());
+
+  auto ib = b.begin();
+
+  for (const auto& sa : a)
+  {
+    const auto& sb = *ib++;
+    std::ostringstream key;
+    key << sa.key();
+    const auto at = where + "/" + key.str();
+
+    if (auto d = diff(sa.key(), sb.key(), at + " (key)"); !d.empty()) return d;
+    if (auto d = diff(sa.value(), sb.value(), at); !d.empty()) return d;
+  }
+
+  return "";
+}
+
+static std::string diff(const object& a, const object& b, const std::string& where)
+{
+  if (std::string_view(a.type_string()) != b.type_string())
+    return fmt::format("{}: types differ ({} vs. {})", where, a.type_string(), b.type_string());
+
+  if (a.is_block())
+    return diff(*a.as_block(), *b.as_block(), where);
+
+  if (a.is_list())
+  {
+    const auto& la = *a.as_list();
+    const auto& lb = *b.as_list();
+
+    if (la.size() != lb.size())
+      return fmt::format("{}: list sizes differ ({} vs. {})", where, la.size(), lb.size());
+
+    for (size_t i = 0; i < la.size(); ++i)
+      if (auto d = diff(la[i], lb[i], fmt::format("{}[{}]", where, i)); !d.empty())
+        return d;
+
+    return "";
+  }
+
+  std::ostringstream sa, sb;
+  sa << a;
+  sb << b;
+
+  return (sa.str() != sb.str()) ? fmt::format("{}: values differ ({} vs. {})", where, sa.str(), sb.str()) : "";
+}
+
+
+int main(int argc, char** argv) {
+  const uint n_files = (argc >= 2) ? atoi(argv[1]) : 50;
+
+  try {
+    printf("libck2 %s\n", LIBCK2_VERSION_STRING);
+
+    binary_token_table tt;
+    uint16_t next_code = 0x2000;
+    for (auto k : TOKEN_KEYS) tt.add(next_code++, k);
+    for (auto k : DATE_KEYS)  tt.add(next_code++, k);
+
+    binary_options opt;
+    for (auto k : DATE_KEYS) opt.date_fields.emplace(k);
+
+    const auto dir = fs::temp_directory_path();
+    const auto txt_path = dir / "binaryroundtrip.txt";
+    const auto bin_path = dir / "binaryroundtrip.bin";
+    uint n_failed = 0;
+
+    for (uint i = 0; i < n_files; ++i)
+    {
+      /* text -> tree -> binary -> tree, which should equal the tree parsed from the text */
+
+      script_gen gen(i);
+      write_file_atomic(txt_path, [&](std::FILE* f) { std::fputs(gen.generate(40).c_str(), f); });
+
+      parser text(txt_path);
+      write_binary(bin_path, *text.root_block(), tt);
+      binary_parser bin(bin_path, tt, opt);
+
+      if (auto d = diff(*text.root_block(), *bin.root_block(), fmt::format("file {}", i)); !d.empty())
+      {
+        fprintf(stderr, "DIFFER: %s\n", d.c_str());
+        ++n_failed;
+      }
+    }
+
+    fs::remove(txt_path);
+    fs::remove(bin_path);
+
+    printf("%u of %u synthetic files round-tripped through the binary encoding\n", n_files - n_failed, n_files);
+    return (n_failed == 0) ? 0 : 1;
+  }
+  catch (std::exception& e) {
+    fprintf(stderr, "fatal: %s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,249 @@
+
+#include <ck2.h>
+#include <ck2/BMPHeader.h>
+#include <ck2/Color.h>
+#include <ck2/mapped_file.h>
+#include <ck2/parallel.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+using namespace ck2;
+
+
+// the ProvMap conversion loop from before the color LUT: per pixel, w/ an std::unordered_map<RGB, prov_id_t>
+// lookup whenever the color differs from its left neighbor's. (only for timing & checking ProvMap against.)
+std::unique_ptr<prov_id_t[]> reference_load(const fs::path& bmp_path, const DefinitionsTable& def_tbl)
+{
+  std::unordered_map<RGB, prov_id_t> color2id_map;
+
+  for (const auto& row : def_tbl)
+    color2id_map.emplace(row.color, row.id);
+
+  mapped_file mf(bmp_path);
+  const auto& hdr = *reinterpret_cast<const BMPHeader*>(mf.data());
+  const uint cols = hdr.n_width;
+  const uint rows = hdr.n_height;
+  const size_t row_sz = 4 * ((24 * size_t(cols) + 31) / 32);
+  auto map = std::make_unique<prov_id_t[]>(size_t(cols) * rows);
+
+  for (uint row = 0; row < rows; ++row)
+  {
+    const uint8_t* p_row = mf.data() + hdr.n_bitmap_offset + row * row_sz;
+    const auto y = rows - 1 - row;
+    uint8_t  prev_b = 0;
+    uint8_t  prev_g = 0;
+    uint8_t  prev_r = 0;
+    uint16_t prev_id = 0;
+
+    for (uint x = 0; x < cols; ++x)
+    {
+      uint8_t const* p = &p_row[3*x];
+      uint16_t id;
+
+      if (p[0] == 0xFF && p[1] == 0xFF && p[2] == 0xFF)
+        id = ProvMap::PM_OCEAN;
+      else if (p[0] == 0x00 && p[1] == 0x00 && p[2] == 0x00)
+        id = ProvMap::PM_IMPASSABLE;
+      else if (x > 0 && p[0] == prev_b && p[1] == prev_g && p[2] == prev_r)
+        id = prev_id;
+      else if (auto it = color2id_map.find({ p[2], p[1], p[0] }); it != color2id_map.end())
+        id = it->second;
+      else
+        throw Error("Unexpected color RGB({}, {}, {}) at pixel ({}, {})", p[2], p[1], p[0], x, y);
+
+      prev_b = p[0];
+      prev_g = p[1];
+      prev_r = p[2];
+      prev_id = map[size_t(y) * cols + x] = id;
+    }
+  }
+
+  return map;
+}
+
+
+// label the map's connected regions of equal IDs by flood fill (4-neighbor BFS), returning how many there are.
+// the labels share the map's layout, so this measures the layout's locality for neighborhood-heavy passes.
+size_t flood_fill_regions(const ProvMap& pm)
+{
+  std::vector<uint32_t> labels(pm.size(), 0);
+  std::vector<std::pair<uint, uint>> queue;
+  uint32_t n_regions = 0;
+
+  for (uint y = 0; y < pm.height(); ++y)
+    for (uint x = 0; x < pm.width(); ++x)
+    {
+      if (labels[pm.index(x, y)] != 0)
+        continue;
+
+      const prov_id_t id = pm(x, y);
+      labels[pm.index(x, y)] = ++n_regions;
+      queue.assign(1, { x, y });
+
+      for (size_t i = 0; i < queue.size(); ++i)
+      {
+        const auto [qx, qy] = queue[i];
+
+        auto visit = [&](uint nx, uint ny) {
+          auto& label = labels[pm.index(nx, ny)];
+
+          if (label == 0 && pm(nx, ny) == id)
+          {
+            label = n_regions;
+            queue.emplace_back(nx, ny);
+          }
+        };
+
+        if (qx > 0)                visit(qx - 1, qy);
+        if (qx + 1 < pm.width())  visit(qx + 1, qy);
+        if (qy > 0)                visit(qx, qy - 1);
+        if (qy + 1 < pm.height()) visit(qx, qy + 1);
+      }
+    }
+
+  return n_regions;
+}
+
+
+// count the vertical neighbors in different provinces, column by column (as a vertical edge scan does)
+size_t count_vertical_borders(const ProvMap& pm)
+{
+  size_t n = 0;
+
+  for (uint x = 0; x < pm.width(); ++x)
+    for (uint y = 0; y + 1 < pm.height(); ++y)
+      n += pm(x, y) != pm(x, y + 1);
+
+  return n;
+}
+
+
+// count the pixels whose right or lower neighbor is in another province, a tile at a time
+size_t count_border_pixels(const ProvMap& pm)
+{
+  std::vector<size_t> counts(pm.tile_count(), 0);
+
+  pm.for_each_tile([&](const ProvMap::const_tile& t)
+  {
+    size_t n = 0;
+
+    for (uint y = t.y0; y < t.y1; ++y)
+    {
+      const prov_id_t* row = t.row(y);
+      const prov_id_t* below = (t.contains(t.x0, y + 1)) ? t.row(y + 1) : nullptr;
+
+      for (uint x = t.x0; x < t.x1; ++x)
+      {
+        const prov_id_t id = row[x - t.x0];
+        const bool right_differs = (x + 1 < t.x1) ? row[x + 1 - t.x0] != id
+                                                  : (x + 1 < pm.width() && pm(x + 1, y) != id);
+        const bool below_differs = (below) ? below[x - t.x0] != id
+                                           : (y + 1 < pm.height() && pm(x, y + 1) != id);
+        n += right_differs || below_differs;
+      }
+    }
+
+    counts[(t.y0 / ProvMap::TILE_SZ) * pm.tiles_x() + t.x0 / ProvMap::TILE_SZ] = n;
+  }, 1);
+
+  size_t total = 0;
+  for (auto n : counts) total += n;
+  return total;
+}
+
+
+// best wall time of several runs, in milliseconds
+double best_ms(uint n_runs, const std::function<void()>& fn)
+{
+  double best = 1e300;
+
+  for (uint i = 0; i < n_runs; ++i)
+  {
+    const auto t0 = std::chrono::steady_clock::now();
+    fn();
+    const auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+  }
+
+  return best;
+}
+
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s GAME_OR_MOD_FOLDER [RUNS]\n", argv[0]);
+    return 2;
+  }
+
+  const uint n_runs = (argc >= 3) ? atoi(argv[2]) : 5;
+
+  try {
+    printf("libck2 %s\n", LIBCK2_VERSION_STRING);
+
+    VFS vfs(argv[1]);
+    DefaultMap dm(vfs);
+    DefinitionsTable def_tbl(vfs, dm);
+    const auto bmp_path = vfs["map" / dm.province_map_path()];
+
+    std::unique_ptr<prov_id_t[]> ref_map;
+    std::unique_ptr<ProvMap> p_pm;
+
+    const double ref_ms = best_ms(n_runs, [&]() { ref_map = reference_load(bmp_path, def_tbl); });
+    const double lut_1t_ms = best_ms(n_runs, [&]() { p_pm = std::make_unique<ProvMap>(vfs, dm, def_tbl, 1); });
+    const double lut_ms = best_ms(n_runs, [&]() { p_pm = std::make_unique<ProvMap>(vfs, dm, def_tbl); });
+
+    const size_t n_px = size_t(p_pm->width()) * p_pm->height();
+    const bool same = std::memcmp(ref_map.get(), p_pm->data(), n_px * sizeof(prov_id_t)) == 0;
+
+    printf("%s: %ux%u, %zu provinces (best of %u runs)\n", bmp_path.generic_string().c_str(), p_pm->width(),
+           p_pm->height(), def_tbl.size(), n_runs);
+    printf("  per-pixel hash map (serial):  %8.1f ms\n", ref_ms);
+    printf("  ProvMap, 1 thread:            %8.1f ms  (%.2fx)\n", lut_1t_ms, ref_ms / lut_1t_ms);
+    printf("  ProvMap, %2u threads:          %8.1f ms  (%.2fx)\n", default_thread_count(), lut_ms,
+           ref_ms / lut_ms);
+    printf("  results %s\n", (same) ? "match" : "DIFFER");
+
+    /* compare the layouts on neighborhood-heavy passes (each upon one thread) */
+
+    ProvMap tiled(vfs, dm, def_tbl, 0, ProvMap::Layout::Tiled);
+    bool layouts_same = true;
+
+    for (uint y = 0; y < tiled.height(); ++y)
+      for (uint x = 0; x < tiled.width(); ++x)
+        layouts_same = layouts_same && tiled(x, y) == (*p_pm)(x, y);
+
+    size_t rm_regions = 0, tl_regions = 0, rm_vert = 0, tl_vert = 0, rm_border = 0, tl_border = 0;
+    const double rm_fill_ms = best_ms(n_runs, [&]() { rm_regions = flood_fill_regions(*p_pm); });
+    const double tl_fill_ms = best_ms(n_runs, [&]() { tl_regions = flood_fill_regions(tiled); });
+    const double rm_vert_ms = best_ms(n_runs, [&]() { rm_vert = count_vertical_borders(*p_pm); });
+    const double tl_vert_ms = best_ms(n_runs, [&]() { tl_vert = count_vertical_borders(tiled); });
+    const double rm_border_ms = best_ms(n_runs, [&]() { rm_border = count_border_pixels(*p_pm); });
+    const double tl_border_ms = best_ms(n_runs, [&]() { tl_border = count_border_pixels(tiled); });
+
+    layouts_same = layouts_same && rm_regions == tl_regions && rm_vert == tl_vert && rm_border == tl_border;
+
+    printf("layouts (row-major vs. %ux%u tiles):\n", ProvMap::TILE_SZ, ProvMap::TILE_SZ);
+    auto print_pass = [](const char* name, size_t result, double rm_ms, double tl_ms) {
+      printf("  %-28s %8.1f ms  vs. %8.1f ms  (%zu)\n", name, rm_ms, tl_ms, result);
+    };
+
+    print_pass("flood fill (regions):", rm_regions, rm_fill_ms, tl_fill_ms);
+    print_pass("vertical borders, by column:", rm_vert, rm_vert_ms, tl_vert_ms);
+    print_pass("border pixels, by tile:", rm_border, rm_border_ms, tl_border_ms);
+    printf("  results %s\n", (layouts_same) ? "match" : "DIFFER");
+
+    return (same && layouts_same) ? 0 : 1;
+  }
+  catch (std::exception& e) {
+    fprintf(stderr, "fatal: %s\n", e.what());
+    return 1;
+  }
+}